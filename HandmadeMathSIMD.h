@@ -0,0 +1,1571 @@
+/*
+  HandmadeMathSIMD.h
+
+  Batched companion to HandmadeMath.h. Where HandmadeMath works on one
+  matrix at a time, the functions in here work on whole arrays of matrices
+  stored structure-of-arrays, so that each SIMD lane holds the same element
+  of a different matrix.
+
+  =============================================================================
+
+  The kernels are selected at runtime. You MUST
+
+     #define HANDMADE_MATH_SIMD_IMPLEMENTATION
+
+  in EXACTLY one C file that includes this header, BEFORE the include, like
+  this:
+
+     #define HANDMADE_MATH_SIMD_IMPLEMENTATION
+     #include "HandmadeMathSIMD.h"
+
+  and call HMM_SIMDInit() once at startup. It queries cpuid and installs the
+  widest kernels the CPU and OS support (AVX-512, AVX2, SSE2 or scalar).
+  Calling a batch function before HMM_SIMDInit() initializes lazily.
+
+  =============================================================================
+
+  Every batch kernel is written once and instantiated per ISA, and none of
+  them use FMA, so all ISA levels (including the scalar fallback) produce
+  bit-identical results as long as the compiler does not contract a*b+c
+  itself. This header turns contraction off for its own code with
+  #pragma STDC FP_CONTRACT OFF, which Clang (contracting by default)
+  honours. GCC ignores the pragma and contracts in its GNU modes, so build
+  with -std=c99 or -ffp-contract=off, as the Makefile does.
+  HMM_MultiplyMat4Batch also matches the SSE path of HMM_MultiplyMat4.
+
+  Single matrix inverses (HMM_InverseMat4 and friends) live in here too,
+  with special cases for affine and rigid-body matrices, as does frustum
+  corner extraction (HMM_FrustumCorners and HMM_FrustumCornersBatch), which
+  writes straight into an interleaved vertex buffer ready for upload, and
+  closed-form translate/rotate/scale model matrix composition
+  (HMM_ComposeTRSEuler, HMM_ComposeTRSQuaternion) built on a 4-wide sincos.
+  HMM_ComposeTRSEulerBatch and HMM_LookAtBatch build whole batches of model
+  and view matrices from structure-of-arrays inputs.
+
+  Defining HANDMADE_MATH_NO_SSE disables everything but the scalar kernels.
+*/
+
+#ifndef HANDMADE_MATH_SIMD_H
+#define HANDMADE_MATH_SIMD_H
+
+#include "HandmadeMath.h"
+
+#ifdef HANDMADE_MATH__USE_SSE
+# if defined(__x86_64__) || defined(__i386__) || defined(_M_AMD64) || defined(_M_IX86)
+#  define HANDMADE_MATH__X86_DISPATCH 1
+#  include <emmintrin.h>
+# endif
+#endif
+
+#ifdef __clang__
+# pragma STDC FP_CONTRACT OFF
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum hmm_simd_level
+{
+    HMM_SIMD_SCALAR,
+    HMM_SIMD_SSE2,
+    HMM_SIMD_AVX2,
+    HMM_SIMD_AVX512,
+    HMM_SIMD_LEVEL_COUNT
+} hmm_simd_level;
+
+/*
+ * A batch of Count matrices. Elements[Column][Row] points at Count floats,
+ * the i-th of which is Elements[Column][Row] of the i-th matrix, so the
+ * indexing mirrors hmm_mat4.Elements.
+ */
+typedef struct hmm_mat4_soa
+{
+    float *Elements[4][4];
+    int Count;
+    void *Memory;
+} hmm_mat4_soa;
+
+hmm_simd_level HMM_PREFIX(SIMDInit)(void);
+hmm_simd_level HMM_PREFIX(SIMDMaxLevel)(void);
+hmm_simd_level HMM_PREFIX(SIMDLevel)(void);
+hmm_simd_level HMM_PREFIX(SetSIMDLevel)(hmm_simd_level Level);
+const char *HMM_PREFIX(SIMDLevelName)(hmm_simd_level Level);
+
+hmm_bool HMM_PREFIX(AllocMat4SoA)(hmm_mat4_soa *Batch, int Count);
+void HMM_PREFIX(FreeMat4SoA)(hmm_mat4_soa *Batch);
+
+/* Result[i] = Left[i] * Right[i]. Result may alias Right but not Left. */
+void HMM_PREFIX(MultiplyMat4Batch)(const hmm_mat4_soa *Left, const hmm_mat4_soa *Right,
+                                   hmm_mat4_soa *Result, int Count);
+
+/*
+ * What the caller knows about a matrix it wants inverted. AFFINE means the
+ * bottom row is (0, 0, 0, 1); RIGID additionally means the upper 3x3 is a
+ * pure rotation (orthonormal, no scale), as produced by HMM_LookAt.
+ */
+typedef enum hmm_mat4_kind
+{
+    HMM_MAT4_GENERAL,
+    HMM_MAT4_AFFINE,
+    HMM_MAT4_RIGID
+} hmm_mat4_kind;
+
+/* Result[i] = inverse(Matrices[i]). Result may alias Matrices. */
+void HMM_PREFIX(InverseMat4Batch)(const hmm_mat4_soa *Matrices, hmm_mat4_soa *Result,
+                                  int Count, hmm_mat4_kind Kind);
+
+/*
+ * Frustum corners, unprojected from the clip-space cube through an inverse
+ * view-projection (world space) or inverse MVP (object space) matrix.
+ * Corner c of matrix i is written as x, y, z to
+ * Dest[(i * 8 + c) * VertexStride], so Dest can be a vertex buffer with
+ * other attributes interleaved. Corners are ordered near then far, each as
+ * left-bottom, left-top, right-top, right-bottom; corner c + 4 is the far
+ * counterpart of near corner c.
+ */
+void HMM_PREFIX(FrustumCornersBatch)(const hmm_mat4_soa *InvViewProj, float *Dest,
+                                     int Count, int VertexStride);
+
+/*
+ * Accuracy tiers of the batched sine and cosine, measured against double
+ * precision sin/cos. Ulp errors are for results with magnitude >= 0.05,
+ * near the zeros the absolute error bound is the meaningful one.
+ *
+ *   PRECISE  Cephes polynomials, three-part pi/2 reduction.
+ *            Max 1.5 ulp and 8e-8 absolute for |x| <= 8192.
+ *   FAST     Degree 5/6 minimax polynomials, two-part reduction.
+ *            Max 26 ulp for |x| <= 1000, 37 ulp for |x| <= 8192,
+ *            1.5e-6 absolute.
+ *
+ * Both give exactly 0 and 1 for x = 0.
+ */
+typedef enum hmm_sincos_accuracy
+{
+    HMM_SINCOS_PRECISE,
+    HMM_SINCOS_FAST
+} hmm_sincos_accuracy;
+
+/* Sin[i] = sin(Angles[i]), Cos[i] = cos(Angles[i]), radians. Sin or Cos may alias Angles. */
+void HMM_PREFIX(SinCosBatch)(const float *Angles, float *Sin, float *Cos, int Count,
+                             hmm_sincos_accuracy Accuracy);
+
+/*
+ * Result[i] = HMM_Rotate(Angles[i], Axis[i]) with the axis split into
+ * AxisX, AxisY and AxisZ arrays. Angles are in degrees and the axes are
+ * normalized like HMM_Rotate does, so they must not be zero.
+ */
+void HMM_PREFIX(RotateBatch)(const float *Angles, const float *AxisX, const float *AxisY,
+                             const float *AxisZ, hmm_mat4_soa *Result, int Count,
+                             hmm_sincos_accuracy Accuracy);
+
+/*
+ * Three arrays of Count floats holding the components of Count vectors,
+ * the inputs of the batched model and view matrix builders below.
+ */
+typedef struct hmm_vec3_soa
+{
+    const float *X;
+    const float *Y;
+    const float *Z;
+} hmm_vec3_soa;
+
+/*
+ * Result[i] = HMM_ComposeTRSEuler(Translation[i], EulerDegrees[i], Scale[i]).
+ * With HMM_SINCOS_PRECISE this is bit-identical to HMM_ComposeTRSEuler
+ * whenever that uses SSE.
+ */
+void HMM_PREFIX(ComposeTRSEulerBatch)(const hmm_vec3_soa *Translation, const hmm_vec3_soa *EulerDegrees,
+                                      const hmm_vec3_soa *Scale, hmm_mat4_soa *Result, int Count,
+                                      hmm_sincos_accuracy Accuracy);
+
+/*
+ * Result[i] = HMM_LookAt(Eye[i], Center[i], Up[i]), bit for bit. Unlike
+ * HMM_LookAt there is no zero check, so Center must differ from Eye and Up
+ * must not be parallel to the view direction.
+ */
+void HMM_PREFIX(LookAtBatch)(const hmm_vec3_soa *Eye, const hmm_vec3_soa *Center,
+                             const hmm_vec3_soa *Up, hmm_mat4_soa *Result, int Count);
+
+HMM_INLINE void HMM_PREFIX(StoreMat4SoA)(hmm_mat4_soa *Batch, int Index, hmm_mat4 Matrix)
+{
+    int Columns;
+    for(Columns = 0; Columns < 4; ++Columns)
+    {
+        int Rows;
+        for(Rows = 0; Rows < 4; ++Rows)
+        {
+            Batch->Elements[Columns][Rows][Index] = Matrix.Elements[Columns][Rows];
+        }
+    }
+}
+
+HMM_INLINE hmm_mat4 HMM_PREFIX(LoadMat4SoA)(const hmm_mat4_soa *Batch, int Index)
+{
+    hmm_mat4 Result;
+
+    int Columns;
+    for(Columns = 0; Columns < 4; ++Columns)
+    {
+        int Rows;
+        for(Rows = 0; Rows < 4; ++Rows)
+        {
+            Result.Elements[Columns][Rows] = Batch->Elements[Columns][Rows][Index];
+        }
+    }
+
+    return (Result);
+}
+
+/*
+ * Single matrix inverses
+ */
+
+#ifdef HANDMADE_MATH__USE_SSE
+/* 2x2 helpers for the block inverse, each __m128 holds a 2x2 as (m00, m01, m10, m11) */
+HMM_INLINE __m128 HMM_PREFIX(Mat2MulSSE)(__m128 Left, __m128 Right)
+{
+    return _mm_add_ps(_mm_mul_ps(Left, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(Left, Left, _MM_SHUFFLE(2, 3, 0, 1)),
+                                 _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+/* adj(Left) * Right */
+HMM_INLINE __m128 HMM_PREFIX(Mat2AdjMulSSE)(__m128 Left, __m128 Right)
+{
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(Left, Left, _MM_SHUFFLE(0, 0, 3, 3)), Right),
+                      _mm_mul_ps(_mm_shuffle_ps(Left, Left, _MM_SHUFFLE(2, 2, 1, 1)),
+                                 _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+/* Left * adj(Right) */
+HMM_INLINE __m128 HMM_PREFIX(Mat2MulAdjSSE)(__m128 Left, __m128 Right)
+{
+    return _mm_sub_ps(_mm_mul_ps(Left, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(Left, Left, _MM_SHUFFLE(2, 3, 0, 1)),
+                                 _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+HMM_INLINE __m128 HMM_PREFIX(Cross3SSE)(__m128 Left, __m128 Right)
+{
+    __m128 Result = _mm_sub_ps(_mm_mul_ps(Left, _mm_shuffle_ps(Right, Right, _MM_SHUFFLE(3, 0, 2, 1))),
+                               _mm_mul_ps(_mm_shuffle_ps(Left, Left, _MM_SHUFFLE(3, 0, 2, 1)), Right));
+    return _mm_shuffle_ps(Result, Result, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+/* Full inverse of an arbitrary invertible matrix */
+HMM_INLINE hmm_mat4 HMM_PREFIX(InverseMat4General)(hmm_mat4 Matrix)
+{
+    hmm_mat4 Result;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    /* Block inverse over the 2x2 sub-matrices A B / C D. Inverting the
+       transpose gives the transpose of the inverse, so this works directly
+       on columns. */
+    __m128 A = _mm_movelh_ps(Matrix.Columns[0], Matrix.Columns[1]);
+    __m128 B = _mm_movehl_ps(Matrix.Columns[1], Matrix.Columns[0]);
+    __m128 C = _mm_movelh_ps(Matrix.Columns[2], Matrix.Columns[3]);
+    __m128 D = _mm_movehl_ps(Matrix.Columns[3], Matrix.Columns[2]);
+
+    /* (|A|, |B|, |C|, |D|) */
+    __m128 DetSub = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(Matrix.Columns[0], Matrix.Columns[2], _MM_SHUFFLE(2, 0, 2, 0)),
+                   _mm_shuffle_ps(Matrix.Columns[1], Matrix.Columns[3], _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(Matrix.Columns[0], Matrix.Columns[2], _MM_SHUFFLE(3, 1, 3, 1)),
+                   _mm_shuffle_ps(Matrix.Columns[1], Matrix.Columns[3], _MM_SHUFFLE(2, 0, 2, 0))));
+    __m128 DetA = _mm_shuffle_ps(DetSub, DetSub, 0x00);
+    __m128 DetB = _mm_shuffle_ps(DetSub, DetSub, 0x55);
+    __m128 DetC = _mm_shuffle_ps(DetSub, DetSub, 0xaa);
+    __m128 DetD = _mm_shuffle_ps(DetSub, DetSub, 0xff);
+
+    __m128 D_C = HMM_PREFIX(Mat2AdjMulSSE)(D, C);
+    __m128 A_B = HMM_PREFIX(Mat2AdjMulSSE)(A, B);
+    __m128 X_ = _mm_sub_ps(_mm_mul_ps(DetD, A), HMM_PREFIX(Mat2MulSSE)(B, D_C));
+    __m128 W_ = _mm_sub_ps(_mm_mul_ps(DetA, D), HMM_PREFIX(Mat2MulSSE)(C, A_B));
+    __m128 Y_ = _mm_sub_ps(_mm_mul_ps(DetB, C), HMM_PREFIX(Mat2MulAdjSSE)(D, A_B));
+    __m128 Z_ = _mm_sub_ps(_mm_mul_ps(DetC, B), HMM_PREFIX(Mat2MulAdjSSE)(A, D_C));
+
+    /* |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C) */
+    __m128 DetM = _mm_add_ps(_mm_mul_ps(DetA, DetD), _mm_mul_ps(DetB, DetC));
+    __m128 Trace = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)));
+    Trace = _mm_add_ps(Trace, _mm_shuffle_ps(Trace, Trace, _MM_SHUFFLE(2, 3, 0, 1)));
+    Trace = _mm_add_ps(Trace, _mm_shuffle_ps(Trace, Trace, _MM_SHUFFLE(1, 0, 3, 2)));
+    DetM = _mm_sub_ps(DetM, Trace);
+
+    __m128 InvDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), DetM);
+    X_ = _mm_mul_ps(X_, InvDetM);
+    Y_ = _mm_mul_ps(Y_, InvDetM);
+    Z_ = _mm_mul_ps(Z_, InvDetM);
+    W_ = _mm_mul_ps(W_, InvDetM);
+
+    Result.Columns[0] = _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3));
+    Result.Columns[1] = _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2));
+    Result.Columns[2] = _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3));
+    Result.Columns[3] = _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2));
+#else
+    float t[6];
+    float a = Matrix.Elements[0][0], b = Matrix.Elements[0][1], c = Matrix.Elements[0][2], d = Matrix.Elements[0][3],
+          e = Matrix.Elements[1][0], f = Matrix.Elements[1][1], g = Matrix.Elements[1][2], h = Matrix.Elements[1][3],
+          i = Matrix.Elements[2][0], j = Matrix.Elements[2][1], k = Matrix.Elements[2][2], l = Matrix.Elements[2][3],
+          m = Matrix.Elements[3][0], n = Matrix.Elements[3][1], o = Matrix.Elements[3][2], p = Matrix.Elements[3][3];
+
+    t[0] = k * p - o * l; t[1] = j * p - n * l; t[2] = j * o - n * k;
+    t[3] = i * p - m * l; t[4] = i * o - m * k; t[5] = i * n - m * j;
+
+    Result.Elements[0][0] =  f * t[0] - g * t[1] + h * t[2];
+    Result.Elements[1][0] =-(e * t[0] - g * t[3] + h * t[4]);
+    Result.Elements[2][0] =  e * t[1] - f * t[3] + h * t[5];
+    Result.Elements[3][0] =-(e * t[2] - f * t[4] + g * t[5]);
+
+    Result.Elements[0][1] =-(b * t[0] - c * t[1] + d * t[2]);
+    Result.Elements[1][1] =  a * t[0] - c * t[3] + d * t[4];
+    Result.Elements[2][1] =-(a * t[1] - b * t[3] + d * t[5]);
+    Result.Elements[3][1] =  a * t[2] - b * t[4] + c * t[5];
+
+    t[0] = g * p - o * h; t[1] = f * p - n * h; t[2] = f * o - n * g;
+    t[3] = e * p - m * h; t[4] = e * o - m * g; t[5] = e * n - m * f;
+
+    Result.Elements[0][2] =  b * t[0] - c * t[1] + d * t[2];
+    Result.Elements[1][2] =-(a * t[0] - c * t[3] + d * t[4]);
+    Result.Elements[2][2] =  a * t[1] - b * t[3] + d * t[5];
+    Result.Elements[3][2] =-(a * t[2] - b * t[4] + c * t[5]);
+
+    t[0] = g * l - k * h; t[1] = f * l - j * h; t[2] = f * k - j * g;
+    t[3] = e * l - i * h; t[4] = e * k - i * g; t[5] = e * j - i * f;
+
+    Result.Elements[0][3] =-(b * t[0] - c * t[1] + d * t[2]);
+    Result.Elements[1][3] =  a * t[0] - c * t[3] + d * t[4];
+    Result.Elements[2][3] =-(a * t[1] - b * t[3] + d * t[5]);
+    Result.Elements[3][3] =  a * t[2] - b * t[4] + c * t[5];
+
+    Result = HMM_PREFIX(MultiplyMat4f)(Result, 1.0f / (a * Result.Elements[0][0] + b * Result.Elements[1][0]
+                                                      + c * Result.Elements[2][0] + d * Result.Elements[3][0]));
+#endif
+
+    return (Result);
+}
+
+/* Inverse of a matrix whose bottom row is (0, 0, 0, 1): invert the upper
+   3x3 with cross products and rotate the translation back through it. */
+HMM_INLINE hmm_mat4 HMM_PREFIX(InverseMat4Affine)(hmm_mat4 Matrix)
+{
+    hmm_mat4 Result;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    __m128 BxC = HMM_PREFIX(Cross3SSE)(Matrix.Columns[1], Matrix.Columns[2]);
+    __m128 CxA = HMM_PREFIX(Cross3SSE)(Matrix.Columns[2], Matrix.Columns[0]);
+    __m128 AxB = HMM_PREFIX(Cross3SSE)(Matrix.Columns[0], Matrix.Columns[1]);
+    __m128 Det = _mm_mul_ps(Matrix.Columns[0], BxC);
+    Det = _mm_add_ps(_mm_add_ps(_mm_shuffle_ps(Det, Det, 0x00), _mm_shuffle_ps(Det, Det, 0x55)),
+                     _mm_shuffle_ps(Det, Det, 0xaa));
+    __m128 InvDet = _mm_div_ps(_mm_set1_ps(1.0f), Det);
+
+    /* rows of the inverse 3x3 are the cross products, transpose back to columns */
+    Result.Columns[0] = _mm_mul_ps(BxC, InvDet);
+    Result.Columns[1] = _mm_mul_ps(CxA, InvDet);
+    Result.Columns[2] = _mm_mul_ps(AxB, InvDet);
+    Result.Columns[3] = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(Result.Columns[0], Result.Columns[1], Result.Columns[2], Result.Columns[3]);
+
+    __m128 T = Matrix.Columns[3];
+    Result.Columns[3] = _mm_mul_ps(_mm_shuffle_ps(T, T, 0x00), Result.Columns[0]);
+    Result.Columns[3] = _mm_add_ps(Result.Columns[3], _mm_mul_ps(_mm_shuffle_ps(T, T, 0x55), Result.Columns[1]));
+    Result.Columns[3] = _mm_add_ps(Result.Columns[3], _mm_mul_ps(_mm_shuffle_ps(T, T, 0xaa), Result.Columns[2]));
+    Result.Columns[3] = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), Result.Columns[3]);
+#else
+    hmm_vec3 A = HMM_PREFIX(Vec3)(Matrix.Elements[0][0], Matrix.Elements[0][1], Matrix.Elements[0][2]);
+    hmm_vec3 B = HMM_PREFIX(Vec3)(Matrix.Elements[1][0], Matrix.Elements[1][1], Matrix.Elements[1][2]);
+    hmm_vec3 C = HMM_PREFIX(Vec3)(Matrix.Elements[2][0], Matrix.Elements[2][1], Matrix.Elements[2][2]);
+    hmm_vec3 InverseRows[3];
+    float InvDet;
+    int Columns, Rows;
+
+    InverseRows[0] = HMM_PREFIX(Cross)(B, C);
+    InverseRows[1] = HMM_PREFIX(Cross)(C, A);
+    InverseRows[2] = HMM_PREFIX(Cross)(A, B);
+    InvDet = 1.0f / HMM_PREFIX(DotVec3)(A, InverseRows[0]);
+
+    for(Columns = 0; Columns < 3; ++Columns)
+    {
+        Result.Elements[Columns][0] = InverseRows[0].Elements[Columns] * InvDet;
+        Result.Elements[Columns][1] = InverseRows[1].Elements[Columns] * InvDet;
+        Result.Elements[Columns][2] = InverseRows[2].Elements[Columns] * InvDet;
+        Result.Elements[Columns][3] = 0.0f;
+    }
+
+    for(Rows = 0; Rows < 3; ++Rows)
+    {
+        Result.Elements[3][Rows] = -(Result.Elements[0][Rows] * Matrix.Elements[3][0]
+                                     + Result.Elements[1][Rows] * Matrix.Elements[3][1]
+                                     + Result.Elements[2][Rows] * Matrix.Elements[3][2]);
+    }
+    Result.Elements[3][3] = 1.0f;
+#endif
+
+    return (Result);
+}
+
+/* Inverse of rotation + translation: transpose the rotation and rotate the
+   translation back through it. Scale in the upper 3x3 gives wrong results. */
+HMM_INLINE hmm_mat4 HMM_PREFIX(InverseMat4Rigid)(hmm_mat4 Matrix)
+{
+    hmm_mat4 Result;
+
+#ifdef HANDMADE_MATH__USE_SSE
+    Result.Columns[0] = Matrix.Columns[0];
+    Result.Columns[1] = Matrix.Columns[1];
+    Result.Columns[2] = Matrix.Columns[2];
+    Result.Columns[3] = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(Result.Columns[0], Result.Columns[1], Result.Columns[2], Result.Columns[3]);
+
+    __m128 T = Matrix.Columns[3];
+    Result.Columns[3] = _mm_mul_ps(_mm_shuffle_ps(T, T, 0x00), Result.Columns[0]);
+    Result.Columns[3] = _mm_add_ps(Result.Columns[3], _mm_mul_ps(_mm_shuffle_ps(T, T, 0x55), Result.Columns[1]));
+    Result.Columns[3] = _mm_add_ps(Result.Columns[3], _mm_mul_ps(_mm_shuffle_ps(T, T, 0xaa), Result.Columns[2]));
+    Result.Columns[3] = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), Result.Columns[3]);
+#else
+    int Columns;
+    for(Columns = 0; Columns < 3; ++Columns)
+    {
+        Result.Elements[Columns][0] = Matrix.Elements[0][Columns];
+        Result.Elements[Columns][1] = Matrix.Elements[1][Columns];
+        Result.Elements[Columns][2] = Matrix.Elements[2][Columns];
+        Result.Elements[Columns][3] = 0.0f;
+    }
+
+    int Rows;
+    for(Rows = 0; Rows < 3; ++Rows)
+    {
+        Result.Elements[3][Rows] = -(Result.Elements[0][Rows] * Matrix.Elements[3][0]
+                                     + Result.Elements[1][Rows] * Matrix.Elements[3][1]
+                                     + Result.Elements[2][Rows] * Matrix.Elements[3][2]);
+    }
+    Result.Elements[3][3] = 1.0f;
+#endif
+
+    return (Result);
+}
+
+HMM_INLINE hmm_mat4 HMM_PREFIX(InverseMat4)(hmm_mat4 Matrix, hmm_mat4_kind Kind)
+{
+    switch(Kind)
+    {
+    case HMM_MAT4_RIGID:  return HMM_PREFIX(InverseMat4Rigid)(Matrix);
+    case HMM_MAT4_AFFINE: return HMM_PREFIX(InverseMat4Affine)(Matrix);
+    default:              return HMM_PREFIX(InverseMat4General)(Matrix);
+    }
+}
+
+/* Single matrix version of HMM_FrustumCornersBatch, bit-identical to it */
+HMM_INLINE void HMM_PREFIX(FrustumCorners)(hmm_mat4 InvViewProj, float *Dest, int VertexStride)
+{
+    static const float ClipCorners[8][3] = {
+        {-1.0f, -1.0f, -1.0f}, {-1.0f,  1.0f, -1.0f}, { 1.0f,  1.0f, -1.0f}, { 1.0f, -1.0f, -1.0f},
+        {-1.0f, -1.0f,  1.0f}, {-1.0f,  1.0f,  1.0f}, { 1.0f,  1.0f,  1.0f}, { 1.0f, -1.0f,  1.0f}
+    };
+
+    int Corner;
+    for(Corner = 0; Corner < 8; ++Corner)
+    {
+        hmm_vec4 Clip = HMM_PREFIX(Vec4)(ClipCorners[Corner][0], ClipCorners[Corner][1], ClipCorners[Corner][2], 1.0f);
+        hmm_vec4 World = HMM_PREFIX(MultiplyMat4ByVec4)(InvViewProj, Clip);
+        float InvW = 1.0f / World.W;
+
+        Dest[0] = World.X * InvW;
+        Dest[1] = World.Y * InvW;
+        Dest[2] = World.Z * InvW;
+        Dest += VertexStride;
+    }
+}
+
+/*
+ * Sine and cosine
+ */
+
+#ifdef HANDMADE_MATH__X86_DISPATCH
+/*
+ * Sine and cosine of four angles in radians at once, the same computation
+ * as the PRECISE tier of HMM_SinCosBatch. The angle is reduced to
+ * r = x - k * pi/2 with k = round(x * 2/pi) (three-part Cody-Waite, exact
+ * for |k| < 2^16), sin and cos of r come from the Cephes sinf/cosf
+ * polynomials on [-pi/4, pi/4] and k mod 4 picks and signs the results.
+ * Rounding uses the 1.5 * 2^23 trick, so only float adds and multiplies
+ * are involved and every ISA level computes the same bits.
+ */
+HMM_INLINE void HMM_PREFIX(SinCosSSE)(__m128 Angles, __m128 *Sin, __m128 *Cos)
+{
+    const __m128 Magic = _mm_set1_ps(12582912.0f);
+    const __m128 One = _mm_set1_ps(1.0f);
+
+    __m128 K = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(Angles, _mm_set1_ps(0.636619772367581f)), Magic), Magic);
+    __m128 R = _mm_sub_ps(Angles, _mm_mul_ps(K, _mm_set1_ps(1.5703125f)));
+    R = _mm_sub_ps(R, _mm_mul_ps(K, _mm_set1_ps(4.837512969970703125e-4f)));
+    R = _mm_sub_ps(R, _mm_mul_ps(K, _mm_set1_ps(7.54978995489188216e-8f)));
+    __m128 Z = _mm_mul_ps(R, R);
+
+    __m128 SinPoly = _mm_set1_ps(-1.9515295891e-4f);
+    SinPoly = _mm_add_ps(_mm_mul_ps(SinPoly, Z), _mm_set1_ps(8.3321608736e-3f));
+    SinPoly = _mm_add_ps(_mm_mul_ps(SinPoly, Z), _mm_set1_ps(-1.6666654611e-1f));
+    SinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(SinPoly, Z), R), R);
+
+    __m128 CosPoly = _mm_set1_ps(2.443315711809948e-5f);
+    CosPoly = _mm_add_ps(_mm_mul_ps(CosPoly, Z), _mm_set1_ps(-1.388731625493765e-3f));
+    CosPoly = _mm_add_ps(_mm_mul_ps(CosPoly, Z), _mm_set1_ps(4.166664568298827e-2f));
+    CosPoly = _mm_mul_ps(_mm_mul_ps(CosPoly, Z), Z);
+    CosPoly = _mm_sub_ps(CosPoly, _mm_mul_ps(Z, _mm_set1_ps(0.5f)));
+    CosPoly = _mm_add_ps(CosPoly, One);
+
+    /* Quadrant = k mod 4 = 2 * High + Low, as exact small floats */
+    __m128 Floor4 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(K, _mm_set1_ps(0.25f)), _mm_set1_ps(0.375f)), Magic), Magic);
+    __m128 Quadrant = _mm_sub_ps(K, _mm_mul_ps(Floor4, _mm_set1_ps(4.0f)));
+    __m128 High = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(Quadrant, _mm_set1_ps(0.5f)), _mm_set1_ps(0.25f)), Magic), Magic);
+    __m128 Low = _mm_sub_ps(Quadrant, _mm_add_ps(High, High));
+    __m128 Sign = _mm_sub_ps(One, _mm_add_ps(High, High));
+    __m128 NotLow = _mm_sub_ps(One, Low);
+
+    *Sin = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(NotLow, SinPoly), _mm_mul_ps(Low, CosPoly)), Sign);
+    *Cos = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(NotLow, CosPoly), _mm_mul_ps(Low, SinPoly)), Sign);
+}
+#endif
+
+/* Sine and cosine of each component of Angles, in radians */
+HMM_INLINE void HMM_PREFIX(SinCosVec3)(hmm_vec3 Angles, hmm_vec3 *Sin, hmm_vec3 *Cos)
+{
+#ifdef HANDMADE_MATH__X86_DISPATCH
+    float SinLanes[4], CosLanes[4];
+    __m128 SinSSE, CosSSE;
+    HMM_PREFIX(SinCosSSE)(_mm_setr_ps(Angles.X, Angles.Y, Angles.Z, 0.0f), &SinSSE, &CosSSE);
+    _mm_storeu_ps(SinLanes, SinSSE);
+    _mm_storeu_ps(CosLanes, CosSSE);
+    *Sin = HMM_PREFIX(Vec3)(SinLanes[0], SinLanes[1], SinLanes[2]);
+    *Cos = HMM_PREFIX(Vec3)(CosLanes[0], CosLanes[1], CosLanes[2]);
+#else
+    *Sin = HMM_PREFIX(Vec3)(HMM_PREFIX(SinF)(Angles.X), HMM_PREFIX(SinF)(Angles.Y), HMM_PREFIX(SinF)(Angles.Z));
+    *Cos = HMM_PREFIX(Vec3)(HMM_PREFIX(CosF)(Angles.X), HMM_PREFIX(CosF)(Angles.Y), HMM_PREFIX(CosF)(Angles.Z));
+#endif
+}
+
+/*
+ * Model matrices
+ */
+
+/*
+ * Translate(Translation) * Rotate(Z) * Rotate(Y) * Rotate(X) * Scale(Scale)
+ * written out in closed form. Euler angles are in degrees like HMM_Rotate.
+ */
+HMM_INLINE hmm_mat4 HMM_PREFIX(ComposeTRSEuler)(hmm_vec3 Translation, hmm_vec3 EulerDegrees, hmm_vec3 Scale)
+{
+    hmm_mat4 Result;
+    hmm_vec3 S, C;
+
+    HMM_PREFIX(SinCosVec3)(HMM_PREFIX(MultiplyVec3f)(EulerDegrees, HMM_PI32 / 180.0f), &S, &C);
+
+    Result.Elements[0][0] = (C.Y * C.Z) * Scale.X;
+    Result.Elements[0][1] = (C.Y * S.Z) * Scale.X;
+    Result.Elements[0][2] = -S.Y * Scale.X;
+    Result.Elements[0][3] = 0.0f;
+
+    Result.Elements[1][0] = (S.X * S.Y * C.Z - C.X * S.Z) * Scale.Y;
+    Result.Elements[1][1] = (S.X * S.Y * S.Z + C.X * C.Z) * Scale.Y;
+    Result.Elements[1][2] = (S.X * C.Y) * Scale.Y;
+    Result.Elements[1][3] = 0.0f;
+
+    Result.Elements[2][0] = (C.X * S.Y * C.Z + S.X * S.Z) * Scale.Z;
+    Result.Elements[2][1] = (C.X * S.Y * S.Z - S.X * C.Z) * Scale.Z;
+    Result.Elements[2][2] = (C.X * C.Y) * Scale.Z;
+    Result.Elements[2][3] = 0.0f;
+
+    Result.Elements[3][0] = Translation.X;
+    Result.Elements[3][1] = Translation.Y;
+    Result.Elements[3][2] = Translation.Z;
+    Result.Elements[3][3] = 1.0f;
+
+    return (Result);
+}
+
+/* The unit quaternion of Rotate(Z) * Rotate(Y) * Rotate(X), angles in degrees */
+HMM_INLINE hmm_quaternion HMM_PREFIX(QuaternionFromEuler)(hmm_vec3 EulerDegrees)
+{
+    hmm_quaternion Result;
+    hmm_vec3 S, C;
+
+    HMM_PREFIX(SinCosVec3)(HMM_PREFIX(MultiplyVec3f)(EulerDegrees, HMM_PI32 / 360.0f), &S, &C);
+
+    Result.X = S.X * C.Y * C.Z - C.X * S.Y * S.Z;
+    Result.Y = C.X * S.Y * C.Z + S.X * C.Y * S.Z;
+    Result.Z = C.X * C.Y * S.Z - S.X * S.Y * C.Z;
+    Result.W = C.X * C.Y * C.Z + S.X * S.Y * S.Z;
+
+    return (Result);
+}
+
+/*
+ * Translate(Translation) * QuaternionToMat4(Rotation) * Scale(Scale) in
+ * closed form. Rotation must already be normalized.
+ */
+HMM_INLINE hmm_mat4 HMM_PREFIX(ComposeTRSQuaternion)(hmm_vec3 Translation, hmm_quaternion Rotation, hmm_vec3 Scale)
+{
+    hmm_mat4 Result;
+
+    float XX = Rotation.X * Rotation.X, YY = Rotation.Y * Rotation.Y, ZZ = Rotation.Z * Rotation.Z;
+    float XY = Rotation.X * Rotation.Y, XZ = Rotation.X * Rotation.Z, YZ = Rotation.Y * Rotation.Z;
+    float WX = Rotation.W * Rotation.X, WY = Rotation.W * Rotation.Y, WZ = Rotation.W * Rotation.Z;
+
+    Result.Elements[0][0] = (1.0f - 2.0f * (YY + ZZ)) * Scale.X;
+    Result.Elements[0][1] = (2.0f * (XY + WZ)) * Scale.X;
+    Result.Elements[0][2] = (2.0f * (XZ - WY)) * Scale.X;
+    Result.Elements[0][3] = 0.0f;
+
+    Result.Elements[1][0] = (2.0f * (XY - WZ)) * Scale.Y;
+    Result.Elements[1][1] = (1.0f - 2.0f * (XX + ZZ)) * Scale.Y;
+    Result.Elements[1][2] = (2.0f * (YZ + WX)) * Scale.Y;
+    Result.Elements[1][3] = 0.0f;
+
+    Result.Elements[2][0] = (2.0f * (XZ + WY)) * Scale.Z;
+    Result.Elements[2][1] = (2.0f * (YZ - WX)) * Scale.Z;
+    Result.Elements[2][2] = (1.0f - 2.0f * (XX + YY)) * Scale.Z;
+    Result.Elements[2][3] = 0.0f;
+
+    Result.Elements[3][0] = Translation.X;
+    Result.Elements[3][1] = Translation.Y;
+    Result.Elements[3][2] = Translation.Z;
+    Result.Elements[3][3] = 1.0f;
+
+    return (Result);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __clang__
+# pragma STDC FP_CONTRACT DEFAULT
+#endif
+
+#endif /* HANDMADE_MATH_SIMD_H */
+
+/*
+ * ==============================================================
+ *
+ *                          IMPLEMENTATION
+ *
+ * ===============================================================
+ */
+#ifdef HANDMADE_MATH_SIMD_IMPLEMENTATION
+#ifndef HANDMADE_MATH_SIMD_IMPLEMENTED
+#define HANDMADE_MATH_SIMD_IMPLEMENTED
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __clang__
+# pragma STDC FP_CONTRACT OFF
+#endif
+
+#ifdef HANDMADE_MATH__X86_DISPATCH
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define HMM_SIMD__TARGET(isa)
+# else
+#  include <cpuid.h>
+#  define HMM_SIMD__TARGET(isa) __attribute__((target(isa)))
+# endif
+#endif
+
+/* Every column is padded to this many bytes so wide loads never straddle a
+   cache line at the start of a column. */
+#define HMM_SIMD__ALIGN 64
+
+/*
+ * Lane operations. Every batch kernel is written once against these and
+ * instantiated per ISA, processing W matrices per iteration. The scalar
+ * instance (W = 1) doubles as the tail loop of the wider ones.
+ */
+
+#define HMM_SIMD__V(I) HMM_SIMD__##I##_V
+#define HMM_SIMD__W(I) HMM_SIMD__##I##_W
+#define HMM_SIMD__LOAD(I, Batch, Column, Row) HMM_SIMD__##I##_LOAD((Batch)->Elements[Column][Row] + i)
+#define HMM_SIMD__STORE(I, Batch, Column, Row, V) HMM_SIMD__##I##_STORE((Batch)->Elements[Column][Row] + i, V)
+#define HMM_SIMD__SET1(I, F) HMM_SIMD__##I##_SET1(F)
+#define HMM_SIMD__ADD(I, A, B) HMM_SIMD__##I##_ADD(A, B)
+#define HMM_SIMD__SUB(I, A, B) HMM_SIMD__##I##_SUB(A, B)
+#define HMM_SIMD__MUL(I, A, B) HMM_SIMD__##I##_MUL(A, B)
+#define HMM_SIMD__DIV(I, A, B) HMM_SIMD__##I##_DIV(A, B)
+#define HMM_SIMD__NEG(I, A) HMM_SIMD__##I##_NEG(A)
+#define HMM_SIMD__SQRT(I, A) HMM_SIMD__##I##_SQRT(A)
+
+/* A * B - C * D */
+#define HMM_SIMD__DET2(I, A, B, C, D) HMM_SIMD__SUB(I, HMM_SIMD__MUL(I, A, B), HMM_SIMD__MUL(I, C, D))
+/* A * B - C * D + E * F, evaluated left to right */
+#define HMM_SIMD__COF(I, A, B, C, D, E, F) HMM_SIMD__ADD(I, HMM_SIMD__DET2(I, A, B, C, D), HMM_SIMD__MUL(I, E, F))
+/* A * B + C * D + E * F, evaluated left to right */
+#define HMM_SIMD__DOT3(I, A, B, C, D, E, F) \
+    HMM_SIMD__ADD(I, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, A, B), HMM_SIMD__MUL(I, C, D)), HMM_SIMD__MUL(I, E, F))
+
+#define HMM_SIMD__Scalar_V float
+#define HMM_SIMD__Scalar_W 1
+#define HMM_SIMD__Scalar_LOAD(Ptr) (*(Ptr))
+#define HMM_SIMD__Scalar_STORE(Ptr, V) (*(Ptr) = (V))
+#define HMM_SIMD__Scalar_SET1(F) (F)
+#define HMM_SIMD__Scalar_ADD(A, B) ((A) + (B))
+#define HMM_SIMD__Scalar_SUB(A, B) ((A) - (B))
+#define HMM_SIMD__Scalar_MUL(A, B) ((A) * (B))
+#define HMM_SIMD__Scalar_DIV(A, B) ((A) / (B))
+#define HMM_SIMD__Scalar_SQRT(A) HMM_PREFIX(SquareRootF)(A)
+#define HMM_SIMD__Scalar_NEG(A) (-(A))
+
+#ifdef HANDMADE_MATH__X86_DISPATCH
+#define HMM_SIMD__SSE2_V __m128
+#define HMM_SIMD__SSE2_W 4
+#define HMM_SIMD__SSE2_LOAD(Ptr) _mm_loadu_ps(Ptr)
+#define HMM_SIMD__SSE2_STORE(Ptr, V) _mm_storeu_ps(Ptr, V)
+#define HMM_SIMD__SSE2_SET1(F) _mm_set1_ps(F)
+#define HMM_SIMD__SSE2_ADD(A, B) _mm_add_ps(A, B)
+#define HMM_SIMD__SSE2_SUB(A, B) _mm_sub_ps(A, B)
+#define HMM_SIMD__SSE2_MUL(A, B) _mm_mul_ps(A, B)
+#define HMM_SIMD__SSE2_DIV(A, B) _mm_div_ps(A, B)
+#define HMM_SIMD__SSE2_SQRT(A) _mm_sqrt_ps(A)
+#define HMM_SIMD__SSE2_NEG(A) _mm_xor_ps(A, _mm_set1_ps(-0.0f))
+
+#define HMM_SIMD__AVX2_V __m256
+#define HMM_SIMD__AVX2_W 8
+#define HMM_SIMD__AVX2_LOAD(Ptr) _mm256_loadu_ps(Ptr)
+#define HMM_SIMD__AVX2_STORE(Ptr, V) _mm256_storeu_ps(Ptr, V)
+#define HMM_SIMD__AVX2_SET1(F) _mm256_set1_ps(F)
+#define HMM_SIMD__AVX2_ADD(A, B) _mm256_add_ps(A, B)
+#define HMM_SIMD__AVX2_SUB(A, B) _mm256_sub_ps(A, B)
+#define HMM_SIMD__AVX2_MUL(A, B) _mm256_mul_ps(A, B)
+#define HMM_SIMD__AVX2_DIV(A, B) _mm256_div_ps(A, B)
+#define HMM_SIMD__AVX2_SQRT(A) _mm256_sqrt_ps(A)
+#define HMM_SIMD__AVX2_NEG(A) _mm256_xor_ps(A, _mm256_set1_ps(-0.0f))
+
+#define HMM_SIMD__AVX512_V __m512
+#define HMM_SIMD__AVX512_W 16
+#define HMM_SIMD__AVX512_LOAD(Ptr) _mm512_loadu_ps(Ptr)
+#define HMM_SIMD__AVX512_STORE(Ptr, V) _mm512_storeu_ps(Ptr, V)
+#define HMM_SIMD__AVX512_SET1(F) _mm512_set1_ps(F)
+#define HMM_SIMD__AVX512_ADD(A, B) _mm512_add_ps(A, B)
+#define HMM_SIMD__AVX512_SUB(A, B) _mm512_sub_ps(A, B)
+#define HMM_SIMD__AVX512_MUL(A, B) _mm512_mul_ps(A, B)
+#define HMM_SIMD__AVX512_DIV(A, B) _mm512_div_ps(A, B)
+#define HMM_SIMD__AVX512_SQRT(A) _mm512_sqrt_ps(A)
+/* _mm512_xor_ps needs AVX512DQ, go through the integer unit instead */
+#define HMM_SIMD__AVX512_NEG(A) \
+    _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(A), _mm512_set1_epi32((int)0x80000000u)))
+#endif
+
+/*
+ * Kernels. Each one handles whole W-wide blocks starting at Begin and
+ * returns the index of the first matrix it did not process.
+ */
+
+/* Same order of operations as LinearCombineSSE, so every ISA matches
+   HMM_MultiplyMat4 bit for bit. */
+#define HMM_SIMD__DEFINE_MULTIPLY_MAT4(I, Target)                                             \
+Target static int                                                                             \
+HMM_SIMD__MultiplyMat4##I(const hmm_mat4_soa *Left, const hmm_mat4_soa *Right,                \
+                          hmm_mat4_soa *Result, int Begin, int End)                           \
+{                                                                                             \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        int Columns;                                                                          \
+        for(Columns = 0; Columns < 4; ++Columns)                                              \
+        {                                                                                     \
+            HMM_SIMD__V(I) R0 = HMM_SIMD__LOAD(I, Right, Columns, 0);                         \
+            HMM_SIMD__V(I) R1 = HMM_SIMD__LOAD(I, Right, Columns, 1);                         \
+            HMM_SIMD__V(I) R2 = HMM_SIMD__LOAD(I, Right, Columns, 2);                         \
+            HMM_SIMD__V(I) R3 = HMM_SIMD__LOAD(I, Right, Columns, 3);                         \
+                                                                                              \
+            int Rows;                                                                         \
+            for(Rows = 0; Rows < 4; ++Rows)                                                   \
+            {                                                                                 \
+                HMM_SIMD__V(I) Sum = HMM_SIMD__MUL(I, HMM_SIMD__LOAD(I, Left, 0, Rows), R0);  \
+                Sum = HMM_SIMD__ADD(I, Sum, HMM_SIMD__MUL(I, HMM_SIMD__LOAD(I, Left, 1, Rows), R1)); \
+                Sum = HMM_SIMD__ADD(I, Sum, HMM_SIMD__MUL(I, HMM_SIMD__LOAD(I, Left, 2, Rows), R2)); \
+                Sum = HMM_SIMD__ADD(I, Sum, HMM_SIMD__MUL(I, HMM_SIMD__LOAD(I, Left, 3, Rows), R3)); \
+                HMM_SIMD__STORE(I, Result, Columns, Rows, Sum);                               \
+            }                                                                                 \
+        }                                                                                     \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* Cofactor expansion, lane for lane the same as the scalar
+   HMM_InverseMat4General. All inputs are loaded before anything is stored,
+   so Result may alias Matrices. */
+#define HMM_SIMD__DEFINE_INVERSE_GENERAL(I, Target)                                           \
+Target static int                                                                             \
+HMM_SIMD__InverseMat4General##I(const hmm_mat4_soa *Matrices, hmm_mat4_soa *Result,           \
+                                int Begin, int End)                                           \
+{                                                                                             \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) a = HMM_SIMD__LOAD(I, Matrices, 0, 0), b = HMM_SIMD__LOAD(I, Matrices, 0, 1), \
+                       c = HMM_SIMD__LOAD(I, Matrices, 0, 2), d = HMM_SIMD__LOAD(I, Matrices, 0, 3), \
+                       e = HMM_SIMD__LOAD(I, Matrices, 1, 0), f = HMM_SIMD__LOAD(I, Matrices, 1, 1), \
+                       g = HMM_SIMD__LOAD(I, Matrices, 1, 2), h = HMM_SIMD__LOAD(I, Matrices, 1, 3), \
+                       j = HMM_SIMD__LOAD(I, Matrices, 2, 1), k = HMM_SIMD__LOAD(I, Matrices, 2, 2), \
+                       l = HMM_SIMD__LOAD(I, Matrices, 2, 3), m = HMM_SIMD__LOAD(I, Matrices, 3, 0), \
+                       n = HMM_SIMD__LOAD(I, Matrices, 3, 1), o = HMM_SIMD__LOAD(I, Matrices, 3, 2), \
+                       p = HMM_SIMD__LOAD(I, Matrices, 3, 3), ii = HMM_SIMD__LOAD(I, Matrices, 2, 0); \
+        HMM_SIMD__V(I) t0, t1, t2, t3, t4, t5;                                                \
+        HMM_SIMD__V(I) r00, r01, r02, r03, r10, r11, r12, r13,                                \
+                       r20, r21, r22, r23, r30, r31, r32, r33, Det;                           \
+                                                                                              \
+        t0 = HMM_SIMD__DET2(I, k, p, o, l); t1 = HMM_SIMD__DET2(I, j, p, n, l);               \
+        t2 = HMM_SIMD__DET2(I, j, o, n, k); t3 = HMM_SIMD__DET2(I, ii, p, m, l);              \
+        t4 = HMM_SIMD__DET2(I, ii, o, m, k); t5 = HMM_SIMD__DET2(I, ii, n, m, j);             \
+                                                                                              \
+        r00 = HMM_SIMD__COF(I, f, t0, g, t1, h, t2);                                          \
+        r10 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, e, t0, g, t3, h, t4));                        \
+        r20 = HMM_SIMD__COF(I, e, t1, f, t3, h, t5);                                          \
+        r30 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, e, t2, f, t4, g, t5));                        \
+        r01 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, b, t0, c, t1, d, t2));                        \
+        r11 = HMM_SIMD__COF(I, a, t0, c, t3, d, t4);                                          \
+        r21 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, a, t1, b, t3, d, t5));                        \
+        r31 = HMM_SIMD__COF(I, a, t2, b, t4, c, t5);                                          \
+                                                                                              \
+        t0 = HMM_SIMD__DET2(I, g, p, o, h); t1 = HMM_SIMD__DET2(I, f, p, n, h);               \
+        t2 = HMM_SIMD__DET2(I, f, o, n, g); t3 = HMM_SIMD__DET2(I, e, p, m, h);               \
+        t4 = HMM_SIMD__DET2(I, e, o, m, g); t5 = HMM_SIMD__DET2(I, e, n, m, f);               \
+                                                                                              \
+        r02 = HMM_SIMD__COF(I, b, t0, c, t1, d, t2);                                          \
+        r12 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, a, t0, c, t3, d, t4));                        \
+        r22 = HMM_SIMD__COF(I, a, t1, b, t3, d, t5);                                          \
+        r32 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, a, t2, b, t4, c, t5));                        \
+                                                                                              \
+        t0 = HMM_SIMD__DET2(I, g, l, k, h); t1 = HMM_SIMD__DET2(I, f, l, j, h);               \
+        t2 = HMM_SIMD__DET2(I, f, k, j, g); t3 = HMM_SIMD__DET2(I, e, l, ii, h);              \
+        t4 = HMM_SIMD__DET2(I, e, k, ii, g); t5 = HMM_SIMD__DET2(I, e, j, ii, f);             \
+                                                                                              \
+        r03 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, b, t0, c, t1, d, t2));                        \
+        r13 = HMM_SIMD__COF(I, a, t0, c, t3, d, t4);                                          \
+        r23 = HMM_SIMD__NEG(I, HMM_SIMD__COF(I, a, t1, b, t3, d, t5));                        \
+        r33 = HMM_SIMD__COF(I, a, t2, b, t4, c, t5);                                          \
+                                                                                              \
+        Det = HMM_SIMD__ADD(I, HMM_SIMD__DOT3(I, a, r00, b, r10, c, r20), HMM_SIMD__MUL(I, d, r30)); \
+        Det = HMM_SIMD__DIV(I, HMM_SIMD__SET1(I, 1.0f), Det);                                 \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 0, 0, HMM_SIMD__MUL(I, r00, Det));                         \
+        HMM_SIMD__STORE(I, Result, 0, 1, HMM_SIMD__MUL(I, r01, Det));                         \
+        HMM_SIMD__STORE(I, Result, 0, 2, HMM_SIMD__MUL(I, r02, Det));                         \
+        HMM_SIMD__STORE(I, Result, 0, 3, HMM_SIMD__MUL(I, r03, Det));                         \
+        HMM_SIMD__STORE(I, Result, 1, 0, HMM_SIMD__MUL(I, r10, Det));                         \
+        HMM_SIMD__STORE(I, Result, 1, 1, HMM_SIMD__MUL(I, r11, Det));                         \
+        HMM_SIMD__STORE(I, Result, 1, 2, HMM_SIMD__MUL(I, r12, Det));                         \
+        HMM_SIMD__STORE(I, Result, 1, 3, HMM_SIMD__MUL(I, r13, Det));                         \
+        HMM_SIMD__STORE(I, Result, 2, 0, HMM_SIMD__MUL(I, r20, Det));                         \
+        HMM_SIMD__STORE(I, Result, 2, 1, HMM_SIMD__MUL(I, r21, Det));                         \
+        HMM_SIMD__STORE(I, Result, 2, 2, HMM_SIMD__MUL(I, r22, Det));                         \
+        HMM_SIMD__STORE(I, Result, 2, 3, HMM_SIMD__MUL(I, r23, Det));                         \
+        HMM_SIMD__STORE(I, Result, 3, 0, HMM_SIMD__MUL(I, r30, Det));                         \
+        HMM_SIMD__STORE(I, Result, 3, 1, HMM_SIMD__MUL(I, r31, Det));                         \
+        HMM_SIMD__STORE(I, Result, 3, 2, HMM_SIMD__MUL(I, r32, Det));                         \
+        HMM_SIMD__STORE(I, Result, 3, 3, HMM_SIMD__MUL(I, r33, Det));                         \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* Upper 3x3 inverted through cross products, translation rotated back */
+#define HMM_SIMD__DEFINE_INVERSE_AFFINE(I, Target)                                            \
+Target static int                                                                             \
+HMM_SIMD__InverseMat4Affine##I(const hmm_mat4_soa *Matrices, hmm_mat4_soa *Result,            \
+                               int Begin, int End)                                            \
+{                                                                                             \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) A0 = HMM_SIMD__LOAD(I, Matrices, 0, 0), A1 = HMM_SIMD__LOAD(I, Matrices, 0, 1), \
+                       A2 = HMM_SIMD__LOAD(I, Matrices, 0, 2), B0 = HMM_SIMD__LOAD(I, Matrices, 1, 0), \
+                       B1 = HMM_SIMD__LOAD(I, Matrices, 1, 1), B2 = HMM_SIMD__LOAD(I, Matrices, 1, 2), \
+                       C0 = HMM_SIMD__LOAD(I, Matrices, 2, 0), C1 = HMM_SIMD__LOAD(I, Matrices, 2, 1), \
+                       C2 = HMM_SIMD__LOAD(I, Matrices, 2, 2), T0 = HMM_SIMD__LOAD(I, Matrices, 3, 0), \
+                       T1 = HMM_SIMD__LOAD(I, Matrices, 3, 1), T2 = HMM_SIMD__LOAD(I, Matrices, 3, 2); \
+        HMM_SIMD__V(I) Zero = HMM_SIMD__SET1(I, 0.0f);                                        \
+        HMM_SIMD__V(I) InvDet;                                                                \
+        HMM_SIMD__V(I) X0 = HMM_SIMD__DET2(I, B1, C2, B2, C1);                                \
+        HMM_SIMD__V(I) X1 = HMM_SIMD__DET2(I, B2, C0, B0, C2);                                \
+        HMM_SIMD__V(I) X2 = HMM_SIMD__DET2(I, B0, C1, B1, C0);                                \
+        HMM_SIMD__V(I) Y0 = HMM_SIMD__DET2(I, C1, A2, C2, A1);                                \
+        HMM_SIMD__V(I) Y1 = HMM_SIMD__DET2(I, C2, A0, C0, A2);                                \
+        HMM_SIMD__V(I) Y2 = HMM_SIMD__DET2(I, C0, A1, C1, A0);                                \
+        HMM_SIMD__V(I) Z0 = HMM_SIMD__DET2(I, A1, B2, A2, B1);                                \
+        HMM_SIMD__V(I) Z1 = HMM_SIMD__DET2(I, A2, B0, A0, B2);                                \
+        HMM_SIMD__V(I) Z2 = HMM_SIMD__DET2(I, A0, B1, A1, B0);                                \
+                                                                                              \
+        InvDet = HMM_SIMD__DIV(I, HMM_SIMD__SET1(I, 1.0f), HMM_SIMD__DOT3(I, A0, X0, A1, X1, A2, X2)); \
+        X0 = HMM_SIMD__MUL(I, X0, InvDet); X1 = HMM_SIMD__MUL(I, X1, InvDet); X2 = HMM_SIMD__MUL(I, X2, InvDet); \
+        Y0 = HMM_SIMD__MUL(I, Y0, InvDet); Y1 = HMM_SIMD__MUL(I, Y1, InvDet); Y2 = HMM_SIMD__MUL(I, Y2, InvDet); \
+        Z0 = HMM_SIMD__MUL(I, Z0, InvDet); Z1 = HMM_SIMD__MUL(I, Z1, InvDet); Z2 = HMM_SIMD__MUL(I, Z2, InvDet); \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 0, 0, X0); HMM_SIMD__STORE(I, Result, 0, 1, Y0);           \
+        HMM_SIMD__STORE(I, Result, 0, 2, Z0); HMM_SIMD__STORE(I, Result, 0, 3, Zero);         \
+        HMM_SIMD__STORE(I, Result, 1, 0, X1); HMM_SIMD__STORE(I, Result, 1, 1, Y1);           \
+        HMM_SIMD__STORE(I, Result, 1, 2, Z1); HMM_SIMD__STORE(I, Result, 1, 3, Zero);         \
+        HMM_SIMD__STORE(I, Result, 2, 0, X2); HMM_SIMD__STORE(I, Result, 2, 1, Y2);           \
+        HMM_SIMD__STORE(I, Result, 2, 2, Z2); HMM_SIMD__STORE(I, Result, 2, 3, Zero);         \
+        HMM_SIMD__STORE(I, Result, 3, 0, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, X0, T0, X1, T1, X2, T2))); \
+        HMM_SIMD__STORE(I, Result, 3, 1, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, Y0, T0, Y1, T1, Y2, T2))); \
+        HMM_SIMD__STORE(I, Result, 3, 2, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, Z0, T0, Z1, T1, Z2, T2))); \
+        HMM_SIMD__STORE(I, Result, 3, 3, HMM_SIMD__SET1(I, 1.0f));                            \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* Rotation transposed, translation rotated back */
+#define HMM_SIMD__DEFINE_INVERSE_RIGID(I, Target)                                             \
+Target static int                                                                             \
+HMM_SIMD__InverseMat4Rigid##I(const hmm_mat4_soa *Matrices, hmm_mat4_soa *Result,             \
+                              int Begin, int End)                                             \
+{                                                                                             \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) A0 = HMM_SIMD__LOAD(I, Matrices, 0, 0), A1 = HMM_SIMD__LOAD(I, Matrices, 0, 1), \
+                       A2 = HMM_SIMD__LOAD(I, Matrices, 0, 2), B0 = HMM_SIMD__LOAD(I, Matrices, 1, 0), \
+                       B1 = HMM_SIMD__LOAD(I, Matrices, 1, 1), B2 = HMM_SIMD__LOAD(I, Matrices, 1, 2), \
+                       C0 = HMM_SIMD__LOAD(I, Matrices, 2, 0), C1 = HMM_SIMD__LOAD(I, Matrices, 2, 1), \
+                       C2 = HMM_SIMD__LOAD(I, Matrices, 2, 2), T0 = HMM_SIMD__LOAD(I, Matrices, 3, 0), \
+                       T1 = HMM_SIMD__LOAD(I, Matrices, 3, 1), T2 = HMM_SIMD__LOAD(I, Matrices, 3, 2); \
+        HMM_SIMD__V(I) Zero = HMM_SIMD__SET1(I, 0.0f);                                        \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 0, 0, A0); HMM_SIMD__STORE(I, Result, 0, 1, B0);           \
+        HMM_SIMD__STORE(I, Result, 0, 2, C0); HMM_SIMD__STORE(I, Result, 0, 3, Zero);         \
+        HMM_SIMD__STORE(I, Result, 1, 0, A1); HMM_SIMD__STORE(I, Result, 1, 1, B1);           \
+        HMM_SIMD__STORE(I, Result, 1, 2, C1); HMM_SIMD__STORE(I, Result, 1, 3, Zero);         \
+        HMM_SIMD__STORE(I, Result, 2, 0, A2); HMM_SIMD__STORE(I, Result, 2, 1, B2);           \
+        HMM_SIMD__STORE(I, Result, 2, 2, C2); HMM_SIMD__STORE(I, Result, 2, 3, Zero);         \
+        HMM_SIMD__STORE(I, Result, 3, 0, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, A0, T0, A1, T1, A2, T2))); \
+        HMM_SIMD__STORE(I, Result, 3, 1, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, B0, T0, B1, T1, B2, T2))); \
+        HMM_SIMD__STORE(I, Result, 3, 2, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, C0, T0, C1, T1, C2, T2))); \
+        HMM_SIMD__STORE(I, Result, 3, 3, HMM_SIMD__SET1(I, 1.0f));                            \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* One row of M * (X, Y, Z, 1) for X, Y, Z = +-1. Negation and adding a
+   negated value are exact, so this rounds exactly like the multiplies by
+   +-1 in HMM_MultiplyMat4ByVec4. */
+#define HMM_SIMD__CORNER_ROW(I, M0, M1, M2, M3, SX, SY, SZ)                                   \
+    HMM_SIMD__ADD(I, HMM_SIMD__ADD(I, HMM_SIMD__ADD(I, (SX) > 0 ? (M0) : HMM_SIMD__NEG(I, M0),  \
+                                                       (SY) > 0 ? (M1) : HMM_SIMD__NEG(I, M1)), \
+                                      (SZ) > 0 ? (M2) : HMM_SIMD__NEG(I, M2)), M3)
+
+/* Unprojects the eight clip-space corners of W matrices at once, one matrix
+   per lane, then scatters the lanes into the interleaved vertex buffer. */
+#define HMM_SIMD__DEFINE_FRUSTUM_CORNERS(I, Target)                                           \
+Target static int                                                                             \
+HMM_SIMD__FrustumCorners##I(const hmm_mat4_soa *InvViewProj, float *Dest, int VertexStride,   \
+                            int Begin, int End)                                               \
+{                                                                                             \
+    static const float ClipCorners[8][3] = {                                                  \
+        {-1.0f, -1.0f, -1.0f}, {-1.0f,  1.0f, -1.0f}, { 1.0f,  1.0f, -1.0f}, { 1.0f, -1.0f, -1.0f}, \
+        {-1.0f, -1.0f,  1.0f}, {-1.0f,  1.0f,  1.0f}, { 1.0f,  1.0f,  1.0f}, { 1.0f, -1.0f,  1.0f}  \
+    };                                                                                        \
+    float Lanes[3][HMM_SIMD__W(I)];                                                           \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) M[4][4];                                                               \
+        int Corner, Column, Row, Lane;                                                        \
+        for(Column = 0; Column < 4; ++Column)                                                 \
+            for(Row = 0; Row < 4; ++Row)                                                      \
+                M[Column][Row] = HMM_SIMD__LOAD(I, InvViewProj, Column, Row);                 \
+                                                                                              \
+        for(Corner = 0; Corner < 8; ++Corner)                                                 \
+        {                                                                                     \
+            float SX = ClipCorners[Corner][0], SY = ClipCorners[Corner][1], SZ = ClipCorners[Corner][2]; \
+            HMM_SIMD__V(I) InvW = HMM_SIMD__DIV(I, HMM_SIMD__SET1(I, 1.0f),                   \
+                HMM_SIMD__CORNER_ROW(I, M[0][3], M[1][3], M[2][3], M[3][3], SX, SY, SZ));     \
+            for(Row = 0; Row < 3; ++Row)                                                      \
+            {                                                                                 \
+                HMM_SIMD__V(I) V = HMM_SIMD__CORNER_ROW(I, M[0][Row], M[1][Row], M[2][Row], M[3][Row], SX, SY, SZ); \
+                HMM_SIMD__##I##_STORE(Lanes[Row], HMM_SIMD__MUL(I, V, InvW));                 \
+            }                                                                                 \
+            for(Lane = 0; Lane < HMM_SIMD__W(I); ++Lane)                                      \
+            {                                                                                 \
+                float *Vertex = Dest + ((size_t)(i + Lane) * 8 + Corner) * VertexStride;      \
+                Vertex[0] = Lanes[0][Lane];                                                   \
+                Vertex[1] = Lanes[1][Lane];                                                   \
+                Vertex[2] = Lanes[2][Lane];                                                   \
+            }                                                                                 \
+        }                                                                                     \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* Round to nearest for |A| < 2^22 */
+#define HMM_SIMD__ROUND(I, A) \
+    HMM_SIMD__SUB(I, HMM_SIMD__ADD(I, A, HMM_SIMD__SET1(I, 12582912.0f)), HMM_SIMD__SET1(I, 12582912.0f))
+
+/* r = x - k * pi/2, split so the first products are exact */
+#define HMM_SIMD__REDUCE_Precise(I, X, K)                                                     \
+    HMM_SIMD__SUB(I, HMM_SIMD__SUB(I, HMM_SIMD__SUB(I, X,                                     \
+        HMM_SIMD__MUL(I, K, HMM_SIMD__SET1(I, 1.5703125f))),                                  \
+        HMM_SIMD__MUL(I, K, HMM_SIMD__SET1(I, 4.837512969970703125e-4f))),                    \
+        HMM_SIMD__MUL(I, K, HMM_SIMD__SET1(I, 7.54978995489188216e-8f)))
+#define HMM_SIMD__REDUCE_Fast(I, X, K)                                                        \
+    HMM_SIMD__SUB(I, HMM_SIMD__SUB(I, X,                                                      \
+        HMM_SIMD__MUL(I, K, HMM_SIMD__SET1(I, 1.5703125f))),                                  \
+        HMM_SIMD__MUL(I, K, HMM_SIMD__SET1(I, 4.838267948966e-4f)))
+
+/* Polynomials in r and z = r * r on [-pi/4, pi/4] */
+#define HMM_SIMD__SIN_Precise(I, R, Z)                                                        \
+    HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I,      \
+        HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__SET1(I, -1.9515295891e-4f), Z),           \
+                      HMM_SIMD__SET1(I, 8.3321608736e-3f)), Z),                               \
+        HMM_SIMD__SET1(I, -1.6666654611e-1f)), Z), R), R)
+#define HMM_SIMD__COS_Precise(I, Z)                                                           \
+    HMM_SIMD__ADD(I, HMM_SIMD__SUB(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I,      \
+        HMM_SIMD__MUL(I, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__SET1(I, 2.443315711809948e-5f), Z), \
+                                      HMM_SIMD__SET1(I, -1.388731625493765e-3f)), Z),         \
+        HMM_SIMD__SET1(I, 4.166664568298827e-2f)), Z), Z),                                    \
+        HMM_SIMD__MUL(I, Z, HMM_SIMD__SET1(I, 0.5f))), HMM_SIMD__SET1(I, 1.0f))
+#define HMM_SIMD__SIN_Fast(I, R, Z)                                                           \
+    HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I,                       \
+        HMM_SIMD__MUL(I, HMM_SIMD__SET1(I, 8.164608e-3f), Z),                                 \
+        HMM_SIMD__SET1(I, -1.6663458e-1f)), Z), R), R)
+#define HMM_SIMD__COS_Fast(I, Z)                                                              \
+    HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I,      \
+        HMM_SIMD__MUL(I, HMM_SIMD__SET1(I, -1.3597822e-3f), Z),                               \
+        HMM_SIMD__SET1(I, 4.1656294e-2f)), Z), HMM_SIMD__SET1(I, -0.49999895f)), Z),          \
+        HMM_SIMD__SET1(I, 1.0f))
+
+/* Sin and Cos of the lanes of X, the algorithm described at HMM_SinCosSSE */
+#define HMM_SIMD__SINCOS(I, Tier, X, Sin, Cos)                                                \
+    do                                                                                        \
+    {                                                                                         \
+        HMM_SIMD__V(I) SC_One = HMM_SIMD__SET1(I, 1.0f);                                      \
+        HMM_SIMD__V(I) SC_X = (X);                                                            \
+        HMM_SIMD__V(I) SC_K = HMM_SIMD__ROUND(I, HMM_SIMD__MUL(I, SC_X, HMM_SIMD__SET1(I, 0.636619772367581f))); \
+        HMM_SIMD__V(I) SC_R = HMM_SIMD__REDUCE_##Tier(I, SC_X, SC_K);                         \
+        HMM_SIMD__V(I) SC_Z = HMM_SIMD__MUL(I, SC_R, SC_R);                                   \
+        HMM_SIMD__V(I) SC_S = HMM_SIMD__SIN_##Tier(I, SC_R, SC_Z);                            \
+        HMM_SIMD__V(I) SC_C = HMM_SIMD__COS_##Tier(I, SC_Z);                                  \
+        HMM_SIMD__V(I) SC_Floor4 = HMM_SIMD__ROUND(I, HMM_SIMD__SUB(I,                        \
+            HMM_SIMD__MUL(I, SC_K, HMM_SIMD__SET1(I, 0.25f)), HMM_SIMD__SET1(I, 0.375f)));    \
+        HMM_SIMD__V(I) SC_Quadrant = HMM_SIMD__SUB(I, SC_K,                                   \
+            HMM_SIMD__MUL(I, SC_Floor4, HMM_SIMD__SET1(I, 4.0f)));                            \
+        HMM_SIMD__V(I) SC_High = HMM_SIMD__ROUND(I, HMM_SIMD__SUB(I,                          \
+            HMM_SIMD__MUL(I, SC_Quadrant, HMM_SIMD__SET1(I, 0.5f)), HMM_SIMD__SET1(I, 0.25f))); \
+        HMM_SIMD__V(I) SC_Low = HMM_SIMD__SUB(I, SC_Quadrant, HMM_SIMD__ADD(I, SC_High, SC_High)); \
+        HMM_SIMD__V(I) SC_Sign = HMM_SIMD__SUB(I, SC_One, HMM_SIMD__ADD(I, SC_High, SC_High)); \
+        HMM_SIMD__V(I) SC_NotLow = HMM_SIMD__SUB(I, SC_One, SC_Low);                          \
+        (Sin) = HMM_SIMD__MUL(I, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, SC_NotLow, SC_S),          \
+                                                  HMM_SIMD__MUL(I, SC_Low, SC_C)), SC_Sign);  \
+        (Cos) = HMM_SIMD__MUL(I, HMM_SIMD__SUB(I, HMM_SIMD__MUL(I, SC_NotLow, SC_C),          \
+                                                  HMM_SIMD__MUL(I, SC_Low, SC_S)), SC_Sign);  \
+    } while(0)
+
+#define HMM_SIMD__DEFINE_SINCOS(I, Target, Tier)                                              \
+Target static int                                                                             \
+HMM_SIMD__SinCos##Tier##I(const float *Angles, float *Sin, float *Cos, int Begin, int End)    \
+{                                                                                             \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) S, C;                                                                  \
+        HMM_SIMD__SINCOS(I, Tier, HMM_SIMD__##I##_LOAD(Angles + i), S, C);                    \
+        HMM_SIMD__##I##_STORE(Sin + i, S);                                                    \
+        HMM_SIMD__##I##_STORE(Cos + i, C);                                                    \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* Same expressions as HMM_Rotate, including its normalization */
+#define HMM_SIMD__DEFINE_ROTATE(I, Target, Tier)                                              \
+Target static int                                                                             \
+HMM_SIMD__Rotate##Tier##I(const float *Angles, const float *AxisX, const float *AxisY,        \
+                          const float *AxisZ, hmm_mat4_soa *Result, int Begin, int End)       \
+{                                                                                             \
+    HMM_SIMD__V(I) Zero = HMM_SIMD__SET1(I, 0.0f), One = HMM_SIMD__SET1(I, 1.0f);             \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) X = HMM_SIMD__##I##_LOAD(AxisX + i);                                   \
+        HMM_SIMD__V(I) Y = HMM_SIMD__##I##_LOAD(AxisY + i);                                   \
+        HMM_SIMD__V(I) Z = HMM_SIMD__##I##_LOAD(AxisZ + i);                                   \
+        HMM_SIMD__V(I) InvLength = HMM_SIMD__DIV(I, One,                                      \
+            HMM_SIMD__SQRT(I, HMM_SIMD__DOT3(I, X, X, Y, Y, Z, Z)));                          \
+        HMM_SIMD__V(I) S, C, CosValue;                                                        \
+        X = HMM_SIMD__MUL(I, X, InvLength);                                                   \
+        Y = HMM_SIMD__MUL(I, Y, InvLength);                                                   \
+        Z = HMM_SIMD__MUL(I, Z, InvLength);                                                   \
+        HMM_SIMD__SINCOS(I, Tier, HMM_SIMD__MUL(I, HMM_SIMD__##I##_LOAD(Angles + i),          \
+                                                HMM_SIMD__SET1(I, HMM_PI32 / 180.0f)), S, C); \
+        CosValue = HMM_SIMD__SUB(I, One, C);                                                  \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 0, 0, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, X, X), CosValue), C)); \
+        HMM_SIMD__STORE(I, Result, 0, 1, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, X, Y), CosValue), HMM_SIMD__MUL(I, Z, S))); \
+        HMM_SIMD__STORE(I, Result, 0, 2, HMM_SIMD__SUB(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, X, Z), CosValue), HMM_SIMD__MUL(I, Y, S))); \
+        HMM_SIMD__STORE(I, Result, 0, 3, Zero);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 1, 0, HMM_SIMD__SUB(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, Y, X), CosValue), HMM_SIMD__MUL(I, Z, S))); \
+        HMM_SIMD__STORE(I, Result, 1, 1, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, Y, Y), CosValue), C)); \
+        HMM_SIMD__STORE(I, Result, 1, 2, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, Y, Z), CosValue), HMM_SIMD__MUL(I, X, S))); \
+        HMM_SIMD__STORE(I, Result, 1, 3, Zero);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 2, 0, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, Z, X), CosValue), HMM_SIMD__MUL(I, Y, S))); \
+        HMM_SIMD__STORE(I, Result, 2, 1, HMM_SIMD__SUB(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, Z, Y), CosValue), HMM_SIMD__MUL(I, X, S))); \
+        HMM_SIMD__STORE(I, Result, 2, 2, HMM_SIMD__ADD(I, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, Z, Z), CosValue), C)); \
+        HMM_SIMD__STORE(I, Result, 2, 3, Zero);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 3, 0, Zero);                                               \
+        HMM_SIMD__STORE(I, Result, 3, 1, Zero);                                               \
+        HMM_SIMD__STORE(I, Result, 3, 2, Zero);                                               \
+        HMM_SIMD__STORE(I, Result, 3, 3, One);                                                \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* Same expressions as HMM_ComposeTRSEuler */
+#define HMM_SIMD__DEFINE_COMPOSE_TRS_EULER(I, Target, Tier)                                   \
+Target static int                                                                             \
+HMM_SIMD__ComposeTRSEuler##Tier##I(const hmm_vec3_soa *Translation, const hmm_vec3_soa *EulerDegrees, \
+                                   const hmm_vec3_soa *Scale, hmm_mat4_soa *Result,           \
+                                   int Begin, int End)                                        \
+{                                                                                             \
+    HMM_SIMD__V(I) Zero = HMM_SIMD__SET1(I, 0.0f), One = HMM_SIMD__SET1(I, 1.0f);             \
+    HMM_SIMD__V(I) ToRadians = HMM_SIMD__SET1(I, HMM_PI32 / 180.0f);                          \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) SX, SY, SZ, CX, CY, CZ;                                                \
+        HMM_SIMD__V(I) ScaleX = HMM_SIMD__##I##_LOAD(Scale->X + i);                           \
+        HMM_SIMD__V(I) ScaleY = HMM_SIMD__##I##_LOAD(Scale->Y + i);                           \
+        HMM_SIMD__V(I) ScaleZ = HMM_SIMD__##I##_LOAD(Scale->Z + i);                           \
+        HMM_SIMD__SINCOS(I, Tier, HMM_SIMD__MUL(I, HMM_SIMD__##I##_LOAD(EulerDegrees->X + i), ToRadians), SX, CX); \
+        HMM_SIMD__SINCOS(I, Tier, HMM_SIMD__MUL(I, HMM_SIMD__##I##_LOAD(EulerDegrees->Y + i), ToRadians), SY, CY); \
+        HMM_SIMD__SINCOS(I, Tier, HMM_SIMD__MUL(I, HMM_SIMD__##I##_LOAD(EulerDegrees->Z + i), ToRadians), SZ, CZ); \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 0, 0, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, CY, CZ), ScaleX));  \
+        HMM_SIMD__STORE(I, Result, 0, 1, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, CY, SZ), ScaleX));  \
+        HMM_SIMD__STORE(I, Result, 0, 2, HMM_SIMD__MUL(I, HMM_SIMD__NEG(I, SY), ScaleX));      \
+        HMM_SIMD__STORE(I, Result, 0, 3, Zero);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 1, 0, HMM_SIMD__MUL(I, HMM_SIMD__DET2(I,                   \
+            HMM_SIMD__MUL(I, SX, SY), CZ, CX, SZ), ScaleY));                                  \
+        HMM_SIMD__STORE(I, Result, 1, 1, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I,                    \
+            HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, SX, SY), SZ), HMM_SIMD__MUL(I, CX, CZ)), ScaleY)); \
+        HMM_SIMD__STORE(I, Result, 1, 2, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, SX, CY), ScaleY));  \
+        HMM_SIMD__STORE(I, Result, 1, 3, Zero);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 2, 0, HMM_SIMD__MUL(I, HMM_SIMD__ADD(I,                    \
+            HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, CX, SY), CZ), HMM_SIMD__MUL(I, SX, SZ)), ScaleZ)); \
+        HMM_SIMD__STORE(I, Result, 2, 1, HMM_SIMD__MUL(I, HMM_SIMD__DET2(I,                   \
+            HMM_SIMD__MUL(I, CX, SY), SZ, SX, CZ), ScaleZ));                                  \
+        HMM_SIMD__STORE(I, Result, 2, 2, HMM_SIMD__MUL(I, HMM_SIMD__MUL(I, CX, CY), ScaleZ));  \
+        HMM_SIMD__STORE(I, Result, 2, 3, Zero);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 3, 0, HMM_SIMD__##I##_LOAD(Translation->X + i));           \
+        HMM_SIMD__STORE(I, Result, 3, 1, HMM_SIMD__##I##_LOAD(Translation->Y + i));           \
+        HMM_SIMD__STORE(I, Result, 3, 2, HMM_SIMD__##I##_LOAD(Translation->Z + i));           \
+        HMM_SIMD__STORE(I, Result, 3, 3, One);                                                \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+/* V * (1 / |V|), the division and square root HMM_NormalizeVec3 does */
+#define HMM_SIMD__NORMALIZE3(I, X, Y, Z)                                                      \
+    do                                                                                        \
+    {                                                                                         \
+        HMM_SIMD__V(I) N_Inv = HMM_SIMD__DIV(I, HMM_SIMD__SET1(I, 1.0f),                      \
+            HMM_SIMD__SQRT(I, HMM_SIMD__DOT3(I, X, X, Y, Y, Z, Z)));                          \
+        (X) = HMM_SIMD__MUL(I, X, N_Inv);                                                     \
+        (Y) = HMM_SIMD__MUL(I, Y, N_Inv);                                                     \
+        (Z) = HMM_SIMD__MUL(I, Z, N_Inv);                                                     \
+    } while(0)
+
+/* Same expressions as HMM_LookAt */
+#define HMM_SIMD__DEFINE_LOOK_AT(I, Target)                                                   \
+Target static int                                                                             \
+HMM_SIMD__LookAt##I(const hmm_vec3_soa *Eye, const hmm_vec3_soa *Center,                      \
+                    const hmm_vec3_soa *Up, hmm_mat4_soa *Result, int Begin, int End)         \
+{                                                                                             \
+    HMM_SIMD__V(I) Zero = HMM_SIMD__SET1(I, 0.0f);                                            \
+    int i;                                                                                    \
+    for(i = Begin; i + HMM_SIMD__W(I) <= End; i += HMM_SIMD__W(I))                            \
+    {                                                                                         \
+        HMM_SIMD__V(I) EX = HMM_SIMD__##I##_LOAD(Eye->X + i);                                 \
+        HMM_SIMD__V(I) EY = HMM_SIMD__##I##_LOAD(Eye->Y + i);                                 \
+        HMM_SIMD__V(I) EZ = HMM_SIMD__##I##_LOAD(Eye->Z + i);                                 \
+        HMM_SIMD__V(I) UpX = HMM_SIMD__##I##_LOAD(Up->X + i);                                 \
+        HMM_SIMD__V(I) UpY = HMM_SIMD__##I##_LOAD(Up->Y + i);                                 \
+        HMM_SIMD__V(I) UpZ = HMM_SIMD__##I##_LOAD(Up->Z + i);                                 \
+        HMM_SIMD__V(I) FX = HMM_SIMD__SUB(I, HMM_SIMD__##I##_LOAD(Center->X + i), EX);        \
+        HMM_SIMD__V(I) FY = HMM_SIMD__SUB(I, HMM_SIMD__##I##_LOAD(Center->Y + i), EY);        \
+        HMM_SIMD__V(I) FZ = HMM_SIMD__SUB(I, HMM_SIMD__##I##_LOAD(Center->Z + i), EZ);        \
+        HMM_SIMD__V(I) SX, SY, SZ, UX, UY, UZ;                                                \
+        HMM_SIMD__NORMALIZE3(I, FX, FY, FZ);                                                  \
+        SX = HMM_SIMD__DET2(I, FY, UpZ, FZ, UpY);                                             \
+        SY = HMM_SIMD__DET2(I, FZ, UpX, FX, UpZ);                                             \
+        SZ = HMM_SIMD__DET2(I, FX, UpY, FY, UpX);                                             \
+        HMM_SIMD__NORMALIZE3(I, SX, SY, SZ);                                                  \
+        UX = HMM_SIMD__DET2(I, SY, FZ, SZ, FY);                                               \
+        UY = HMM_SIMD__DET2(I, SZ, FX, SX, FZ);                                               \
+        UZ = HMM_SIMD__DET2(I, SX, FY, SY, FX);                                               \
+                                                                                              \
+        HMM_SIMD__STORE(I, Result, 0, 0, SX); HMM_SIMD__STORE(I, Result, 0, 1, UX);           \
+        HMM_SIMD__STORE(I, Result, 0, 2, HMM_SIMD__NEG(I, FX)); HMM_SIMD__STORE(I, Result, 0, 3, Zero); \
+        HMM_SIMD__STORE(I, Result, 1, 0, SY); HMM_SIMD__STORE(I, Result, 1, 1, UY);           \
+        HMM_SIMD__STORE(I, Result, 1, 2, HMM_SIMD__NEG(I, FY)); HMM_SIMD__STORE(I, Result, 1, 3, Zero); \
+        HMM_SIMD__STORE(I, Result, 2, 0, SZ); HMM_SIMD__STORE(I, Result, 2, 1, UZ);           \
+        HMM_SIMD__STORE(I, Result, 2, 2, HMM_SIMD__NEG(I, FZ)); HMM_SIMD__STORE(I, Result, 2, 3, Zero); \
+        HMM_SIMD__STORE(I, Result, 3, 0, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, SX, EX, SY, EY, SZ, EZ))); \
+        HMM_SIMD__STORE(I, Result, 3, 1, HMM_SIMD__NEG(I, HMM_SIMD__DOT3(I, UX, EX, UY, EY, UZ, EZ))); \
+        HMM_SIMD__STORE(I, Result, 3, 2, HMM_SIMD__DOT3(I, FX, EX, FY, EY, FZ, EZ));          \
+        HMM_SIMD__STORE(I, Result, 3, 3, HMM_SIMD__SET1(I, 1.0f));                            \
+    }                                                                                         \
+    return i;                                                                                 \
+}
+
+#define HMM_SIMD__DEFINE_KERNELS(I, Target)                \
+    HMM_SIMD__DEFINE_MULTIPLY_MAT4(I, Target)              \
+    HMM_SIMD__DEFINE_INVERSE_GENERAL(I, Target)            \
+    HMM_SIMD__DEFINE_INVERSE_AFFINE(I, Target)             \
+    HMM_SIMD__DEFINE_INVERSE_RIGID(I, Target)              \
+    HMM_SIMD__DEFINE_FRUSTUM_CORNERS(I, Target)            \
+    HMM_SIMD__DEFINE_SINCOS(I, Target, Precise)            \
+    HMM_SIMD__DEFINE_SINCOS(I, Target, Fast)               \
+    HMM_SIMD__DEFINE_ROTATE(I, Target, Precise)            \
+    HMM_SIMD__DEFINE_ROTATE(I, Target, Fast)               \
+    HMM_SIMD__DEFINE_COMPOSE_TRS_EULER(I, Target, Precise) \
+    HMM_SIMD__DEFINE_COMPOSE_TRS_EULER(I, Target, Fast)    \
+    HMM_SIMD__DEFINE_LOOK_AT(I, Target)
+
+HMM_SIMD__DEFINE_KERNELS(Scalar, )
+
+#ifdef HANDMADE_MATH__X86_DISPATCH
+HMM_SIMD__DEFINE_KERNELS(SSE2, )
+HMM_SIMD__DEFINE_KERNELS(AVX2, HMM_SIMD__TARGET("avx2"))
+HMM_SIMD__DEFINE_KERNELS(AVX512, HMM_SIMD__TARGET("avx512f"))
+#endif
+
+typedef int hmm_simd__multiply_mat4_fn(const hmm_mat4_soa *Left, const hmm_mat4_soa *Right,
+                                       hmm_mat4_soa *Result, int Begin, int End);
+typedef int hmm_simd__inverse_mat4_fn(const hmm_mat4_soa *Matrices, hmm_mat4_soa *Result,
+                                      int Begin, int End);
+typedef int hmm_simd__frustum_corners_fn(const hmm_mat4_soa *InvViewProj, float *Dest, int VertexStride,
+                                         int Begin, int End);
+typedef int hmm_simd__sincos_fn(const float *Angles, float *Sin, float *Cos, int Begin, int End);
+typedef int hmm_simd__rotate_fn(const float *Angles, const float *AxisX, const float *AxisY,
+                                const float *AxisZ, hmm_mat4_soa *Result, int Begin, int End);
+typedef int hmm_simd__compose_trs_euler_fn(const hmm_vec3_soa *Translation, const hmm_vec3_soa *EulerDegrees,
+                                           const hmm_vec3_soa *Scale, hmm_mat4_soa *Result, int Begin, int End);
+typedef int hmm_simd__look_at_fn(const hmm_vec3_soa *Eye, const hmm_vec3_soa *Center,
+                                 const hmm_vec3_soa *Up, hmm_mat4_soa *Result, int Begin, int End);
+
+static struct
+{
+    int Initialized;
+    hmm_simd_level MaxLevel;
+    hmm_simd_level Level;
+    hmm_simd__multiply_mat4_fn *MultiplyMat4;
+    hmm_simd__inverse_mat4_fn *InverseMat4[3];
+    hmm_simd__frustum_corners_fn *FrustumCorners;
+    hmm_simd__sincos_fn *SinCos[2];
+    hmm_simd__rotate_fn *Rotate[2];
+    hmm_simd__compose_trs_euler_fn *ComposeTRSEuler[2];
+    hmm_simd__look_at_fn *LookAt;
+} HMM_SIMD__State;
+
+/*
+ * CPU detection
+ */
+
+#ifdef HANDMADE_MATH__X86_DISPATCH
+
+static void
+HMM_SIMD__CPUID(unsigned int Leaf, unsigned int SubLeaf, unsigned int Regs[4])
+{
+#ifdef _MSC_VER
+    int Info[4];
+    __cpuidex(Info, (int)Leaf, (int)SubLeaf);
+    Regs[0] = (unsigned int)Info[0]; Regs[1] = (unsigned int)Info[1];
+    Regs[2] = (unsigned int)Info[2]; Regs[3] = (unsigned int)Info[3];
+#else
+    __cpuid_count(Leaf, SubLeaf, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+}
+
+static uint64_t
+HMM_SIMD__XGETBV(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int Lo, Hi;
+    __asm__ __volatile__("xgetbv" : "=a"(Lo), "=d"(Hi) : "c"(0));
+    return ((uint64_t)Hi << 32) | Lo;
+#endif
+}
+
+static hmm_simd_level
+HMM_SIMD__DetectLevel(void)
+{
+    unsigned int Regs[4];
+    unsigned int MaxLeaf;
+    uint64_t XCR0;
+
+    HMM_SIMD__CPUID(0, 0, Regs);
+    MaxLeaf = Regs[0];
+
+    HMM_SIMD__CPUID(1, 0, Regs);
+    if(!(Regs[3] & (1u << 26)))
+        return HMM_SIMD_SCALAR;
+
+    /* AVX state has to be enabled by the OS (OSXSAVE + XCR0), not just present */
+    if(!(Regs[2] & (1u << 27)) || !(Regs[2] & (1u << 28)) || MaxLeaf < 7)
+        return HMM_SIMD_SSE2;
+
+    XCR0 = HMM_SIMD__XGETBV();
+    if((XCR0 & 0x6) != 0x6)
+        return HMM_SIMD_SSE2;
+
+    HMM_SIMD__CPUID(7, 0, Regs);
+    if((Regs[1] & (1u << 16)) && (XCR0 & 0xe6) == 0xe6)
+        return HMM_SIMD_AVX512;
+    if(Regs[1] & (1u << 5))
+        return HMM_SIMD_AVX2;
+    return HMM_SIMD_SSE2;
+}
+
+#else
+
+static hmm_simd_level
+HMM_SIMD__DetectLevel(void)
+{
+    return HMM_SIMD_SCALAR;
+}
+
+#endif /* HANDMADE_MATH__X86_DISPATCH */
+
+/*
+ * Dispatch
+ */
+
+#define HMM_SIMD__INSTALL(I)                                                                   \
+    HMM_SIMD__State.MultiplyMat4 = HMM_SIMD__MultiplyMat4##I;                                  \
+    HMM_SIMD__State.InverseMat4[HMM_MAT4_GENERAL] = HMM_SIMD__InverseMat4General##I;           \
+    HMM_SIMD__State.InverseMat4[HMM_MAT4_AFFINE] = HMM_SIMD__InverseMat4Affine##I;             \
+    HMM_SIMD__State.InverseMat4[HMM_MAT4_RIGID] = HMM_SIMD__InverseMat4Rigid##I;               \
+    HMM_SIMD__State.FrustumCorners = HMM_SIMD__FrustumCorners##I;                              \
+    HMM_SIMD__State.SinCos[HMM_SINCOS_PRECISE] = HMM_SIMD__SinCosPrecise##I;                   \
+    HMM_SIMD__State.SinCos[HMM_SINCOS_FAST] = HMM_SIMD__SinCosFast##I;                         \
+    HMM_SIMD__State.Rotate[HMM_SINCOS_PRECISE] = HMM_SIMD__RotatePrecise##I;                   \
+    HMM_SIMD__State.Rotate[HMM_SINCOS_FAST] = HMM_SIMD__RotateFast##I;                         \
+    HMM_SIMD__State.ComposeTRSEuler[HMM_SINCOS_PRECISE] = HMM_SIMD__ComposeTRSEulerPrecise##I; \
+    HMM_SIMD__State.ComposeTRSEuler[HMM_SINCOS_FAST] = HMM_SIMD__ComposeTRSEulerFast##I;       \
+    HMM_SIMD__State.LookAt = HMM_SIMD__LookAt##I
+
+static void
+HMM_SIMD__Install(hmm_simd_level Level)
+{
+    HMM_SIMD__State.Level = Level;
+    switch(Level)
+    {
+#ifdef HANDMADE_MATH__X86_DISPATCH
+    case HMM_SIMD_AVX512:
+        HMM_SIMD__INSTALL(AVX512);
+        break;
+    case HMM_SIMD_AVX2:
+        HMM_SIMD__INSTALL(AVX2);
+        break;
+    case HMM_SIMD_SSE2:
+        HMM_SIMD__INSTALL(SSE2);
+        break;
+#endif
+    default:
+        HMM_SIMD__State.Level = HMM_SIMD_SCALAR;
+        HMM_SIMD__INSTALL(Scalar);
+        break;
+    }
+}
+
+hmm_simd_level
+HMM_PREFIX(SIMDInit)(void)
+{
+    if(!HMM_SIMD__State.Initialized)
+    {
+        HMM_SIMD__State.MaxLevel = HMM_SIMD__DetectLevel();
+        HMM_SIMD__Install(HMM_SIMD__State.MaxLevel);
+        HMM_SIMD__State.Initialized = 1;
+    }
+    return HMM_SIMD__State.Level;
+}
+
+hmm_simd_level
+HMM_PREFIX(SIMDMaxLevel)(void)
+{
+    HMM_PREFIX(SIMDInit)();
+    return HMM_SIMD__State.MaxLevel;
+}
+
+hmm_simd_level
+HMM_PREFIX(SIMDLevel)(void)
+{
+    return HMM_PREFIX(SIMDInit)();
+}
+
+/* Forces a kernel set, clamped to what the CPU supports. Returns the level
+   that was actually installed. */
+hmm_simd_level
+HMM_PREFIX(SetSIMDLevel)(hmm_simd_level Level)
+{
+    HMM_PREFIX(SIMDInit)();
+    if(Level > HMM_SIMD__State.MaxLevel)
+        Level = HMM_SIMD__State.MaxLevel;
+    HMM_SIMD__Install(Level);
+    return HMM_SIMD__State.Level;
+}
+
+const char *
+HMM_PREFIX(SIMDLevelName)(hmm_simd_level Level)
+{
+    switch(Level)
+    {
+    case HMM_SIMD_SCALAR: return "scalar";
+    case HMM_SIMD_SSE2:   return "SSE2";
+    case HMM_SIMD_AVX2:   return "AVX2";
+    case HMM_SIMD_AVX512: return "AVX-512";
+    default:              return "unknown";
+    }
+}
+
+/*
+ * Storage
+ */
+
+hmm_bool
+HMM_PREFIX(AllocMat4SoA)(hmm_mat4_soa *Batch, int Count)
+{
+    size_t Stride = ((size_t)Count * sizeof(float) + HMM_SIMD__ALIGN - 1) & ~(size_t)(HMM_SIMD__ALIGN - 1);
+    unsigned char *Base;
+    int Columns, Rows;
+
+    Batch->Count = 0;
+    Batch->Memory = malloc(16 * Stride + HMM_SIMD__ALIGN);
+    if(!Batch->Memory)
+        return 0;
+
+    Base = (unsigned char *)(((uintptr_t)Batch->Memory + HMM_SIMD__ALIGN - 1) & ~(uintptr_t)(HMM_SIMD__ALIGN - 1));
+    for(Columns = 0; Columns < 4; ++Columns)
+    {
+        for(Rows = 0; Rows < 4; ++Rows)
+        {
+            Batch->Elements[Columns][Rows] = (float *)(Base + (size_t)(Columns * 4 + Rows) * Stride);
+        }
+    }
+    Batch->Count = Count;
+    return 1;
+}
+
+void
+HMM_PREFIX(FreeMat4SoA)(hmm_mat4_soa *Batch)
+{
+    free(Batch->Memory);
+    Batch->Memory = 0;
+    Batch->Count = 0;
+}
+
+/*
+ * Batch operations
+ */
+
+void
+HMM_PREFIX(MultiplyMat4Batch)(const hmm_mat4_soa *Left, const hmm_mat4_soa *Right,
+                              hmm_mat4_soa *Result, int Count)
+{
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.MultiplyMat4(Left, Right, Result, 0, Count);
+    HMM_SIMD__MultiplyMat4Scalar(Left, Right, Result, Done, Count);
+}
+
+void
+HMM_PREFIX(InverseMat4Batch)(const hmm_mat4_soa *Matrices, hmm_mat4_soa *Result,
+                             int Count, hmm_mat4_kind Kind)
+{
+    static hmm_simd__inverse_mat4_fn *const ScalarInverse[3] = {
+        HMM_SIMD__InverseMat4GeneralScalar,
+        HMM_SIMD__InverseMat4AffineScalar,
+        HMM_SIMD__InverseMat4RigidScalar
+    };
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.InverseMat4[Kind](Matrices, Result, 0, Count);
+    ScalarInverse[Kind](Matrices, Result, Done, Count);
+}
+
+void
+HMM_PREFIX(FrustumCornersBatch)(const hmm_mat4_soa *InvViewProj, float *Dest,
+                                int Count, int VertexStride)
+{
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.FrustumCorners(InvViewProj, Dest, VertexStride, 0, Count);
+    HMM_SIMD__FrustumCornersScalar(InvViewProj, Dest, VertexStride, Done, Count);
+}
+
+void
+HMM_PREFIX(SinCosBatch)(const float *Angles, float *Sin, float *Cos, int Count,
+                        hmm_sincos_accuracy Accuracy)
+{
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.SinCos[Accuracy](Angles, Sin, Cos, 0, Count);
+    if(Accuracy == HMM_SINCOS_FAST)
+        HMM_SIMD__SinCosFastScalar(Angles, Sin, Cos, Done, Count);
+    else
+        HMM_SIMD__SinCosPreciseScalar(Angles, Sin, Cos, Done, Count);
+}
+
+void
+HMM_PREFIX(RotateBatch)(const float *Angles, const float *AxisX, const float *AxisY,
+                        const float *AxisZ, hmm_mat4_soa *Result, int Count,
+                        hmm_sincos_accuracy Accuracy)
+{
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.Rotate[Accuracy](Angles, AxisX, AxisY, AxisZ, Result, 0, Count);
+    if(Accuracy == HMM_SINCOS_FAST)
+        HMM_SIMD__RotateFastScalar(Angles, AxisX, AxisY, AxisZ, Result, Done, Count);
+    else
+        HMM_SIMD__RotatePreciseScalar(Angles, AxisX, AxisY, AxisZ, Result, Done, Count);
+}
+
+void
+HMM_PREFIX(ComposeTRSEulerBatch)(const hmm_vec3_soa *Translation, const hmm_vec3_soa *EulerDegrees,
+                                 const hmm_vec3_soa *Scale, hmm_mat4_soa *Result, int Count,
+                                 hmm_sincos_accuracy Accuracy)
+{
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.ComposeTRSEuler[Accuracy](Translation, EulerDegrees, Scale, Result, 0, Count);
+    if(Accuracy == HMM_SINCOS_FAST)
+        HMM_SIMD__ComposeTRSEulerFastScalar(Translation, EulerDegrees, Scale, Result, Done, Count);
+    else
+        HMM_SIMD__ComposeTRSEulerPreciseScalar(Translation, EulerDegrees, Scale, Result, Done, Count);
+}
+
+void
+HMM_PREFIX(LookAtBatch)(const hmm_vec3_soa *Eye, const hmm_vec3_soa *Center,
+                        const hmm_vec3_soa *Up, hmm_mat4_soa *Result, int Count)
+{
+    int Done;
+    HMM_PREFIX(SIMDInit)();
+    Done = HMM_SIMD__State.LookAt(Eye, Center, Up, Result, 0, Count);
+    HMM_SIMD__LookAtScalar(Eye, Center, Up, Result, Done, Count);
+}
+
+#ifdef __clang__
+# pragma STDC FP_CONTRACT DEFAULT
+#endif
+
+#endif /* HANDMADE_MATH_SIMD_IMPLEMENTED */
+#endif /* HANDMADE_MATH_SIMD_IMPLEMENTATION */
@@ -0,0 +1,237 @@
+/*
+  gl_stream.h
+
+  Ring buffer for vertex and index data that is rewritten every frame.
+
+  Each stream owns one buffer object split into GL_STREAM_REGIONS regions.
+  gl_stream_map() hands out the next region and gl_stream_fence(), called
+  once the draws reading from it have been issued, puts a fence behind it.
+  By the time the ring wraps around to a region the GPU has normally long
+  finished with it, so mapping never has to wait; when it does, the wait is
+  counted in the stream's stats as a stall.
+
+  With ARB_buffer_storage (GL 4.4) the whole buffer is mapped once,
+  persistently and coherently, and writes go straight into it. Without it
+  every map orphans the buffer instead (glBufferData with NULL, then
+  glMapBufferRange with GL_MAP_INVALIDATE_BUFFER_BIT) and the driver does
+  the renaming, which is also counted. Defining GL_STREAM_NO_PERSISTENT
+  forces the orphaning path.
+
+  A GL loader (GLEW) must be included before this header. You MUST
+
+     #define GL_STREAM_IMPLEMENTATION
+
+  in EXACTLY one C file that includes this header, BEFORE the include.
+
+  All buffer operations go through GL_COPY_WRITE_BUFFER, so creating and
+  mapping a stream never disturbs the ARRAY or ELEMENT_ARRAY bindings of
+  whatever VAO is bound. The caller binds stream->buffer to the target it
+  draws from, and picks up the data at stream->offset, which is always a
+  multiple of the stride passed to gl_stream_reserve(); with
+  glDrawElementsBaseVertex the VAO's attribute pointers can stay at 0.
+*/
+
+#ifndef GL_STREAM_H
+#define GL_STREAM_H
+
+#define GL_STREAM_REGIONS 3
+
+struct gl_stream_stats
+{
+    unsigned long maps;         /* regions handed out */
+    unsigned long stalls;       /* maps that had to wait on a fence */
+    unsigned long orphans;      /* maps served by orphaning instead */
+    unsigned long reallocs;     /* buffer (re)allocations */
+    double stall_seconds;       /* time spent blocked in those waits */
+    GLsizeiptr used;            /* bytes written by the last map */
+    GLsizeiptr high_water;      /* most bytes written by any map */
+};
+
+struct gl_stream
+{
+    GLuint buffer;
+    GLsizeiptr region_size;
+    GLsizeiptr stride;
+    int persistent;
+    unsigned char *base;        /* persistent mapping, NULL when orphaning */
+    GLsync fences[GL_STREAM_REGIONS];
+    int region;                 /* region last handed out */
+    GLintptr offset;            /* and its byte offset into buffer */
+    struct gl_stream_stats stats;
+};
+
+/* Zeroes the stream. No GL calls, storage comes with gl_stream_reserve. */
+void gl_stream_init(struct gl_stream *stream);
+
+/*
+ * Makes every region at least region_size bytes, rounded up to a multiple
+ * of stride. Returns nonzero when the buffer object was replaced, in which
+ * case anything pointing at the old stream->buffer must be rebound.
+ */
+int gl_stream_reserve(struct gl_stream *stream, GLsizeiptr region_size, GLsizeiptr stride);
+
+/*
+ * Returns size bytes to write to, at stream->offset in stream->buffer, or
+ * NULL if size is larger than a region. Only those size bytes are mapped
+ * when orphaning. Must be followed by gl_stream_unmap() before drawing,
+ * which is told how many of them were actually written.
+ */
+void *gl_stream_map(struct gl_stream *stream, GLsizeiptr size);
+void gl_stream_unmap(struct gl_stream *stream, GLsizeiptr used);
+
+/*
+ * Fences the region last handed out. Call after every frame's draws that
+ * read from it, including frames that reuse it without mapping again.
+ */
+void gl_stream_fence(struct gl_stream *stream);
+
+void gl_stream_destroy(struct gl_stream *stream);
+
+#endif
+
+#if defined(GL_STREAM_IMPLEMENTATION) && !defined(GL_STREAM_IMPLEMENTED)
+#define GL_STREAM_IMPLEMENTED
+
+#include <string.h>
+#include <SDL2/SDL.h>
+
+void
+gl_stream_init(struct gl_stream *stream)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->region = GL_STREAM_REGIONS - 1;
+}
+
+static void
+gl_stream__release(struct gl_stream *stream)
+{
+    int i;
+    for (i = 0; i < GL_STREAM_REGIONS; i++) {
+        if (stream->fences[i])
+            glDeleteSync(stream->fences[i]);
+        stream->fences[i] = 0;
+    }
+    if (stream->base) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        stream->base = NULL;
+    }
+    if (stream->buffer)
+        glDeleteBuffers(1, &stream->buffer);
+    stream->buffer = 0;
+}
+
+int
+gl_stream_reserve(struct gl_stream *stream, GLsizeiptr region_size, GLsizeiptr stride)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    region_size = (region_size + stride - 1) / stride * stride;
+    if (stream->buffer && region_size <= stream->region_size && stride == stream->stride)
+        return 0;
+
+    /* storage from glBufferStorage is immutable, so growing means a new buffer */
+    gl_stream__release(stream);
+    stream->region_size = region_size;
+    stream->stride = stride;
+    stream->region = GL_STREAM_REGIONS - 1;
+    stream->offset = 0;
+    stream->stats.reallocs++;
+
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+#ifndef GL_STREAM_NO_PERSISTENT
+    stream->persistent = GLEW_ARB_buffer_storage ? 1 : 0;
+#endif
+    if (stream->persistent) {
+        glBufferStorage(GL_COPY_WRITE_BUFFER, region_size * GL_STREAM_REGIONS, NULL, flags);
+        stream->base = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                                        region_size * GL_STREAM_REGIONS, flags);
+        if (!stream->base) {
+            /* keep going on the orphaning path with a fresh, mutable buffer */
+            glDeleteBuffers(1, &stream->buffer);
+            glGenBuffers(1, &stream->buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+            stream->persistent = 0;
+        }
+    }
+    if (!stream->persistent)
+        glBufferData(GL_COPY_WRITE_BUFFER, region_size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return 1;
+}
+
+void *
+gl_stream_map(struct gl_stream *stream, GLsizeiptr size)
+{
+    GLsync fence;
+    void *ptr;
+
+    if (size > stream->region_size)
+        return NULL;
+    stream->stats.maps++;
+
+    if (!stream->persistent) {
+        stream->stats.orphans++;
+        stream->offset = 0;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, stream->region_size, NULL, GL_STREAM_DRAW);
+        ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return ptr;
+    }
+
+    stream->region = (stream->region + 1) % GL_STREAM_REGIONS;
+    stream->offset = stream->region * stream->region_size;
+    fence = stream->fences[stream->region];
+    if (fence) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            GLenum status;
+            stream->stats.stalls++;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            stream->stats.stall_seconds += (double)(SDL_GetPerformanceCounter() - start)
+                / (double)SDL_GetPerformanceFrequency();
+        }
+        glDeleteSync(fence);
+        stream->fences[stream->region] = 0;
+    }
+    return stream->base + stream->offset;
+}
+
+void
+gl_stream_unmap(struct gl_stream *stream, GLsizeiptr used)
+{
+    stream->stats.used = used;
+    if (used > stream->stats.high_water)
+        stream->stats.high_water = used;
+
+    /* coherent persistent mappings need no unmap or flush */
+    if (stream->persistent)
+        return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void
+gl_stream_fence(struct gl_stream *stream)
+{
+    if (!stream->persistent)
+        return;
+    if (stream->fences[stream->region])
+        glDeleteSync(stream->fences[stream->region]);
+    stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void
+gl_stream_destroy(struct gl_stream *stream)
+{
+    gl_stream__release(stream);
+    stream->region_size = 0;
+}
+
+#endif
@@ -0,0 +1,685 @@
+/*
+  gl_trace.h
+
+  Optional counting layer over the GL entry points the renderer calls every
+  frame. With GL_TRACE defined to 1, every file that includes this header
+  after its GL loader has glUseProgram, glBindBuffer, glEnable, glDraw* and
+  the rest redirected to wrappers that count the call and then make it.
+
+  The state setters also keep a shadow of what they last set, and a call
+  that sets what is already set is counted as redundant, along with the
+  file and line it came from. The shadow starts out unknown and is
+  forgotten again whenever a bound object may have been deleted, so a call
+  is only ever flagged when it provably changed nothing. Binding a vertex
+  array forgets the element array binding, which belongs to the VAO.
+
+  Calls are never skipped, so turning tracing on changes only timing. It
+  is a measuring tool for deciding what a state cache would save, not the
+  cache itself.
+
+  Without GL_TRACE nothing is redirected and gl_trace_end_frame() is a
+  no-op. You MUST
+
+     #define GL_TRACE_IMPLEMENTATION
+
+  in EXACTLY one C file that includes this header, BEFORE the include.
+  The header must come after the GL loader and before any code that makes
+  the calls to be traced, including other headers such as gl_stream.h.
+*/
+
+#ifndef GL_TRACE_H
+#define GL_TRACE_H
+
+#ifndef GL_TRACE
+#define GL_TRACE 0
+#endif
+
+#if GL_TRACE
+
+enum gl_trace_call {
+    GL_TRACE_USE_PROGRAM,
+    GL_TRACE_BIND_VERTEX_ARRAY,
+    GL_TRACE_BIND_BUFFER,
+    GL_TRACE_BIND_BUFFER_BASE,
+    GL_TRACE_ACTIVE_TEXTURE,
+    GL_TRACE_BIND_TEXTURE,
+    GL_TRACE_BIND_FRAMEBUFFER,
+    GL_TRACE_ENABLE,
+    GL_TRACE_DISABLE,
+    GL_TRACE_BLEND_FUNC,
+    GL_TRACE_BLEND_EQUATION,
+    GL_TRACE_VIEWPORT,
+    GL_TRACE_SCISSOR,
+    GL_TRACE_CLEAR_COLOR,
+    GL_TRACE_UNIFORM,
+    GL_TRACE_BUFFER_DATA,
+    GL_TRACE_MAP_BUFFER,
+    GL_TRACE_CLEAR,
+    GL_TRACE_DRAW,
+    GL_TRACE_CALL_COUNT
+};
+
+struct gl_trace_counts
+{
+    unsigned long calls;
+    unsigned long redundant;
+};
+
+struct gl_trace_stats
+{
+    const char *names[GL_TRACE_CALL_COUNT];
+    struct gl_trace_counts frame[GL_TRACE_CALL_COUNT];      /* frame in progress */
+    struct gl_trace_counts last_frame[GL_TRACE_CALL_COUNT];
+    struct gl_trace_counts total[GL_TRACE_CALL_COUNT];
+    /* where the latest redundant call of each kind was made */
+    const char *redundant_file[GL_TRACE_CALL_COUNT];
+    int redundant_line[GL_TRACE_CALL_COUNT];
+};
+
+/* Moves the frame's counts to last_frame. Call once per frame. */
+void gl_trace_end_frame(void);
+const struct gl_trace_stats *gl_trace_stats(void);
+
+/* Prints every kind of call that was ever redundant, and where */
+void gl_trace_report(FILE *out);
+
+void gl_trace_use_program(GLuint program, const char *file, int line);
+void gl_trace_bind_vertex_array(GLuint array, const char *file, int line);
+void gl_trace_bind_buffer(GLenum target, GLuint buffer, const char *file, int line);
+void gl_trace_bind_buffer_base(GLenum target, GLuint index, GLuint buffer, const char *file, int line);
+void gl_trace_active_texture(GLenum unit, const char *file, int line);
+void gl_trace_bind_texture(GLenum target, GLuint texture, const char *file, int line);
+void gl_trace_bind_framebuffer(GLenum target, GLuint framebuffer, const char *file, int line);
+void gl_trace_enable(GLenum cap, const char *file, int line);
+void gl_trace_disable(GLenum cap, const char *file, int line);
+void gl_trace_blend_func(GLenum sfactor, GLenum dfactor, const char *file, int line);
+void gl_trace_blend_func_separate(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha,
+                                  const char *file, int line);
+void gl_trace_blend_equation(GLenum mode, const char *file, int line);
+void gl_trace_viewport(GLint x, GLint y, GLsizei width, GLsizei height, const char *file, int line);
+void gl_trace_scissor(GLint x, GLint y, GLsizei width, GLsizei height, const char *file, int line);
+void gl_trace_clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a, const char *file, int line);
+void gl_trace_uniform1i(GLint location, GLint v0);
+void gl_trace_uniform_matrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+void gl_trace_buffer_data(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+void gl_trace_buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+void *gl_trace_map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+GLboolean gl_trace_unmap_buffer(GLenum target);
+void gl_trace_clear(GLbitfield mask);
+void gl_trace_clear_bufferfv(GLenum buffer, GLint drawbuffer, const GLfloat *value);
+void gl_trace_draw_arrays(GLenum mode, GLint first, GLsizei count);
+void gl_trace_draw_elements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+void gl_trace_draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type,
+                                        const void *indices, GLint basevertex);
+void gl_trace_delete_buffers(GLsizei n, const GLuint *buffers);
+void gl_trace_delete_vertex_arrays(GLsizei n, const GLuint *arrays);
+void gl_trace_delete_textures(GLsizei n, const GLuint *textures);
+void gl_trace_delete_framebuffers(GLsizei n, const GLuint *framebuffers);
+void gl_trace_delete_program(GLuint program);
+
+#else
+
+#define gl_trace_end_frame() ((void)0)
+
+#endif
+
+#endif
+
+#if defined(GL_TRACE_IMPLEMENTATION) && !defined(GL_TRACE_IMPLEMENTED) && GL_TRACE
+#define GL_TRACE_IMPLEMENTED
+
+#include <stdio.h>
+#include <string.h>
+
+#define GL_TRACE_UNKNOWN (-1)
+#define GL_TRACE_TEXTURE_UNITS 16
+
+/* bindings and capabilities with a shadow, anything else is only counted */
+enum gl_trace_buffer_target {
+    GL_TRACE_ARRAY_BUFFER,
+    GL_TRACE_ELEMENT_ARRAY_BUFFER,
+    GL_TRACE_UNIFORM_BUFFER,
+    GL_TRACE_COPY_READ_BUFFER,
+    GL_TRACE_COPY_WRITE_BUFFER,
+    GL_TRACE_PIXEL_PACK_BUFFER,
+    GL_TRACE_PIXEL_UNPACK_BUFFER,
+    GL_TRACE_BUFFER_TARGETS
+};
+
+enum gl_trace_cap {
+    GL_TRACE_CAP_BLEND,
+    GL_TRACE_CAP_SCISSOR_TEST,
+    GL_TRACE_CAP_DEPTH_TEST,
+    GL_TRACE_CAP_CULL_FACE,
+    GL_TRACE_CAP_STENCIL_TEST,
+    GL_TRACE_CAPS
+};
+
+static struct gl_trace_stats gl_trace = {.names = {
+    "glUseProgram",
+    "glBindVertexArray",
+    "glBindBuffer",
+    "glBindBufferBase",
+    "glActiveTexture",
+    "glBindTexture",
+    "glBindFramebuffer",
+    "glEnable",
+    "glDisable",
+    "glBlendFunc*",
+    "glBlendEquation",
+    "glViewport",
+    "glScissor",
+    "glClearColor",
+    "glUniform*",
+    "glBuffer*Data",
+    "glMap/Unmap",
+    "glClear*",
+    "glDraw*",
+}};
+
+/* what the wrappers last set, GL_TRACE_UNKNOWN until then */
+static struct
+{
+    int valid;
+    GLint64 program;
+    GLint64 vertex_array;
+    GLint64 buffers[GL_TRACE_BUFFER_TARGETS];
+    GLint64 active_texture;
+    GLint64 textures[GL_TRACE_TEXTURE_UNITS];
+    GLint64 draw_framebuffer, read_framebuffer;
+    int caps[GL_TRACE_CAPS];
+    GLint64 blend[4];
+    GLint64 blend_equation;
+    GLint64 viewport[4];
+    GLint64 scissor[4];
+    GLfloat clear_color[4];
+    int clear_color_known;
+} gl_trace_shadow;
+
+static void
+gl_trace__forget(void)
+{
+    int i;
+    gl_trace_shadow.program = GL_TRACE_UNKNOWN;
+    gl_trace_shadow.vertex_array = GL_TRACE_UNKNOWN;
+    for (i = 0; i < GL_TRACE_BUFFER_TARGETS; i++)
+        gl_trace_shadow.buffers[i] = GL_TRACE_UNKNOWN;
+    gl_trace_shadow.active_texture = GL_TRACE_UNKNOWN;
+    for (i = 0; i < GL_TRACE_TEXTURE_UNITS; i++)
+        gl_trace_shadow.textures[i] = GL_TRACE_UNKNOWN;
+    gl_trace_shadow.draw_framebuffer = GL_TRACE_UNKNOWN;
+    gl_trace_shadow.read_framebuffer = GL_TRACE_UNKNOWN;
+    for (i = 0; i < GL_TRACE_CAPS; i++)
+        gl_trace_shadow.caps[i] = GL_TRACE_UNKNOWN;
+    for (i = 0; i < 4; i++) {
+        gl_trace_shadow.blend[i] = GL_TRACE_UNKNOWN;
+        gl_trace_shadow.viewport[i] = GL_TRACE_UNKNOWN;
+        gl_trace_shadow.scissor[i] = GL_TRACE_UNKNOWN;
+    }
+    gl_trace_shadow.blend_equation = GL_TRACE_UNKNOWN;
+    gl_trace_shadow.clear_color_known = 0;
+    gl_trace_shadow.valid = 1;
+}
+
+static void
+gl_trace__count(enum gl_trace_call call)
+{
+    gl_trace.frame[call].calls++;
+    gl_trace.total[call].calls++;
+}
+
+/* Counts a setter call and flags it if it leaves the shadow as it was */
+static void
+gl_trace__set(enum gl_trace_call call, GLint64 *shadow, GLint64 value, const char *file, int line)
+{
+    if (!gl_trace_shadow.valid)
+        gl_trace__forget();
+    gl_trace__count(call);
+    if (shadow && *shadow == value) {
+        gl_trace.frame[call].redundant++;
+        gl_trace.total[call].redundant++;
+        gl_trace.redundant_file[call] = file;
+        gl_trace.redundant_line[call] = line;
+        return;
+    }
+    if (shadow)
+        *shadow = value;
+}
+
+static GLint64 *
+gl_trace__buffer_slot(GLenum target)
+{
+    switch (target) {
+    case GL_ARRAY_BUFFER:         return &gl_trace_shadow.buffers[GL_TRACE_ARRAY_BUFFER];
+    case GL_ELEMENT_ARRAY_BUFFER: return &gl_trace_shadow.buffers[GL_TRACE_ELEMENT_ARRAY_BUFFER];
+    case GL_UNIFORM_BUFFER:       return &gl_trace_shadow.buffers[GL_TRACE_UNIFORM_BUFFER];
+    case GL_COPY_READ_BUFFER:     return &gl_trace_shadow.buffers[GL_TRACE_COPY_READ_BUFFER];
+    case GL_COPY_WRITE_BUFFER:    return &gl_trace_shadow.buffers[GL_TRACE_COPY_WRITE_BUFFER];
+    case GL_PIXEL_PACK_BUFFER:    return &gl_trace_shadow.buffers[GL_TRACE_PIXEL_PACK_BUFFER];
+    case GL_PIXEL_UNPACK_BUFFER:  return &gl_trace_shadow.buffers[GL_TRACE_PIXEL_UNPACK_BUFFER];
+    default:                      return NULL;
+    }
+}
+
+static int *
+gl_trace__cap_slot(GLenum cap)
+{
+    switch (cap) {
+    case GL_BLEND:        return &gl_trace_shadow.caps[GL_TRACE_CAP_BLEND];
+    case GL_SCISSOR_TEST: return &gl_trace_shadow.caps[GL_TRACE_CAP_SCISSOR_TEST];
+    case GL_DEPTH_TEST:   return &gl_trace_shadow.caps[GL_TRACE_CAP_DEPTH_TEST];
+    case GL_CULL_FACE:    return &gl_trace_shadow.caps[GL_TRACE_CAP_CULL_FACE];
+    case GL_STENCIL_TEST: return &gl_trace_shadow.caps[GL_TRACE_CAP_STENCIL_TEST];
+    default:              return NULL;
+    }
+}
+
+static void
+gl_trace__cap(enum gl_trace_call call, GLenum cap, int enabled, const char *file, int line)
+{
+    int *slot = gl_trace__cap_slot(cap);
+    GLint64 shadow;
+
+    if (!gl_trace_shadow.valid)
+        gl_trace__forget();
+    shadow = slot ? *slot : GL_TRACE_UNKNOWN;
+    gl_trace__set(call, slot ? &shadow : NULL, enabled, file, line);
+    if (slot)
+        *slot = (int)shadow;
+}
+
+void
+gl_trace_end_frame(void)
+{
+    memcpy(gl_trace.last_frame, gl_trace.frame, sizeof(gl_trace.frame));
+    memset(gl_trace.frame, 0, sizeof(gl_trace.frame));
+}
+
+const struct gl_trace_stats *
+gl_trace_stats(void)
+{
+    return &gl_trace;
+}
+
+void
+gl_trace_report(FILE *out)
+{
+    int call;
+    for (call = 0; call < GL_TRACE_CALL_COUNT; call++) {
+        const struct gl_trace_counts *total = &gl_trace.total[call];
+        if (!total->redundant)
+            continue;
+        fprintf(out, "GL trace: %s %lu of %lu calls redundant, last at %s:%d\n",
+                gl_trace.names[call], total->redundant, total->calls,
+                gl_trace.redundant_file[call], gl_trace.redundant_line[call]);
+    }
+}
+
+void
+gl_trace_use_program(GLuint program, const char *file, int line)
+{
+    gl_trace__set(GL_TRACE_USE_PROGRAM, &gl_trace_shadow.program, program, file, line);
+    glUseProgram(program);
+}
+
+void
+gl_trace_bind_vertex_array(GLuint array, const char *file, int line)
+{
+    gl_trace__set(GL_TRACE_BIND_VERTEX_ARRAY, &gl_trace_shadow.vertex_array, array, file, line);
+    /* the element array binding comes with the VAO */
+    gl_trace_shadow.buffers[GL_TRACE_ELEMENT_ARRAY_BUFFER] = GL_TRACE_UNKNOWN;
+    glBindVertexArray(array);
+}
+
+void
+gl_trace_bind_buffer(GLenum target, GLuint buffer, const char *file, int line)
+{
+    gl_trace__set(GL_TRACE_BIND_BUFFER, gl_trace__buffer_slot(target), buffer, file, line);
+    glBindBuffer(target, buffer);
+}
+
+void
+gl_trace_bind_buffer_base(GLenum target, GLuint index, GLuint buffer, const char *file, int line)
+{
+    GLint64 *slot;
+
+    /* the indexed binding has no shadow, but the generic one changes too */
+    gl_trace__set(GL_TRACE_BIND_BUFFER_BASE, NULL, buffer, file, line);
+    slot = gl_trace__buffer_slot(target);
+    if (slot)
+        *slot = buffer;
+    glBindBufferBase(target, index, buffer);
+}
+
+void
+gl_trace_active_texture(GLenum unit, const char *file, int line)
+{
+    gl_trace__set(GL_TRACE_ACTIVE_TEXTURE, &gl_trace_shadow.active_texture, unit, file, line);
+    glActiveTexture(unit);
+}
+
+void
+gl_trace_bind_texture(GLenum target, GLuint texture, const char *file, int line)
+{
+    GLint64 *slot = NULL;
+    GLint64 unit;
+
+    if (!gl_trace_shadow.valid)
+        gl_trace__forget();
+    unit = gl_trace_shadow.active_texture;
+    if (target == GL_TEXTURE_2D && unit != GL_TRACE_UNKNOWN &&
+        unit - GL_TEXTURE0 < GL_TRACE_TEXTURE_UNITS)
+        slot = &gl_trace_shadow.textures[unit - GL_TEXTURE0];
+    gl_trace__set(GL_TRACE_BIND_TEXTURE, slot, texture, file, line);
+    glBindTexture(target, texture);
+}
+
+void
+gl_trace_bind_framebuffer(GLenum target, GLuint framebuffer, const char *file, int line)
+{
+    GLint64 *slot = NULL;
+
+    if (!gl_trace_shadow.valid)
+        gl_trace__forget();
+    if (target == GL_DRAW_FRAMEBUFFER)
+        slot = &gl_trace_shadow.draw_framebuffer;
+    else if (target == GL_READ_FRAMEBUFFER)
+        slot = &gl_trace_shadow.read_framebuffer;
+    else if (gl_trace_shadow.draw_framebuffer == gl_trace_shadow.read_framebuffer)
+        slot = &gl_trace_shadow.draw_framebuffer;
+    gl_trace__set(GL_TRACE_BIND_FRAMEBUFFER, slot, framebuffer, file, line);
+    if (target == GL_FRAMEBUFFER)
+        gl_trace_shadow.draw_framebuffer = gl_trace_shadow.read_framebuffer = framebuffer;
+    glBindFramebuffer(target, framebuffer);
+}
+
+void
+gl_trace_enable(GLenum cap, const char *file, int line)
+{
+    gl_trace__cap(GL_TRACE_ENABLE, cap, 1, file, line);
+    glEnable(cap);
+}
+
+void
+gl_trace_disable(GLenum cap, const char *file, int line)
+{
+    gl_trace__cap(GL_TRACE_DISABLE, cap, 0, file, line);
+    glDisable(cap);
+}
+
+/* Counts a call that sets n values at once, redundant only if all match */
+static void
+gl_trace__set_n(enum gl_trace_call call, GLint64 *shadow, const GLint64 *values, int n,
+                const char *file, int line)
+{
+    if (!gl_trace_shadow.valid)
+        gl_trace__forget();
+    if (memcmp(shadow, values, n * sizeof(*values)) == 0) {
+        gl_trace__set(call, shadow, shadow[0], file, line);
+    } else {
+        gl_trace__set(call, NULL, 0, file, line);
+        memcpy(shadow, values, n * sizeof(*values));
+    }
+}
+
+void
+gl_trace_blend_func(GLenum sfactor, GLenum dfactor, const char *file, int line)
+{
+    GLint64 values[4];
+    values[0] = values[2] = sfactor;
+    values[1] = values[3] = dfactor;
+    gl_trace__set_n(GL_TRACE_BLEND_FUNC, gl_trace_shadow.blend, values, 4, file, line);
+    glBlendFunc(sfactor, dfactor);
+}
+
+void
+gl_trace_blend_func_separate(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha,
+                             const char *file, int line)
+{
+    GLint64 values[4];
+    values[0] = src_rgb;
+    values[1] = dst_rgb;
+    values[2] = src_alpha;
+    values[3] = dst_alpha;
+    gl_trace__set_n(GL_TRACE_BLEND_FUNC, gl_trace_shadow.blend, values, 4, file, line);
+    glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+}
+
+void
+gl_trace_blend_equation(GLenum mode, const char *file, int line)
+{
+    gl_trace__set(GL_TRACE_BLEND_EQUATION, &gl_trace_shadow.blend_equation, mode, file, line);
+    glBlendEquation(mode);
+}
+
+void
+gl_trace_viewport(GLint x, GLint y, GLsizei width, GLsizei height, const char *file, int line)
+{
+    GLint64 values[4];
+    values[0] = x;
+    values[1] = y;
+    values[2] = width;
+    values[3] = height;
+    gl_trace__set_n(GL_TRACE_VIEWPORT, gl_trace_shadow.viewport, values, 4, file, line);
+    glViewport(x, y, width, height);
+}
+
+void
+gl_trace_scissor(GLint x, GLint y, GLsizei width, GLsizei height, const char *file, int line)
+{
+    GLint64 values[4];
+    values[0] = x;
+    values[1] = y;
+    values[2] = width;
+    values[3] = height;
+    gl_trace__set_n(GL_TRACE_SCISSOR, gl_trace_shadow.scissor, values, 4, file, line);
+    glScissor(x, y, width, height);
+}
+
+void
+gl_trace_clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a, const char *file, int line)
+{
+    GLfloat values[4];
+    values[0] = r;
+    values[1] = g;
+    values[2] = b;
+    values[3] = a;
+    if (!gl_trace_shadow.valid)
+        gl_trace__forget();
+    if (gl_trace_shadow.clear_color_known &&
+        memcmp(gl_trace_shadow.clear_color, values, sizeof(values)) == 0) {
+        GLint64 same = 0;
+        gl_trace__set(GL_TRACE_CLEAR_COLOR, &same, 0, file, line);
+    } else {
+        gl_trace__set(GL_TRACE_CLEAR_COLOR, NULL, 0, file, line);
+        memcpy(gl_trace_shadow.clear_color, values, sizeof(values));
+        gl_trace_shadow.clear_color_known = 1;
+    }
+    glClearColor(r, g, b, a);
+}
+
+void
+gl_trace_uniform1i(GLint location, GLint v0)
+{
+    gl_trace__count(GL_TRACE_UNIFORM);
+    glUniform1i(location, v0);
+}
+
+void
+gl_trace_uniform_matrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    gl_trace__count(GL_TRACE_UNIFORM);
+    glUniformMatrix4fv(location, count, transpose, value);
+}
+
+void
+gl_trace_buffer_data(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+    gl_trace__count(GL_TRACE_BUFFER_DATA);
+    glBufferData(target, size, data, usage);
+}
+
+void
+gl_trace_buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+    gl_trace__count(GL_TRACE_BUFFER_DATA);
+    glBufferSubData(target, offset, size, data);
+}
+
+void *
+gl_trace_map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    gl_trace__count(GL_TRACE_MAP_BUFFER);
+    return glMapBufferRange(target, offset, length, access);
+}
+
+GLboolean
+gl_trace_unmap_buffer(GLenum target)
+{
+    gl_trace__count(GL_TRACE_MAP_BUFFER);
+    return glUnmapBuffer(target);
+}
+
+void
+gl_trace_clear(GLbitfield mask)
+{
+    gl_trace__count(GL_TRACE_CLEAR);
+    glClear(mask);
+}
+
+void
+gl_trace_clear_bufferfv(GLenum buffer, GLint drawbuffer, const GLfloat *value)
+{
+    gl_trace__count(GL_TRACE_CLEAR);
+    glClearBufferfv(buffer, drawbuffer, value);
+}
+
+void
+gl_trace_draw_arrays(GLenum mode, GLint first, GLsizei count)
+{
+    gl_trace__count(GL_TRACE_DRAW);
+    glDrawArrays(mode, first, count);
+}
+
+void
+gl_trace_draw_elements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+    gl_trace__count(GL_TRACE_DRAW);
+    glDrawElements(mode, count, type, indices);
+}
+
+void
+gl_trace_draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type,
+                                   const void *indices, GLint basevertex)
+{
+    gl_trace__count(GL_TRACE_DRAW);
+    glDrawElementsBaseVertex(mode, count, type, (void *)indices, basevertex);
+}
+
+/* deleting a bound object unbinds it, so the shadow can no longer be trusted */
+void
+gl_trace_delete_buffers(GLsizei n, const GLuint *buffers)
+{
+    gl_trace_shadow.valid = 0;
+    glDeleteBuffers(n, buffers);
+}
+
+void
+gl_trace_delete_vertex_arrays(GLsizei n, const GLuint *arrays)
+{
+    gl_trace_shadow.valid = 0;
+    glDeleteVertexArrays(n, arrays);
+}
+
+void
+gl_trace_delete_textures(GLsizei n, const GLuint *textures)
+{
+    gl_trace_shadow.valid = 0;
+    glDeleteTextures(n, textures);
+}
+
+void
+gl_trace_delete_framebuffers(GLsizei n, const GLuint *framebuffers)
+{
+    gl_trace_shadow.valid = 0;
+    glDeleteFramebuffers(n, framebuffers);
+}
+
+void
+gl_trace_delete_program(GLuint program)
+{
+    gl_trace_shadow.valid = 0;
+    glDeleteProgram(program);
+}
+
+#endif
+
+/* from here on the traced entry points go through the wrappers */
+#if GL_TRACE && !defined(GL_TRACE_REDIRECTED)
+#define GL_TRACE_REDIRECTED
+
+#undef glUseProgram
+#undef glBindVertexArray
+#undef glBindBuffer
+#undef glBindBufferBase
+#undef glActiveTexture
+#undef glBindTexture
+#undef glBindFramebuffer
+#undef glEnable
+#undef glDisable
+#undef glBlendFunc
+#undef glBlendFuncSeparate
+#undef glBlendEquation
+#undef glViewport
+#undef glScissor
+#undef glClearColor
+#undef glUniform1i
+#undef glUniformMatrix4fv
+#undef glBufferData
+#undef glBufferSubData
+#undef glMapBufferRange
+#undef glUnmapBuffer
+#undef glClear
+#undef glClearBufferfv
+#undef glDrawArrays
+#undef glDrawElements
+#undef glDrawElementsBaseVertex
+#undef glDeleteBuffers
+#undef glDeleteVertexArrays
+#undef glDeleteTextures
+#undef glDeleteFramebuffers
+#undef glDeleteProgram
+
+#define glUseProgram(p) gl_trace_use_program(p, __FILE__, __LINE__)
+#define glBindVertexArray(a) gl_trace_bind_vertex_array(a, __FILE__, __LINE__)
+#define glBindBuffer(t, b) gl_trace_bind_buffer(t, b, __FILE__, __LINE__)
+#define glBindBufferBase(t, i, b) gl_trace_bind_buffer_base(t, i, b, __FILE__, __LINE__)
+#define glActiveTexture(u) gl_trace_active_texture(u, __FILE__, __LINE__)
+#define glBindTexture(t, x) gl_trace_bind_texture(t, x, __FILE__, __LINE__)
+#define glBindFramebuffer(t, f) gl_trace_bind_framebuffer(t, f, __FILE__, __LINE__)
+#define glEnable(c) gl_trace_enable(c, __FILE__, __LINE__)
+#define glDisable(c) gl_trace_disable(c, __FILE__, __LINE__)
+#define glBlendFunc(s, d) gl_trace_blend_func(s, d, __FILE__, __LINE__)
+#define glBlendFuncSeparate(sr, dr, sa, da) gl_trace_blend_func_separate(sr, dr, sa, da, __FILE__, __LINE__)
+#define glBlendEquation(m) gl_trace_blend_equation(m, __FILE__, __LINE__)
+#define glViewport(x, y, w, h) gl_trace_viewport(x, y, w, h, __FILE__, __LINE__)
+#define glScissor(x, y, w, h) gl_trace_scissor(x, y, w, h, __FILE__, __LINE__)
+#define glClearColor(r, g, b, a) gl_trace_clear_color(r, g, b, a, __FILE__, __LINE__)
+#define glUniform1i gl_trace_uniform1i
+#define glUniformMatrix4fv gl_trace_uniform_matrix4fv
+#define glBufferData gl_trace_buffer_data
+#define glBufferSubData gl_trace_buffer_sub_data
+#define glMapBufferRange gl_trace_map_buffer_range
+#define glUnmapBuffer gl_trace_unmap_buffer
+#define glClear gl_trace_clear
+#define glClearBufferfv gl_trace_clear_bufferfv
+#define glDrawArrays gl_trace_draw_arrays
+#define glDrawElements gl_trace_draw_elements
+#define glDrawElementsBaseVertex gl_trace_draw_elements_base_vertex
+#define glDeleteBuffers gl_trace_delete_buffers
+#define glDeleteVertexArrays gl_trace_delete_vertex_arrays
+#define glDeleteTextures gl_trace_delete_textures
+#define glDeleteFramebuffers gl_trace_delete_framebuffers
+#define glDeleteProgram gl_trace_delete_program
+
+#endif
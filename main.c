@@ -1,18 +1,60 @@
 /* Adapted from https://github.com/Immediate-Mode-UI/Nuklear/tree/master/demo/sdl_opengles2 */
 
 #define GL_SILENCE_DEPRECATION
+/* glibc hides mmap and friends from strict C99 unless asked, see --batch */
+#if defined(__linux__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
 #define DEBUG 0
 #include "HandmadeMath.h"
+#define HANDMADE_MATH_SIMD_IMPLEMENTATION
+#include "HandmadeMathSIMD.h"
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_mouse.h>
+/* --headless renders through a surfaceless EGL context, Mesa's on Linux */
+#ifndef HEADLESS_EGL
+#if defined(__linux__)
+#define HEADLESS_EGL 1
+#else
+#define HEADLESS_EGL 0
+#endif
+#endif
+#if HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#define PROFILE_IMPLEMENTATION
+#include "profile.h"
+#define SOFT_RASTER_IMPLEMENTATION
+#include "soft_raster.h"
+#include <assert.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+/* --batch maps input files where it can and reads everything else */
+#if defined(__unix__) || defined(__APPLE__)
+#define BATCH_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define BATCH_MMAP 0
+#endif
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#define GL_TRACE_IMPLEMENTATION
+#include "gl_trace.h"
 #define NK_INCLUDE_FIXED_TYPES
 #define NK_INCLUDE_STANDARD_IO
 #define NK_INCLUDE_STANDARD_VARARGS
@@ -20,23 +62,69 @@
 #define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
 #define NK_INCLUDE_FONT_BAKING
 #define NK_INCLUDE_DEFAULT_FONT
+#define NK_ZERO_COMMAND_MEMORY
 #define NK_IMPLEMENTATION
 #define NK_SDL_GL3_IMPLEMENTATION
+#define GL_STREAM_IMPLEMENTATION
 
 #include "nuklear.h"
+#include "gl_stream.h"
 #include "nuklear_sdl_gl3.h"
 
-/* near */
-static hmm_vec4 CSCOORD_LBN, CSCOORD_LTN, CSCOORD_RTN, CSCOORD_RBN,
-    CSCOORD_LBF, CSCOORD_LTF, CSCOORD_RTF, CSCOORD_RBF;
-
 #define WINDOW_WIDTH 1920
 #define WINDOW_HEIGHT 1080
 
-#define MAX_VERTEX_MEMORY 512 * 1024
-#define MAX_ELEMENT_MEMORY 128 * 1024
-
-#define MOVESPEED 0.1f
+/* starting sizes, nk_sdl_render grows them as the UI needs */
+#define UI_VERTEX_MEMORY (64 * 1024)
+#define UI_ELEMENT_MEMORY (16 * 1024)
+
+/* eye units per second while a WASD key is held */
+#define MOVESPEED 3.0f
+/* longest step movement takes, e.g. after waiting for events */
+#define MAX_FRAME_DT 0.05f
+/* WASD as update_movement sees them, and as --record logs them */
+#define MOVE_FORWARD 1
+#define MOVE_BACK 2
+#define MOVE_RIGHT 4
+#define MOVE_LEFT 8
+
+#define IDLE_SETTLE_FRAMES 2
+#define IDLE_TIMEOUT_MS 1000
+
+#define PROFILE_TRACE_PATH "mvp_trace.json"
+
+#define HEADLESS_FRAMES 600
+
+/* "MVPR", and the --record log layout */
+#define REPLAY_MAGIC 0x5250564du
+#define REPLAY_VERSION 1
+
+/* frames kept for the Performance window's min/avg/p99 */
+#define PERF_HISTORY 1024
+#define PERF_GRAPH_POINTS 120
+/* how often the window's numbers change, so showing it stays cheap */
+#define PERF_REFRESH_MS 250
+
+/* frames a GPU timestamp gets to become available before its slot is reused */
+#define GPU_TIMER_FRAMES 4
+/* set to 1 to time each GPU pass by finishing it, see struct gpu_timers */
+#define GPU_FINISH_ENV "MVP_GPU_FINISH"
+
+#define BENCH_BATCH 4096
+#define BENCH_REPS 2000
+/* cubes per side of the square field the rasterizer benchmark draws */
+#define BENCH_RASTER_CUBES 32
+#define BENCH_RASTER_FRAMES 20
+/* --batch: records per SIMD batch and input bytes per worker per round */
+#define BATCH_RECORDS 256
+#define BATCH_PIECE_BYTES (1 << 20)
+#define BATCH_LINE_MAX 1024
+/* floats per input record, per output record and for the optional corners */
+#define BATCH_IN_FLOATS 22
+#define BATCH_OUT_FLOATS 64
+#define BATCH_CORNER_FLOATS 24
+/* longest CSV cell batch_format_float writes, separator included */
+#define BATCH_CSV_CELL 24
 
 #define UNUSED(a) (void)a
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -94,18 +182,21 @@ struct ogl_init
     size_t index_len;
 };
 
+/* locations are looked up once in init_shader, -1 where the program has none */
 struct ogl
 {
     struct ogl_init *init_data;
     unsigned int program;
-    unsigned int matrixID;
+    GLint matrixID;
     unsigned int VAO;
     unsigned int VBO;
     unsigned int IBO;
     unsigned int colorID;
-    unsigned int mvpLoc;
-    unsigned int vertexLoc;
-    unsigned int colorLoc;
+    GLint mvpLoc;
+    GLint modelLoc;
+    GLuint cameraBlock;
+    GLint vertexLoc;
+    GLint colorLoc;
 };
 
 static struct scene_objects
@@ -144,6 +235,209 @@ struct cam_perspective
     float far;
 };
 
+/*
+ * Everything the draw functions need from one camera, brought up to date
+ * once per frame by update_frame_transforms(). ornt and prsp are copies of
+ * the inputs the matrices were last built from.
+ */
+struct camera
+{
+    struct cam_orientation ornt;
+    struct cam_perspective prsp;
+    hmm_mat4 view;
+    hmm_mat4 projection;
+    hmm_mat4 viewproj;
+    hmm_mat4 inv_view;
+    hmm_mat4 inv_projection;
+    hmm_mat4 inv_viewproj;
+    unsigned int version;
+    unsigned int derived_version;
+};
+
+/*
+ * The text of a 4x4 matrix as shown in the Matrices panel, one "%0.2f"
+ * cell per element in row-major display order. Cells remember the value
+ * they were formatted from, rounded to hundredths, and are only formatted
+ * again when that changes. Small enough to keep one per displayed object.
+ */
+struct matrix_display
+{
+    long long shown[16];    /* value * 100 rounded, sign folded into bit 0 */
+    char text[16][24];
+    unsigned char len[16];
+    bool valid;
+};
+
+/* main loop phases timed on the CPU, see cpu_pass_begin */
+enum cpu_pass {
+    CPU_PASS_EVENTS,
+    CPU_PASS_UI,
+    CPU_PASS_TRANSFORMS,
+    CPU_PASS_SCENE,
+    CPU_PASS_UI_RENDER,
+    CPU_PASS_SWAP,
+    CPU_PASS_HUD,
+    CPU_PASS_COUNT
+};
+
+/* draw passes timed on the GPU, see gpu_timers */
+enum gpu_pass {
+    GPU_PASS_GRID,
+    GPU_PASS_CUBE,
+    GPU_PASS_FRUSTUM,
+    GPU_PASS_CAM,
+    GPU_PASS_UI,
+    GPU_PASS_COUNT
+};
+
+/* One frame as recorded for the Performance window */
+struct perf_sample
+{
+    float frame_ms;                 /* MainLoop, not counting the idle wait */
+    float cpu_ms[CPU_PASS_COUNT];
+    float gpu_ms[GPU_PASS_COUNT];   /* latest results, a few frames behind */
+    unsigned long draws, ui_draws;
+    unsigned long state_changes;
+    unsigned long uniform_uploads;
+    unsigned long upload_bytes, ui_upload_bytes;
+    unsigned long ui_memory;        /* Nuklear command memory in use */
+    unsigned long traced_calls, redundant_calls;    /* with GL_TRACE */
+};
+
+/*
+ * The matrices and frustum of one frame for the software renderer. It only
+ * reads from this and from constant data, so frames of different scenes can
+ * be drawn on different threads at once.
+ */
+struct soft_scene
+{
+    hmm_mat4 grid_mvp, cube_mvp, frustum_mvp, cam_mvp;
+    bool cube_blend;
+    bool show_frustum;              /* and the camera gizmo */
+    GLfloat frustum_verts[8 * 7];
+};
+
+/*
+ * One --batch worker thread. Each round it converts the records in
+ * [begin, end) into out[slot] and the main thread writes that buffer out
+ * while the next round goes to out[slot ^ 1]. in holds a batch of input
+ * records one field per row, ready to be handed to the SoA kernels.
+ */
+struct batch_worker
+{
+    SDL_Thread *thread;
+    SDL_sem *start;
+    const char *begin, *end;
+    long long offset;               /* of begin in the input */
+    long long bad_at;               /* offset of the first malformed record, or -1 */
+    bool failed;                    /* ran out of memory */
+    long long records;              /* converted this round */
+    int slot;
+    char *out[2];
+    size_t out_len[2], out_cap[2];
+    float in[BATCH_IN_FLOATS][BATCH_RECORDS];
+    hmm_mat4_soa model, view, projection, viewproj, mvp, inv_view, inv_viewproj;
+    float *corners;
+};
+
+/* The parameters a --sweep image differs in, everything else is the UI's default */
+struct sweep_frame
+{
+    struct orientation cube;
+    struct cam_perspective prsp;
+};
+
+/* One parameter --sweep varies and the values it takes */
+struct sweep_axis
+{
+    int param;                      /* into sweep_params */
+    int count;
+    float *values;
+};
+
+/* One --sweep thread, with a rasterizer of its own that runs on it alone */
+struct sweep_worker
+{
+    SDL_Thread *thread;
+    struct soft_raster *raster;
+    unsigned char *rgb;
+};
+
+/*
+ * Where --batch gets its records. A mapped file is handed out in place,
+ * anything else is read into buf[slot], and whatever follows the last
+ * whole record is carried over to the start of the next round.
+ */
+struct batch_input
+{
+    FILE *file;
+    const char *map;
+    size_t map_len, pos;
+    char *buf[2];
+    size_t cap;
+    const char *carry;
+    size_t carry_len;
+    long long offset;               /* of the next round in the input */
+    bool eof;
+};
+
+/*
+ * A --record log is a replay_header, then for every frame drawn a
+ * replay_frame, its events, each followed by the text of a text event, and
+ * a replay_controls when the controls differ from the previous frame's.
+ * Fields are in native byte order, like --batch's binary records.
+ */
+struct replay_header
+{
+    Uint32 magic;
+    Uint32 version;
+    Sint32 width, height;           /* of the window when recording started */
+};
+
+struct replay_frame
+{
+    Uint32 ms;                      /* frame start, since recording started */
+    float dt;                       /* movement.dt */
+    Uint32 events;
+    Uint8 keys;                     /* MOVE_* held */
+    Uint8 has_controls;
+    Uint16 reserved;
+};
+
+enum replay_event_kind {
+    REPLAY_QUIT,
+    REPLAY_KEY_DOWN,
+    REPLAY_KEY_UP,
+    REPLAY_BUTTON_DOWN,
+    REPLAY_BUTTON_UP,
+    REPLAY_MOTION,
+    REPLAY_WHEEL,
+    REPLAY_TEXT
+};
+
+/* The fields of the SDL events MainLoop and the Nuklear backend look at */
+struct replay_event
+{
+    Uint8 kind;
+    Uint8 code;                     /* mouse button, or key repeat */
+    Uint8 state;                    /* clicks, motion buttons, wheel direction */
+    Uint8 text_len;
+    Sint16 x, y, xrel, yrel;        /* the wheel's x and y are its amounts */
+    Sint32 sym;
+    Uint16 scancode, mod;
+};
+
+/* Every value the Controls window and mouse look can change */
+struct replay_controls
+{
+    struct orientation cube;
+    struct cam_orientation proj_ornt, obj_ornt;
+    struct cam_perspective proj_prsp;
+    float yaw, pitch;
+    Sint32 selected_cam, show_cam;
+    Sint32 live_counters, cached_ui, render_on_demand, show_perf;
+};
+
 /* ===============================================================
  *
  *                          Function declarations
@@ -161,17 +455,56 @@ static bool init_indices(struct ogl *draw_data, struct ogl_init *init_data);
 static bool init_grid(struct ogl *draw_data, struct ogl_init *init_data);
 static bool init_cube(struct ogl *draw_data, struct ogl_init *init_data);
 static void update_frustum_buffer();
+static void init_camera_ubo();
+static void upload_camera(const struct camera *cam);
 static hmm_mat4 perspective(float FOV, float AspectRatio, float Near, float Far);
-static hmm_mat4 calc_cube_mvp(struct cam_orientation *ornt, struct cam_perspective *prsp);
-static hmm_mat4 calc_grid_mvp(struct cam_orientation *ornt, struct cam_perspective *prsp);
+static hmm_mat4 calc_cube_model(struct orientation *transform);
+static hmm_mat4 calc_cam_model(hmm_vec3 eye);
+static void update_camera(struct camera *cam, int first_slot,
+                          struct cam_orientation *ornt, struct cam_perspective *prsp);
+static void update_frame_transforms();
+static hmm_mat4 calc_cube_mvp(const struct camera *cam);
+static hmm_mat4 calc_grid_mvp(const struct camera *cam);
 static hmm_mat4 calc_frustum_mvp();
-static void set_frustum_verts();
+static bool set_frustum_verts();
 static void reset_cube_transform();
 static void reset_proj_cam();
 static void draw_triangle_indices(struct ogl *obj, hmm_mat4 mvp);
-static void draw_cube(struct ogl *obj, struct cam_orientation *ornt, struct cam_perspective *prsp);
+static void draw_cam(struct ogl *obj);
+static void draw_cube(struct ogl *obj);
 static void draw_frustum(struct ogl *obj);
-static void draw_grid(struct ogl *obj, struct cam_orientation *ornt, struct cam_perspective *prsp);
+static void draw_grid(struct ogl *obj);
+static int matrix_display_update(struct matrix_display *display, const hmm_mat4 *m);
+static void matrix_display_draw(struct nk_context *ctx, const char *title,
+                                const struct matrix_display *display);
+static unsigned long xform_rebuilt_total();
+static int idle_wait(SDL_Event *evt);
+static void export_profile();
+static void init_gpu_timers();
+static void gpu_timers_begin_frame();
+static void gpu_timer_begin(enum gpu_pass pass);
+static void gpu_timer_end(enum gpu_pass pass);
+static void cpu_pass_begin(enum cpu_pass pass);
+static void cpu_pass_end(enum cpu_pass pass);
+static void perf_end_frame();
+static void perf_hud_draw(struct nk_context *ctx);
+static bool update_movement();
+static void init_scene();
+static struct nk_context *init_renderer(SDL_Window *window);
+static void print_render_stats();
+static int run_headless(int argc, char *argv[]);
+static void soft_scene_current(struct soft_scene *scene);
+static void soft_draw_scene(struct soft_raster *raster, const struct soft_scene *scene);
+static int run_soft(int argc, char *argv[]);
+static int run_batch(int argc, char *argv[]);
+static int run_sweep(int argc, char *argv[]);
+static bool replay_load(const char *path);
+static bool replay_record(const char *path, int width, int height);
+static bool replay_begin_frame();
+static int replay_read_event(SDL_Event *evt);
+static void replay_record_event(const SDL_Event *evt);
+static void replay_sync_controls();
+static void replay_finish();
 static void MainLoop(void *loopArg);
 
 /* ===============================================================
@@ -187,13 +520,21 @@ static const char grid_frag_shader[] =
     "	color = vec3(1.0,0.0,0.0);\n"
     "}\n";
 
+/* per-frame camera matrices, shared by every program through one UBO */
+#define CAMERA_BINDING 0
+#define CAMERA_BLOCK \
+        "layout (std140) uniform Camera {\n" \
+        "    mat4 view;\n" \
+        "    mat4 projection;\n" \
+        "    mat4 viewproj;\n" \
+        "};\n"
+
 static const char vp_vert_shader[] =
         "#version 330 core\n"
         "layout (location = 0) in vec3 aPos;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 projection;\n"
+        CAMERA_BLOCK
         "void main() {\n"
-        "    gl_Position = projection * view * vec4(aPos, 1.0);\n"
+        "    gl_Position = viewproj * vec4(aPos, 1.0);\n"
         "}\n";
 
 static const char color_mvp_vert_shader[] =
@@ -202,10 +543,9 @@ static const char color_mvp_vert_shader[] =
         "layout (location = 1) in vec4 aColor;\n"
         "out vec4 vertexColor;\n"
         "uniform mat4 model;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 projection;\n"
+        CAMERA_BLOCK
         "void main() {\n"
-        "    gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+        "    gl_Position = viewproj * model * vec4(aPos, 1.0);\n"
         "    vertexColor = aColor;\n"
         "}\n";
 
@@ -214,10 +554,9 @@ static const char mvp_vert_shader[] =
         "#version 330 core\n"
         "layout (location = 0) in vec3 aPos;\n"
         "uniform mat4 model;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 projection;\n"
+        CAMERA_BLOCK
         "void main() {\n"
-        "    gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+        "    gl_Position = viewproj * model * vec4(aPos, 1.0);\n"
         "}\n";
 
 
@@ -226,10 +565,9 @@ static const char color_vp_vert_shader[] =
     "layout (location = 0) in vec3 aPos;\n"
     "layout (location = 1) in vec4 aColor;\n"
     "out vec4 vertexColor;\n"
-    "uniform mat4 view;\n"
-    "uniform mat4 projection;\n"
+    CAMERA_BLOCK
     "void main() {\n"
-    "    gl_Position = projection * view * vec4(aPos, 1.0);\n"
+    "    gl_Position = viewproj * vec4(aPos, 1.0);\n"
     "    vertexColor = aColor;\n"
     "}\n";
 
@@ -241,6 +579,10 @@ static const char color_in_shader[] =
     "    FragColor = vertexColor;\n"
     "}\n";
 
+/* what grid_frag_shader and cam_frag_shader write, for the CPU renderer */
+static const float grid_color[4] = {1.0f, 0.0f, 0.0f, 1.0f};
+static const float cam_color[4] = {0.5f, 0.5f, 0.5f, 1.0f};
+
 static const char cam_frag_shader[] =
     "#version 410\n"
     "in vec4 v_color;"
@@ -467,9 +809,11 @@ static struct cam_perspective obj_cam_prsp = {
     0.1f,
     100.0f};
 
-static hmm_mat4 cube_model, cube_rotate_x, cube_rotate_y, cube_rotate_z,
-    cube_scale, cube_translate, cube_view, cube_projection;
-static hmm_vec3 cube_center;
+static struct matrix_display model_display, view_display, projection_display;
+static unsigned long matrix_cells_formatted, matrix_cells_kept;
+
+/* the eye the user looks through and the camera being visualized */
+static struct camera obj_cam, proj_cam;
 
 static hmm_mat4 cam_rotation, cam_scale;
 static hmm_vec3 cam_offset;
@@ -479,10 +823,301 @@ static float pitch = 0;
 
 static int fix_eye_cam_pos = nk_false;
 static int show_cam = nk_true;
+/* off by default: live numbers change the UI every frame, so it can never be reused */
+static int live_counters = nk_false;
+/* draw the UI into a texture and only redraw that when the UI changes */
+static int cached_ui = nk_false;
+static int render_on_demand = nk_true;
+static int show_perf = nk_false;
+static int draw_ui = nk_true;
+
+/* --soft and the rasterizer benchmark draw the scene with this instead of GL */
+static struct soft_raster *cpu_raster;
+
+/* --headless draws into fbo instead of the window and finishes every frame */
+static struct headless
+{
+    bool enabled;
+    int width, height;
+    GLuint fbo, color;
+} headless;
+
+enum replay_mode { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+
+/*
+ * --record writes a frame to file once its controls are known, --replay
+ * plays the whole log from memory so that reading it costs no I/O.
+ */
+static struct replay
+{
+    enum replay_mode mode;
+    bool fast;                      /* --fast: don't wait for the recorded times */
+    const char *path;
+    FILE *file;
+    unsigned char *data;            /* recording: this frame's events; playing: the log */
+    size_t size, capacity, pos;
+    struct replay_frame frame;      /* being recorded or played */
+    Uint32 events_left;
+    struct replay_controls controls;    /* as last recorded or played */
+    int width, height;
+    int frames, played;
+    Uint32 recorded_ms;             /* start of the last frame */
+    unsigned long diverged;         /* played frames whose UI left other values */
+    Uint32 start_ticks;
+    Uint64 start_counter;
+} replay;
+
+/* --batch settings, shared with its worker threads */
+static struct batch
+{
+    bool csv_in, csv_out, corners;
+    int threads;
+    struct batch_worker *workers;
+    SDL_sem *done;
+    bool quit;
+} batch;
+
+/* what --sweep can vary, in the units of the UI's controls */
+static const struct sweep_param
+{
+    const char *name;
+    size_t offset;                  /* of the float in struct sweep_frame */
+} sweep_params[] = {
+    {"tx", offsetof(struct sweep_frame, cube.tx)},
+    {"ty", offsetof(struct sweep_frame, cube.ty)},
+    {"tz", offsetof(struct sweep_frame, cube.tz)},
+    {"sx", offsetof(struct sweep_frame, cube.sx)},
+    {"sy", offsetof(struct sweep_frame, cube.sy)},
+    {"sz", offsetof(struct sweep_frame, cube.sz)},
+    {"rx", offsetof(struct sweep_frame, cube.rx)},
+    {"ry", offsetof(struct sweep_frame, cube.ry)},
+    {"rz", offsetof(struct sweep_frame, cube.rz)},
+    {"fov", offsetof(struct sweep_frame, prsp.fov)},
+    {"aspect", offsetof(struct sweep_frame, prsp.aspect_ratio)},
+    {"near", offsetof(struct sweep_frame, prsp.near)},
+    {"far", offsetof(struct sweep_frame, prsp.far)},
+};
+
+/*
+ * --sweep settings. Image i takes the value of the first axis at
+ * i / (product of the other counts), so the last axis varies fastest.
+ * Workers claim images by incrementing next.
+ */
+static struct sweep
+{
+    struct sweep_axis axes[LEN(sweep_params)];
+    int axis_count;
+    int images;
+    int width, height;
+    bool through;
+    const char *dump_prefix;
+    SDL_atomic_t next;
+    SDL_atomic_t failed;
+} sweep;
+
+/* WASD movement, sampled from the keyboard state once per frame */
+static struct movement
+{
+    Uint64 last_counter;        /* performance counter at the previous frame, 0 after a wait */
+    float dt;                   /* seconds since then, at most MAX_FRAME_DT */
+    Uint32 pressed_at;          /* SDL timestamp of the last fresh WASD press */
+    bool pending;               /* that press has not shown up on screen yet */
+    Uint32 latency_ms;          /* press to presented motion, last measured */
+} movement;
+
+/*
+ * Render on demand: once IDLE_SETTLE_FRAMES frames in a row had no input
+ * and changed neither the UI nor any transform, MainLoop blocks in
+ * SDL_WaitEventTimeout instead of drawing. Any event brings it back,
+ * window expose and resize events included.
+ */
+static struct idle_state
+{
+    int frames;                 /* consecutive frames that changed nothing */
+    unsigned long waits;
+    unsigned long timeouts;
+    double wait_seconds;        /* wall time blocked waiting for events */
+    double wait_cpu_seconds;    /* process CPU time used meanwhile */
+    Uint64 run_start;
+    clock_t run_cpu_start;
+} idle;
 
 
 static enum cam selected_cam = OBJECTIVE_CAM;
 
+/*
+ * Every derived matrix remembers the inputs it was built from and is only
+ * rebuilt when they differ, which the counters below keep track of. Each
+ * camera's view, projection and derived slots are consecutive.
+ */
+enum xform_slot {
+    XFORM_CUBE_MODEL,
+    XFORM_CAM_MODEL,
+    XFORM_OBJ_VIEW,
+    XFORM_OBJ_PROJECTION,
+    XFORM_OBJ_DERIVED,
+    XFORM_PROJ_VIEW,
+    XFORM_PROJ_PROJECTION,
+    XFORM_PROJ_DERIVED,
+    XFORM_FRUSTUM,
+    XFORM_COUNT
+};
+
+static const char *xform_slot_names[XFORM_COUNT] = {
+    "cube model",
+    "cam model",
+    "eye view",
+    "eye proj",
+    "eye vp/inv",
+    "scene view",
+    "scene proj",
+    "scene vp/inv",
+    "frustum",
+};
+
+static struct transform_cache
+{
+    struct orientation cube_transform;
+    hmm_vec3 cam_eye;
+    unsigned int frustum_version;
+
+    hmm_mat4 cube_model;
+    hmm_mat4 cam_model;
+
+    bool valid[XFORM_COUNT];
+    unsigned long rebuilt[XFORM_COUNT];
+    unsigned long reused[XFORM_COUNT];
+} xform;
+
+/*
+ * GL calls made through the counting helpers below, for the frame in
+ * progress, the last complete frame and since startup.
+ */
+enum gl_counter {
+    GL_COUNT_LOCATION_LOOKUPS,
+    GL_COUNT_UNIFORM_UPLOADS,
+    GL_COUNT_BUFFER_UPLOADS,
+    GL_COUNT_UPLOAD_BYTES,
+    GL_COUNT_DRAW_CALLS,
+    GL_COUNT_STATE_CHANGES,
+    GL_COUNTER_COUNT
+};
+
+static const char *gl_counter_names[GL_COUNTER_COUNT] = {
+    "GL lookups",
+    "GL uniforms",
+    "GL uploads",
+    "GL bytes",
+    "GL draws",
+    "GL state",
+};
+
+static struct gl_call_counters
+{
+    unsigned long frame[GL_COUNTER_COUNT];
+    unsigned long last_frame[GL_COUNTER_COUNT];
+    unsigned long total[GL_COUNTER_COUNT];
+} gl_calls;
+
+/*
+ * Each pass is bracketed by two GL_TIMESTAMP queries. A frame's queries are
+ * only read once the GPU reports them available, from a pool deep enough
+ * that this normally happens a frame or two later, so reading back never
+ * stalls. Results still pending when their slot comes round again are
+ * dropped instead of waited for.
+ *
+ * llvmpipe and softpipe answer timestamp queries when the commands are
+ * submitted rather than when their rasterizer threads get to them, so
+ * there the numbers are submit times only and are labelled as such.
+ * MVP_GPU_FINISH=1 times each pass by finishing the work around it
+ * instead, on any renderer. That makes the CPU wait for the GPU twice per
+ * pass and serializes the frame, so frame times stop meaning much and only
+ * the trend of the pass times is worth reading.
+ */
+static const char *gpu_pass_names[GPU_PASS_COUNT] = {
+    "GPU grid",
+    "GPU cube",
+    "GPU frustum",
+    "GPU cam",
+    "GPU UI",
+};
+
+static struct gpu_timers
+{
+    GLuint queries[GPU_TIMER_FRAMES][GPU_PASS_COUNT][2];
+    bool issued[GPU_TIMER_FRAMES][GPU_PASS_COUNT];
+    int slot;                           /* frame slot being recorded */
+
+    /* maps GL_TIMESTAMP nanoseconds onto the profiler's clock */
+    GLint64 gpu_epoch;
+    Uint64 cpu_epoch;
+
+    bool finish_passes;                 /* MVP_GPU_FINISH=1: glFinish around each pass */
+    bool submit_only;                   /* llvmpipe/softpipe queries without it */
+    Uint64 pass_start[GPU_PASS_COUNT];
+
+    double last_ms[GPU_PASS_COUNT];
+    double total_ms[GPU_PASS_COUNT];
+    unsigned long samples[GPU_PASS_COUNT];
+    unsigned long dropped;
+    struct profile_ring *track;
+} gpu_timers;
+
+static const char *cpu_pass_names[CPU_PASS_COUNT] = {
+    "events",
+    "ui",
+    "transforms",
+    "scene",
+    "nk_sdl_render",
+    "swap",
+    "perf HUD",
+};
+
+/*
+ * Every frame adds one sample to history, which costs the same whether
+ * the window is shown or not. The window itself draws from a snapshot
+ * taken every PERF_REFRESH_MS, so between refreshes its commands do not
+ * change and the UI is reused rather than converted again. The time spent
+ * laying it out is its own CPU pass and is taken out of "ui".
+ */
+static struct perf_hud
+{
+    struct perf_sample history[PERF_HISTORY];
+    unsigned long frames;           /* samples ever recorded */
+    struct perf_sample current;     /* frame in progress */
+    Uint64 frame_start;
+    Uint64 pass_start[CPU_PASS_COUNT];
+
+    Uint32 refreshed_at;
+    unsigned long refreshed_frames; /* frames at the last refresh */
+    struct perf_sample shown;       /* averaged since the previous refresh */
+    float graph[PERF_GRAPH_POINTS];
+    int graph_len;
+    float graph_max;
+    float min_ms, avg_ms, p99_ms;
+    int window;                     /* frames min/avg/p99 are taken over */
+    float sorted[PERF_HISTORY];     /* scratch for p99 */
+    double refresh_ms;              /* cost of the last snapshot */
+} perf;
+
+/* std140 mirror of CAMERA_BLOCK, mat4 columns line up with hmm_mat4 */
+struct camera_block
+{
+    hmm_mat4 view;
+    hmm_mat4 projection;
+    hmm_mat4 viewproj;
+};
+
+static struct camera_ubo
+{
+    GLuint buffer;
+    const struct camera *cam;   /* last camera uploaded */
+    unsigned int version;       /* and its version at the time */
+} camera_ubo;
+
+/* the frustum is rewritten whenever the scene camera changes */
+static struct gl_stream frustum_stream;
+
 static struct ogl_init frustum_init = {
         FRUSTUM,
         color_vp_vert_shader,
@@ -523,124 +1158,173 @@ static struct ogl_init grid_init = {
         0,
 };
 
-static hmm_vec4 corners[8];
 static GLenum error;
 
 /* ===============================================================
  *
- *                          Math Functions
+ *                          Functions
  *
  * ===============================================================*/
 
-hmm_mat4
-hmm_mat4_inv(hmm_mat4 mat, hmm_mat4 dest) {
-    float t[6];
-    float det;
-    float a = mat.Elements[0][0], b = mat.Elements[0][1], c = mat.Elements[0][2], d = mat.Elements[0][3],
-        e = mat.Elements[1][0], f = mat.Elements[1][1], g = mat.Elements[1][2], h = mat.Elements[1][3],
-        i = mat.Elements[2][0], j = mat.Elements[2][1], k = mat.Elements[2][2], l = mat.Elements[2][3],
-        m = mat.Elements[3][0], n = mat.Elements[3][1], o = mat.Elements[3][2], p = mat.Elements[3][3];
-
-    t[0] = k * p - o * l; t[1] = j * p - n * l; t[2] = j * o - n * k;
-    t[3] = i * p - m * l; t[4] = i * o - m * k; t[5] = i * n - m * j;
-
-    dest.Elements[0][0] =  f * t[0] - g * t[1] + h * t[2];
-    dest.Elements[1][0] =-(e * t[0] - g * t[3] + h * t[4]);
-    dest.Elements[2][0] =  e * t[1] - f * t[3] + h * t[5];
-    dest.Elements[3][0] =-(e * t[2] - f * t[4] + g * t[5]);
-
-    dest.Elements[0][1] =-(b * t[0] - c * t[1] + d * t[2]);
-    dest.Elements[1][1] =  a * t[0] - c * t[3] + d * t[4];
-    dest.Elements[2][1] =-(a * t[1] - b * t[3] + d * t[5]);
-    dest.Elements[3][1] =  a * t[2] - b * t[4] + c * t[5];
-
-    t[0] = g * p - o * h; t[1] = f * p - n * h; t[2] = f * o - n * g;
-    t[3] = e * p - m * h; t[4] = e * o - m * g; t[5] = e * n - m * f;
-
-    dest.Elements[0][2] =  b * t[0] - c * t[1] + d * t[2];
-    dest.Elements[1][2] =-(a * t[0] - c * t[3] + d * t[4]);
-    dest.Elements[2][2] =  a * t[1] - b * t[3] + d * t[5];
-    dest.Elements[3][2] =-(a * t[2] - b * t[4] + c * t[5]);
-
-    t[0] = g * l - k * h; t[1] = f * l - j * h; t[2] = f * k - j * g;
-    t[3] = e * l - i * h; t[4] = e * k - i * g; t[5] = e * j - i * f;
-
-    dest.Elements[0][3] =-(b * t[0] - c * t[1] + d * t[2]);
-    dest.Elements[1][3] =  a * t[0] - c * t[3] + d * t[4];
-    dest.Elements[2][3] =-(a * t[1] - b * t[3] + d * t[5]);
-    dest.Elements[3][3] =  a * t[2] - b * t[4] + c * t[5];
-
-    det = 1.0f / (a * dest.Elements[0][0] + b * dest.Elements[1][0]
-                  + c * dest.Elements[2][0] + d * dest.Elements[3][0]);
-
-    hmm_mat4 result = HMM_MultiplyMat4f(dest, det);
-    return result;
+static void
+gl_count(enum gl_counter counter)
+{
+    gl_calls.frame[counter]++;
+    gl_calls.total[counter]++;
 }
 
-/*!
- * @brief extracts view frustum corners using clip-space coordinates
- *
- * corners' space:
- *  1- if m = invViewProj: World Space
- *  2- if m = invMVP:      Object Space
- *
- * You probably want to extract corners in world space so use invViewProj
- * Computing invViewProj:
- *   glm_mat4_mul(proj, view, viewProj);
- *   ...
- *   glm_mat4_inv(viewProj, invViewProj);
- *
- * if you have a near coord at i index, you can get it's far coord by i + 4
- *
- * Find center coordinates:
- *   for (j = 0; j < 4; j++) {
- *     glm_vec3_center(corners[i], corners[i + 4], centerCorners[i]);
- *   }
- *
- * @param[in]  invMat matrix (see brief)
- * @param[out] dest   exracted view frustum corners (see brief)
+static void
+gl_count_end_frame()
+{
+    memcpy(gl_calls.last_frame, gl_calls.frame, sizeof(gl_calls.frame));
+    memset(gl_calls.frame, 0, sizeof(gl_calls.frame));
+    gl_trace_end_frame();
+}
+
+void
+init_gpu_timers()
+{
+    const char *renderer;
+    const char *finish = getenv(GPU_FINISH_ENV);
+
+    glGenQueries(GPU_TIMER_FRAMES * GPU_PASS_COUNT * 2, &gpu_timers.queries[0][0][0]);
+    glGetInteger64v(GL_TIMESTAMP, &gpu_timers.gpu_epoch);
+    gpu_timers.cpu_epoch = SDL_GetPerformanceCounter();
+    gpu_timers.track = profile_track("GPU");
+
+    renderer = (const char *)glGetString(GL_RENDERER);
+    gpu_timers.finish_passes = finish && strcmp(finish, "0") != 0;
+    gpu_timers.submit_only = !gpu_timers.finish_passes && renderer &&
+        (strstr(renderer, "llvmpipe") || strstr(renderer, "softpipe"));
+}
+
+static Uint64
+gpu_to_cpu_ticks(GLuint64 gpu_ns)
+{
+    double ns = (double)(GLint64)(gpu_ns - (GLuint64)gpu_timers.gpu_epoch);
+    return gpu_timers.cpu_epoch + (Uint64)(Sint64)(ns * (double)SDL_GetPerformanceFrequency() / 1e9);
+}
+
+static void
+gpu_timer_record(enum gpu_pass pass, Uint64 start, Uint64 end)
+{
+    double ms = (double)(Sint64)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+
+    gpu_timers.last_ms[pass] = ms;
+    gpu_timers.total_ms[pass] += ms;
+    gpu_timers.samples[pass]++;
+    profile_record(gpu_timers.track, gpu_pass_names[pass], start, end);
+}
+
+/*
+ * Reads back whatever has become available without waiting, then moves on
+ * to the oldest slot, dropping anything in it the GPU has still not done.
  */
 void
-hmm_frustum_corners(hmm_mat4 invMat, hmm_vec4 dest[8]) {
-    hmm_vec4 c[8];
-
-    /* indexOf(nearCoord) = indexOf(farCoord) + 4 */
-    hmm_vec4 csCoords[8] = {
-        CSCOORD_LBN,
-        CSCOORD_LTN,
-        CSCOORD_RTN,
-        CSCOORD_RBN,
-
-        CSCOORD_LBF,
-        CSCOORD_LTF,
-        CSCOORD_RTF,
-        CSCOORD_RBF
-    };
+gpu_timers_begin_frame()
+{
+    int slot, pass;
+
+    for (slot = 0; slot < GPU_TIMER_FRAMES; slot++) {
+        for (pass = 0; pass < GPU_PASS_COUNT; pass++) {
+            GLuint *queries = gpu_timers.queries[slot][pass];
+            GLuint available = 0;
+            GLuint64 start, end;
+
+            if (!gpu_timers.issued[slot][pass])
+                continue;
+            glGetQueryObjectuiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+            gpu_timers.issued[slot][pass] = false;
+            gpu_timer_record(pass, gpu_to_cpu_ticks(start), gpu_to_cpu_ticks(end));
+        }
+    }
+
+    gpu_timers.slot = (gpu_timers.slot + 1) % GPU_TIMER_FRAMES;
+    for (pass = 0; pass < GPU_PASS_COUNT; pass++) {
+        if (gpu_timers.issued[gpu_timers.slot][pass])
+            gpu_timers.dropped++;
+        gpu_timers.issued[gpu_timers.slot][pass] = false;
+    }
+}
 
-    c[0] = HMM_MultiplyMat4ByVec4(invMat,csCoords[0]);
-    c[1] = HMM_MultiplyMat4ByVec4(invMat,csCoords[1]);
-    c[2] = HMM_MultiplyMat4ByVec4(invMat,csCoords[2]);
-    c[3] = HMM_MultiplyMat4ByVec4(invMat,csCoords[3]);
-    c[4] = HMM_MultiplyMat4ByVec4(invMat,csCoords[4]);
-    c[5] = HMM_MultiplyMat4ByVec4(invMat,csCoords[5]);
-    c[6] = HMM_MultiplyMat4ByVec4(invMat,csCoords[6]);
-    c[7] = HMM_MultiplyMat4ByVec4(invMat,csCoords[7]);
-
-    dest[0] = HMM_MultiplyVec4f(c[0], 1.0f / c[0].W);
-    dest[1] = HMM_MultiplyVec4f(c[1], 1.0f / c[1].W);
-    dest[2] = HMM_MultiplyVec4f(c[2], 1.0f / c[2].W);
-    dest[3] = HMM_MultiplyVec4f(c[3], 1.0f / c[3].W);
-    dest[4] = HMM_MultiplyVec4f(c[4], 1.0f / c[4].W);
-    dest[5] = HMM_MultiplyVec4f(c[5], 1.0f / c[5].W);
-    dest[6] = HMM_MultiplyVec4f(c[6], 1.0f / c[6].W);
-    dest[7] = HMM_MultiplyVec4f(c[7], 1.0f / c[7].W);
+void
+gpu_timer_begin(enum gpu_pass pass)
+{
+    if (gpu_timers.finish_passes) {
+        glFinish();
+        gpu_timers.pass_start[pass] = SDL_GetPerformanceCounter();
+        return;
+    }
+    glQueryCounter(gpu_timers.queries[gpu_timers.slot][pass][0], GL_TIMESTAMP);
 }
 
-/* ===============================================================
- *
- *                          Functions
- *
- * ===============================================================*/
+void
+gpu_timer_end(enum gpu_pass pass)
+{
+    if (gpu_timers.finish_passes) {
+        glFinish();
+        gpu_timer_record(pass, gpu_timers.pass_start[pass], SDL_GetPerformanceCounter());
+        return;
+    }
+    glQueryCounter(gpu_timers.queries[gpu_timers.slot][pass][1], GL_TIMESTAMP);
+    gpu_timers.issued[gpu_timers.slot][pass] = true;
+}
+
+static void
+gl_count_add(enum gl_counter counter, unsigned long n)
+{
+    gl_calls.frame[counter] += n;
+    gl_calls.total[counter] += n;
+}
+
+static void
+use_program(GLuint program)
+{
+    gl_count(GL_COUNT_STATE_CHANGES);
+    glUseProgram(program);
+}
+
+static void
+bind_vertex_array(GLuint vao)
+{
+    gl_count(GL_COUNT_STATE_CHANGES);
+    glBindVertexArray(vao);
+}
+
+static void
+set_blend(bool enable)
+{
+    gl_count(GL_COUNT_STATE_CHANGES);
+    if (enable)
+        glEnable(GL_BLEND);
+    else
+        glDisable(GL_BLEND);
+}
+
+static GLint
+uniform_location(GLuint program, const char *name)
+{
+    gl_count(GL_COUNT_LOCATION_LOOKUPS);
+    return glGetUniformLocation(program, name);
+}
+
+static GLint
+attrib_location(GLuint program, const char *name)
+{
+    gl_count(GL_COUNT_LOCATION_LOOKUPS);
+    return glGetAttribLocation(program, name);
+}
+
+static void
+upload_mat4(GLint location, const hmm_mat4 *matrix)
+{
+    gl_count(GL_COUNT_UNIFORM_UPLOADS);
+    glUniformMatrix4fv(location, 1, GL_FALSE, &matrix->Elements[0][0]);
+}
 
 GLuint
 LoadShader(GLenum type, const char *shaderSrc)
@@ -679,26 +1363,12 @@ init_cam()
     cam_scale = HMM_Scale(HMM_Vec3(0.5f, 0.5f, 0.5f));
 }
 
-void
-init_corners()
-{
-    CSCOORD_LBN= HMM_Vec4(-1.0f, -1.0f, -1.0f, 1.0f);
-    CSCOORD_LTN= HMM_Vec4(-1.0f,  1.0f, -1.0f, 1.0f);
-    CSCOORD_RTN= HMM_Vec4(1.0f,  1.0f, -1.0f, 1.0f);
-    CSCOORD_RBN= HMM_Vec4(1.0f, -1.0f, -1.0f, 1.0f);
-    CSCOORD_LBF= HMM_Vec4(-1.0f, -1.0f,  1.0f, 1.0f);
-    CSCOORD_LTF= HMM_Vec4(-1.0f,  1.0f,  1.0f, 1.0f);
-    CSCOORD_RTF= HMM_Vec4(1.0f,  1.0f,  1.0f, 1.0f);
-    CSCOORD_RBF= HMM_Vec4(1.0f, -1.0f,  1.0f, 1.0f);
-}
-
 void
 init_objs()
 {
     reset_proj_cam();
     reset_cube_transform();
     init_cam();
-    init_corners();
 }
 
 void
@@ -753,6 +1423,16 @@ init_shader(struct ogl *draw_data, struct ogl_init *init_data)
         glDeleteProgram(draw_data->program);
         return false;
     }
+
+    draw_data->mvpLoc = uniform_location(draw_data->program, "mvp");
+    draw_data->matrixID = draw_data->mvpLoc;
+    draw_data->modelLoc = uniform_location(draw_data->program, "model");
+    draw_data->cameraBlock = glGetUniformBlockIndex(draw_data->program, "Camera");
+    gl_count(GL_COUNT_LOCATION_LOOKUPS);
+    if (draw_data->cameraBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(draw_data->program, draw_data->cameraBlock, CAMERA_BINDING);
+    draw_data->vertexLoc = attrib_location(draw_data->program, "aPos");
+    draw_data->colorLoc = attrib_location(draw_data->program, "aColor");
     return true;
 }
 
@@ -764,13 +1444,15 @@ init_frustum(struct ogl *draw_data, struct ogl_init *init_data)
     }
 
     glGenVertexArrays(1, &(draw_data->VAO));
-    glGenBuffers(1, &(draw_data->VBO));
     glGenBuffers(1, &(draw_data->IBO));
 
+    gl_stream_init(&frustum_stream);
+    gl_stream_reserve(&frustum_stream, init_data->vert_len, 7 * sizeof(GLfloat));
+    draw_data->VBO = frustum_stream.buffer;
+
     glBindVertexArray(draw_data->VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, draw_data->VBO);
-    glBufferData(GL_ARRAY_BUFFER, init_data->vert_len, init_data->verts, GL_DYNAMIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(GLfloat), (void*)0);
@@ -779,11 +1461,12 @@ init_frustum(struct ogl *draw_data, struct ogl_init *init_data)
     glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 7 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw_data->IBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, init_data->index_len, init_data->indices, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, init_data->index_len, init_data->indices, GL_STATIC_DRAW);
 
     glBindVertexArray(0);
 
     draw_data->init_data = init_data;
+    update_frustum_buffer();
     return true;
 }
 
@@ -872,8 +1555,50 @@ init_cube(struct ogl *draw_data, struct ogl_init *init_data)
 void
 update_frustum_buffer()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, objs.frustum.VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, frustum_init.vert_len, frustum_init.verts);
+    void *verts;
+
+    /* nothing to upload to when the scene is drawn on the CPU */
+    if (!frustum_stream.buffer)
+        return;
+    verts = gl_stream_map(&frustum_stream, frustum_init.vert_len);
+    if (!verts)
+        return;
+    gl_count(GL_COUNT_BUFFER_UPLOADS);
+    gl_count_add(GL_COUNT_UPLOAD_BYTES, frustum_init.vert_len);
+    memcpy(verts, frustum_init.verts, frustum_init.vert_len);
+    gl_stream_unmap(&frustum_stream, frustum_init.vert_len);
+}
+
+void
+init_camera_ubo()
+{
+    glGenBuffers(1, &camera_ubo.buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, camera_ubo.buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(struct camera_block), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, camera_ubo.buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    camera_ubo.cam = NULL;
+}
+
+/* Once per frame, before drawing. Skips the upload if nothing changed. */
+void
+upload_camera(const struct camera *cam)
+{
+    struct camera_block block;
+
+    if (camera_ubo.cam == cam && camera_ubo.version == cam->version)
+        return;
+    camera_ubo.cam = cam;
+    camera_ubo.version = cam->version;
+
+    block.view = cam->view;
+    block.projection = cam->projection;
+    block.viewproj = cam->viewproj;
+    gl_count(GL_COUNT_BUFFER_UPLOADS);
+    gl_count_add(GL_COUNT_UPLOAD_BYTES, sizeof(block));
+    glBindBuffer(GL_UNIFORM_BUFFER, camera_ubo.buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 /*
@@ -896,92 +1621,147 @@ perspective(float FOV, float AspectRatio, float Near, float Far)
     return result;
 }
 
-hmm_mat4
-calc_cam_mvp()
+/*
+ * Returns true if the matrix in slot has to be rebuilt because input no
+ * longer matches the copy in key, which is then brought up to date.
+ */
+static bool
+xform_stale(enum xform_slot slot, void *key, const void *input, size_t size)
 {
-    hmm_mat4 translation = HMM_Translate(HMM_AddVec3(proj_cam_ornt.eye, cam_offset));
-    hmm_mat4 rsm = HMM_MultiplyMat4(cam_rotation,cam_scale);
-    hmm_mat4 model = HMM_MultiplyMat4(translation,rsm);
-    hmm_mat4 view = HMM_LookAt(obj_cam_ornt.eye, HMM_AddVec3(obj_cam_ornt.center, obj_cam_ornt.eye), obj_cam_ornt.up);
-    hmm_mat4 projection = perspective(obj_cam_prsp.fov, obj_cam_prsp.aspect_ratio,
-                                     obj_cam_prsp.near, obj_cam_prsp.far);
+    if (xform.valid[slot] && memcmp(key, input, size) == 0) {
+        xform.reused[slot]++;
+        return false;
+    }
+    memcpy(key, input, size);
+    xform.valid[slot] = true;
+    xform.rebuilt[slot]++;
+    return true;
+}
 
-    hmm_mat4 vm = HMM_MultiplyMat4(view,model);
-    hmm_mat4 mvp = HMM_MultiplyMat4(projection,vm);
-    return mvp;
+static void
+calc_camera_view(struct camera *cam, const struct cam_orientation *ornt)
+{
+    cam->view = HMM_LookAt(ornt->eye, HMM_AddVec3(ornt->center, ornt->eye), ornt->up);
+    cam->inv_view = HMM_InverseMat4(cam->view, HMM_MAT4_RIGID);
 }
 
-hmm_mat4
-calc_cube_mvp(struct cam_orientation *ornt,
-              struct cam_perspective *prsp)
+static void
+calc_camera_projection(struct camera *cam, const struct cam_perspective *prsp)
+{
+    cam->projection = perspective(prsp->fov, prsp->aspect_ratio, prsp->near, prsp->far);
+    cam->inv_projection = HMM_InverseMat4(cam->projection, HMM_MAT4_GENERAL);
+}
+
+static void
+calc_camera_derived(struct camera *cam)
+{
+    cam->viewproj = HMM_MultiplyMat4(cam->projection, cam->view);
+    cam->inv_viewproj = HMM_MultiplyMat4(cam->inv_view, cam->inv_projection);
+}
+
+/*
+ * View and projection are rebuilt when their inputs changed, the
+ * view-projection and the inverses whenever either of those was.
+ */
+void
+update_camera(struct camera *cam, int first_slot,
+              struct cam_orientation *ornt, struct cam_perspective *prsp)
+{
+    if (xform_stale(first_slot, &cam->ornt, ornt, sizeof(*ornt))) {
+        calc_camera_view(cam, ornt);
+        cam->version++;
+    }
+    if (xform_stale(first_slot + 1, &cam->prsp, prsp, sizeof(*prsp))) {
+        calc_camera_projection(cam, prsp);
+        cam->version++;
+    }
+    if (xform_stale(first_slot + 2, &cam->derived_version, &cam->version, sizeof(cam->version)))
+        calc_camera_derived(cam);
+}
+
+/* Every matrix of a camera that lives outside the transform cache, such as --sweep's */
+static void
+calc_camera(struct camera *cam, const struct cam_orientation *ornt, const struct cam_perspective *prsp)
+{
+    cam->ornt = *ornt;
+    cam->prsp = *prsp;
+    calc_camera_view(cam, ornt);
+    calc_camera_projection(cam, prsp);
+    calc_camera_derived(cam);
+}
+
+/* Runs once per frame, after the UI has had its chance to change things */
+void
+update_frame_transforms()
 {
-    cube_center = HMM_AddVec3(ornt->center, ornt->eye);
-    cube_rotate_x = HMM_Rotate(cube_transform.rx * 30, HMM_Vec3(1.0f, 0.0f, 0.0f));
-    cube_rotate_y = HMM_Rotate(cube_transform.ry * 30, HMM_Vec3(0.0f, 1.0f, 0.0f));
-    cube_rotate_z = HMM_Rotate(cube_transform.rz * 30, HMM_Vec3(0.0f, 0.0f, 1.0f));
+    update_camera(&obj_cam, XFORM_OBJ_VIEW, &obj_cam_ornt, &obj_cam_prsp);
+    update_camera(&proj_cam, XFORM_PROJ_VIEW, &proj_cam_ornt, &proj_cam_prsp);
 
-    cube_scale = HMM_Scale(HMM_Vec3(cube_transform.sx,cube_transform.sy,cube_transform.sz));
-    cube_translate = HMM_Translate(HMM_Vec3(cube_transform.tx,cube_transform.ty,cube_transform.tz));
+    if (xform_stale(XFORM_CUBE_MODEL, &xform.cube_transform, &cube_transform, sizeof(cube_transform)))
+        xform.cube_model = calc_cube_model(&cube_transform);
 
-    hmm_mat4 rsx = HMM_MultiplyMat4(cube_rotate_x,cube_scale);
-    hmm_mat4 rsy = HMM_MultiplyMat4(cube_rotate_y,rsx);
-    hmm_mat4 rsz = HMM_MultiplyMat4(cube_rotate_z,rsy);
-    cube_model = HMM_MultiplyMat4(cube_translate,rsz);
+    if (xform_stale(XFORM_CAM_MODEL, &xform.cam_eye, &proj_cam_ornt.eye, sizeof(proj_cam_ornt.eye)))
+        xform.cam_model = calc_cam_model(proj_cam_ornt.eye);
 
+    PROFILE_BEGIN(frustum_zone, "frustum");
+    if (set_frustum_verts())
+        update_frustum_buffer();
+    PROFILE_END(frustum_zone);
+}
 
-    cube_view = HMM_LookAt(ornt->eye, cube_center, ornt->up);
-    cube_projection = perspective(prsp->fov, prsp->aspect_ratio,prsp->near, prsp->far);
-    hmm_mat4 cube_vp = HMM_MultiplyMat4(cube_projection,cube_view);
-    hmm_mat4 cube_mvp = HMM_MultiplyMat4(cube_vp,cube_model);
-    return cube_mvp;
+/* the camera gizmo follows the scene camera's eye */
+hmm_mat4
+calc_cam_model(hmm_vec3 eye)
+{
+    hmm_mat4 translation = HMM_Translate(HMM_AddVec3(eye, cam_offset));
+    hmm_mat4 rsm = HMM_MultiplyMat4(cam_rotation,cam_scale);
+    return HMM_MultiplyMat4(translation,rsm);
 }
 
 hmm_mat4
-calc_grid_mvp(struct cam_orientation *ornt,
-              struct cam_perspective *prsp)
+calc_cam_mvp()
 {
-    hmm_mat4 view, proj;
-    hmm_vec3 center;
-    center = HMM_AddVec3(ornt->center, ornt->eye);
+    return HMM_MultiplyMat4(obj_cam.viewproj, xform.cam_model);
+}
 
-    view = HMM_LookAt(ornt->eye, center, ornt->up);
-    proj = perspective(prsp->fov, prsp->aspect_ratio,prsp->near, prsp->far);
-    hmm_mat4 ret = HMM_MultiplyMat4(proj,view);
-    return ret;
+/* the rotation sliders are in units of 30 degrees */
+hmm_mat4
+calc_cube_model(struct orientation *transform)
+{
+    return HMM_ComposeTRSEuler(HMM_Vec3(transform->tx, transform->ty, transform->tz),
+                               HMM_Vec3(transform->rx * 30, transform->ry * 30, transform->rz * 30),
+                               HMM_Vec3(transform->sx, transform->sy, transform->sz));
 }
 
 hmm_mat4
-calc_frustum_mvp()
+calc_cube_mvp(const struct camera *cam)
+{
+    return HMM_MultiplyMat4(cam->viewproj, xform.cube_model);
+}
+
+hmm_mat4
+calc_grid_mvp(const struct camera *cam)
 {
-    hmm_mat4 view = HMM_LookAt(obj_cam_ornt.eye , HMM_AddVec3(obj_cam_ornt.center, obj_cam_ornt.eye), obj_cam_ornt.up);
-    hmm_mat4 projection = perspective(obj_cam_prsp.fov, obj_cam_prsp.aspect_ratio,
-                                      obj_cam_prsp.near, obj_cam_prsp.far);
+    return cam->viewproj;
+}
 
-    hmm_mat4 mvp = HMM_MultiplyMat4(projection,view);
-    return mvp;
+hmm_mat4
+calc_frustum_mvp()
+{
+    return obj_cam.viewproj;
 }
 
 
-void
+/* returns true if the corners moved and the vertex buffer needs uploading */
+bool
 set_frustum_verts()
 {
-    hmm_mat4 view = HMM_LookAt(proj_cam_ornt.eye, HMM_AddVec3(proj_cam_ornt.center, proj_cam_ornt.eye), proj_cam_ornt.up);
-    hmm_mat4 proj = perspective(proj_cam_prsp.fov, proj_cam_prsp.aspect_ratio,
-                                proj_cam_prsp.near, proj_cam_prsp.far);
-    hmm_mat4 viewproj = HMM_MultiplyMat4(proj,view);
-    hmm_mat4 inv = HMM_Mat4();
-    inv = hmm_mat4_inv(viewproj, inv);
-
-    hmm_frustum_corners(inv,corners);
-    int i,index;
-    index = 0;
+    if (!xform_stale(XFORM_FRUSTUM, &xform.frustum_version, &proj_cam.version, sizeof(proj_cam.version)))
+        return false;
 
-    for(i = 0; i < 8; i++) {
-        frustum_verts[index++] = corners[i].X;
-        frustum_verts[index++] = corners[i].Y;
-        frustum_verts[index++] = corners[i].Z;
-        index += 4;
-    }
+    /* corners go straight into the xyz of each 7-float vertex */
+    HMM_FrustumCorners(proj_cam.inv_viewproj, frustum_verts, 7);
+    return true;
 }
 
 void
@@ -1016,118 +1796,2503 @@ reset_proj_cam()
 void
 draw_triangle_indices(struct ogl *obj, hmm_mat4 mvp)
 {
-    glUniformMatrix4fv(obj->matrixID, 1, GL_FALSE, mvp.Elements[0]);
+    upload_mat4(obj->matrixID, &mvp);
     glDrawElements(GL_TRIANGLES, obj->init_data->index_len, GL_UNSIGNED_SHORT, 0);
 }
 
 void
 draw_cam(struct ogl *obj)
 {
-    glUseProgram(obj->program);
-    hmm_mat4 translation = HMM_Translate(HMM_AddVec3(proj_cam_ornt.eye, cam_offset));
-    hmm_mat4 rsm = HMM_MultiplyMat4(cam_rotation,cam_scale);
-    hmm_mat4 model = HMM_MultiplyMat4(translation,rsm);
-    hmm_mat4 view = HMM_LookAt(obj_cam_ornt.eye, HMM_AddVec3(obj_cam_ornt.center, obj_cam_ornt.eye), obj_cam_ornt.up);
-    hmm_mat4 projection = perspective(obj_cam_prsp.fov, obj_cam_prsp.aspect_ratio,
-                                   obj_cam_prsp.near, obj_cam_prsp.far);
+    use_program(obj->program);
 
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "model"), 1, GL_FALSE, &model.Elements[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "view"), 1, GL_FALSE, &view.Elements[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "projection"), 1, GL_FALSE, &projection.Elements[0][0]);
+    upload_mat4(obj->modelLoc, &xform.cam_model);
 
-    glBindVertexArray(obj->VAO);
+    bind_vertex_array(obj->VAO);
 
+    gl_count(GL_COUNT_DRAW_CALLS);
     glDrawElements(GL_TRIANGLES, obj->init_data->index_len, GL_UNSIGNED_INT, 0);
 }
 
 void
-draw_cube(struct ogl *obj, struct cam_orientation *ornt, struct cam_perspective *prsp)
+draw_cube(struct ogl *obj)
 {
-    glUseProgram(obj->program);
-
-    cube_center = HMM_AddVec3(ornt->center, ornt->eye);
-    cube_rotate_x = HMM_Rotate(cube_transform.rx * 30, HMM_Vec3(1.0f, 0.0f, 0.0f));
-    cube_rotate_y = HMM_Rotate(cube_transform.ry * 30, HMM_Vec3(0.0f, 1.0f, 0.0f));
-    cube_rotate_z = HMM_Rotate(cube_transform.rz * 30, HMM_Vec3(0.0f, 0.0f, 1.0f));
-
-    cube_translate = HMM_Translate(HMM_Vec3(cube_transform.tx,cube_transform.ty,cube_transform.tz));
-    cube_scale = HMM_Scale(HMM_Vec3(cube_transform.sx,cube_transform.sy,cube_transform.sz));
-
-    hmm_mat4 rsx = HMM_MultiplyMat4(cube_rotate_x,cube_scale);
-    hmm_mat4 rsy = HMM_MultiplyMat4(cube_rotate_y,rsx);
-    hmm_mat4 rsz = HMM_MultiplyMat4(cube_rotate_z,rsy);
-    cube_model = HMM_MultiplyMat4(cube_translate,rsz);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "model"), 1, GL_FALSE, &cube_model.Elements[0][0]);
-
+    use_program(obj->program);
 
-    cube_view = HMM_LookAt(ornt->eye, cube_center, ornt->up);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "view"), 1, GL_FALSE, &cube_view.Elements[0][0]);
-    cube_projection = perspective(prsp->fov, prsp->aspect_ratio,prsp->near, prsp->far);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "projection"), 1, GL_FALSE, &cube_projection.Elements[0][0]);
+    upload_mat4(obj->modelLoc, &xform.cube_model);
 
-    glBindVertexArray(obj->VAO);
+    bind_vertex_array(obj->VAO);
 
+    gl_count(GL_COUNT_DRAW_CALLS);
     glDrawElements(GL_TRIANGLES, obj->init_data->index_len, GL_UNSIGNED_INT, 0);
 
-    glBindVertexArray(0);
+    bind_vertex_array(0);
+}
+
+void
+draw_frustum(struct ogl *obj)
+{
+    use_program(obj->program);
+
+    bind_vertex_array(obj->VAO);
+
+    /* the vertices sit at whichever ring region was written last */
+    gl_count(GL_COUNT_DRAW_CALLS);
+    glDrawElementsBaseVertex(GL_TRIANGLES, obj->init_data->index_len, GL_UNSIGNED_INT, 0,
+                             (GLint)(frustum_stream.offset / (7 * sizeof(GLfloat))));
+    gl_stream_fence(&frustum_stream);
+
+    bind_vertex_array(0);
+}
+
+void
+draw_grid(struct ogl *obj)
+{
+    set_blend(false);
+    use_program(obj->program);
+
+    bind_vertex_array(obj->VAO);
+    gl_count(GL_COUNT_DRAW_CALLS);
+    glDrawArrays(GL_LINES, 0, (obj->init_data->vert_len) / 3);
+}
+
+void
+just_draw_it(struct ogl *obj, const struct camera *cam)
+{
+    glUseProgram(obj->program);
+    hmm_mat4 mvp;
+    mvp = calc_grid_mvp(cam);
+    upload_mat4(obj->matrixID, &mvp);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, obj->VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->IBO);
+
+    glVertexAttribPointer(0,
+                          3, GL_FLOAT, GL_FALSE,
+                          3 * sizeof(float), 0);
+    glDrawArrays(GL_LINES, 0, (obj->init_data->vert_len) / 3);
+    glDisableVertexAttribArray(0);
+}
+
+/* ===============================================================
+ *
+ *                          Matrix display
+ *
+ * ===============================================================*/
+
+/*
+ * Writes hundredths / 100 with two decimals, the way "%0.2f" would, and
+ * returns the length. buf needs room for 23 characters.
+ */
+static int
+format_hundredths(long long hundredths, bool negative, char *buf)
+{
+    char digits[20];
+    unsigned long long whole;
+    int n = 0, len = 0;
+
+    if (negative)
+        buf[len++] = '-';
+    if (hundredths < 0)
+        hundredths = -hundredths;
+    whole = (unsigned long long)hundredths / 100;
+    do {
+        digits[n++] = (char)('0' + whole % 10);
+        whole /= 10;
+    } while (whole);
+    while (n)
+        buf[len++] = digits[--n];
+    buf[len++] = '.';
+    buf[len++] = (char)('0' + hundredths / 10 % 10);
+    buf[len++] = (char)('0' + hundredths % 10);
+    buf[len] = '\0';
+    return len;
+}
+
+/* Returns how many cells had to be formatted again. */
+int
+matrix_display_update(struct matrix_display *display, const hmm_mat4 *m)
+{
+    int row, col, formatted = 0;
+
+    for (row = 0; row < 4; row++) {
+        for (col = 0; col < 4; col++) {
+            int cell = row * 4 + col;
+            float value = m->Elements[col][row];
+            long long hundredths, shown;
+
+            /* printf prints the sign of values that round to zero, so keep it */
+            if (!isfinite(value) || fabsf(value) >= 1e15f) {
+                /* from about 1e21 on the digits no longer fit and are cut off */
+                int n = snprintf(display->text[cell], sizeof(display->text[cell]), "%0.2f", value);
+                display->len[cell] = (unsigned char)(n < 0 ? 0 :
+                    MIN(n, (int)sizeof(display->text[cell]) - 1));
+                display->shown[cell] = LLONG_MIN;
+                formatted++;
+                continue;
+            }
+            hundredths = llrint((double)value * 100.0);
+            shown = hundredths * 2 + (signbit(value) ? 1 : 0);
+            if (display->valid && display->shown[cell] == shown)
+                continue;
+            display->shown[cell] = shown;
+            display->len[cell] = (unsigned char)format_hundredths(hundredths, signbit(value),
+                                                                  display->text[cell]);
+            formatted++;
+        }
+    }
+    display->valid = true;
+    matrix_cells_formatted += formatted;
+    matrix_cells_kept += 16 - formatted;
+    return formatted;
+}
+
+void
+matrix_display_draw(struct nk_context *ctx, const char *title,
+                    const struct matrix_display *display)
+{
+    int cell;
+
+    nk_group_begin(ctx, title, NK_WINDOW_TITLE | NK_WINDOW_BORDER | NK_WINDOW_NO_SCROLLBAR);
+    nk_layout_row_static(ctx, 30, 50, 4);
+    for (cell = 0; cell < 16; cell++)
+        nk_text(ctx, display->text[cell], display->len[cell], NK_TEXT_LEFT);
+    nk_group_end(ctx);
+}
+
+/* ===============================================================
+ *
+ *                          Performance HUD
+ *
+ * ===============================================================*/
+
+static float
+ticks_to_ms(Uint64 ticks)
+{
+    return (float)((double)ticks * 1000.0 / (double)SDL_GetPerformanceFrequency());
+}
+
+/* Times a main loop phase for the HUD, and for the profiler when built in */
+void
+cpu_pass_begin(enum cpu_pass pass)
+{
+    perf.pass_start[pass] = SDL_GetPerformanceCounter();
+}
+
+void
+cpu_pass_end(enum cpu_pass pass)
+{
+    perf.current.cpu_ms[pass] += ticks_to_ms(SDL_GetPerformanceCounter() - perf.pass_start[pass]);
+#if PROFILE_ENABLED
+    {
+        struct profile_zone zone;
+        zone.name = cpu_pass_names[pass];
+        zone.start = perf.pass_start[pass];
+        profile_end(&zone);
+    }
+#endif
+}
+
+/* Files the frame's sample into history, once everything has been counted */
+void
+perf_end_frame()
+{
+    const struct nk_sdl_frame_stats *ui = nk_sdl_frame_stats();
+    struct perf_sample *sample = &perf.current;
+    int pass;
+
+    sample->frame_ms = ticks_to_ms(SDL_GetPerformanceCounter() - perf.frame_start);
+    sample->cpu_ms[CPU_PASS_UI] -= sample->cpu_ms[CPU_PASS_HUD];
+    for (pass = 0; pass < GPU_PASS_COUNT; pass++)
+        sample->gpu_ms[pass] = (float)gpu_timers.last_ms[pass];
+    sample->draws = gl_calls.last_frame[GL_COUNT_DRAW_CALLS];
+    sample->state_changes = gl_calls.last_frame[GL_COUNT_STATE_CHANGES];
+    sample->uniform_uploads = gl_calls.last_frame[GL_COUNT_UNIFORM_UPLOADS];
+    sample->upload_bytes = gl_calls.last_frame[GL_COUNT_UPLOAD_BYTES];
+    sample->ui_draws = ui->draws;
+    sample->ui_upload_bytes = ui->upload_bytes;
+#if GL_TRACE
+    {
+        const struct gl_trace_stats *trace = gl_trace_stats();
+        for (pass = 0; pass < GL_TRACE_CALL_COUNT; pass++) {
+            sample->traced_calls += trace->last_frame[pass].calls;
+            sample->redundant_calls += trace->last_frame[pass].redundant;
+        }
+    }
+#endif
+
+    perf.history[perf.frames % PERF_HISTORY] = *sample;
+    perf.frames++;
+    memset(sample, 0, sizeof(*sample));
+}
+
+/* k-th smallest of values[0..n), reordering them */
+static float
+select_kth(float *values, int n, int k)
+{
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        float pivot = values[(lo + hi) / 2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (values[i] < pivot)
+                i++;
+            while (values[j] > pivot)
+                j--;
+            if (i <= j) {
+                float t = values[i];
+                values[i++] = values[j];
+                values[j--] = t;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+    return values[k];
+}
+
+/* Takes the snapshot the window shows until the next refresh */
+static void
+perf_refresh()
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    int n = (int)MIN(perf.frames, PERF_HISTORY);
+    int fresh = (int)MIN(perf.frames - perf.refreshed_frames, PERF_HISTORY);
+    int i, pass;
+    double sum = 0.0;
+
+    perf.window = n;
+    perf.min_ms = perf.avg_ms = perf.p99_ms = perf.graph_max = 0.0f;
+    perf.graph_len = MIN(n, PERF_GRAPH_POINTS);
+    if (n == 0)
+        return;
+
+    /* oldest first, so the graph scrolls to the left */
+    perf.min_ms = perf.history[(perf.frames - 1) % PERF_HISTORY].frame_ms;
+    for (i = 0; i < n; i++) {
+        float ms = perf.history[(perf.frames - n + i) % PERF_HISTORY].frame_ms;
+        perf.sorted[i] = ms;
+        sum += ms;
+        perf.min_ms = MIN(perf.min_ms, ms);
+        if (i >= n - perf.graph_len) {
+            perf.graph[i - (n - perf.graph_len)] = ms;
+            perf.graph_max = MAX(perf.graph_max, ms);
+        }
+    }
+    perf.avg_ms = (float)(sum / n);
+    perf.p99_ms = select_kth(perf.sorted, n, (n * 99 + 99) / 100 - 1);
+
+    /* times are averaged over the frames since the last refresh, counts are the last frame's */
+    if (fresh < 1)
+        fresh = 1;
+    perf.shown = perf.history[(perf.frames - 1) % PERF_HISTORY];
+    memset(perf.shown.cpu_ms, 0, sizeof(perf.shown.cpu_ms));
+    memset(perf.shown.gpu_ms, 0, sizeof(perf.shown.gpu_ms));
+    perf.shown.frame_ms = 0.0f;
+    for (i = 0; i < fresh; i++) {
+        const struct perf_sample *sample = &perf.history[(perf.frames - 1 - i) % PERF_HISTORY];
+        perf.shown.frame_ms += sample->frame_ms / fresh;
+        for (pass = 0; pass < CPU_PASS_COUNT; pass++)
+            perf.shown.cpu_ms[pass] += sample->cpu_ms[pass] / fresh;
+        for (pass = 0; pass < GPU_PASS_COUNT; pass++)
+            perf.shown.gpu_ms[pass] += sample->gpu_ms[pass] / fresh;
+    }
+    perf.refreshed_frames = perf.frames;
+    perf.refresh_ms = ticks_to_ms(SDL_GetPerformanceCounter() - start);
+}
+
+void
+perf_hud_draw(struct nk_context *ctx)
+{
+    const struct gl_stream_stats *vstream, *estream;
+    int i;
+
+    cpu_pass_begin(CPU_PASS_HUD);
+    if (!perf.refreshed_at || SDL_GetTicks() - perf.refreshed_at >= PERF_REFRESH_MS) {
+        perf_refresh();
+        perf.refreshed_at = SDL_GetTicks();
+    }
+    nk_sdl_stream_stats(&vstream, &estream);
+
+    if (nk_begin(ctx, "Performance", nk_rect(WINDOW_WIDTH - 300, 0, 300, 830),
+                 NK_WINDOW_TITLE | NK_WINDOW_BORDER | NK_WINDOW_MOVABLE |
+                 NK_WINDOW_SCALABLE | NK_WINDOW_MINIMIZABLE))
+    {
+        nk_layout_row_dynamic(ctx, 20, 1);
+        nk_labelf(ctx, NK_TEXT_LEFT, "frame ms, last %d frames", perf.graph_len);
+        nk_layout_row_dynamic(ctx, 80, 1);
+        if (nk_chart_begin(ctx, NK_CHART_COLUMN, perf.graph_len, 0.0f,
+                           perf.graph_max > 0.0f ? perf.graph_max : 1.0f)) {
+            for (i = 0; i < perf.graph_len; i++)
+                nk_chart_push(ctx, perf.graph[i]);
+            nk_chart_end(ctx);
+        }
+
+        nk_layout_row_dynamic(ctx, 20, 4);
+        nk_labelf(ctx, NK_TEXT_LEFT, "%d fr", perf.window);
+        nk_label(ctx, "min", NK_TEXT_RIGHT);
+        nk_label(ctx, "avg", NK_TEXT_RIGHT);
+        nk_label(ctx, "p99", NK_TEXT_RIGHT);
+        nk_label(ctx, "frame", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", perf.min_ms);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", perf.avg_ms);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", perf.p99_ms);
+
+        nk_layout_row_dynamic(ctx, 20, 2);
+        nk_label(ctx, "CPU", NK_TEXT_LEFT);
+        nk_label(ctx, "ms", NK_TEXT_RIGHT);
+        for (i = 0; i < CPU_PASS_COUNT; i++) {
+            nk_label(ctx, cpu_pass_names[i], NK_TEXT_LEFT);
+            nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", perf.shown.cpu_ms[i]);
+        }
+        nk_label(ctx, gpu_timers.submit_only ? "GPU (submit only)" : "GPU", NK_TEXT_LEFT);
+        nk_label(ctx, "ms", NK_TEXT_RIGHT);
+        for (i = 0; i < GPU_PASS_COUNT; i++) {
+            nk_label(ctx, gpu_pass_names[i] + 4, NK_TEXT_LEFT);
+            nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", perf.shown.gpu_ms[i]);
+        }
+
+        nk_layout_row_dynamic(ctx, 20, 3);
+        nk_label(ctx, "last frame", NK_TEXT_LEFT);
+        nk_label(ctx, "scene", NK_TEXT_RIGHT);
+        nk_label(ctx, "UI", NK_TEXT_RIGHT);
+        nk_label(ctx, "draw calls", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.draws);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.ui_draws);
+        nk_label(ctx, "bytes up", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.upload_bytes);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.ui_upload_bytes);
+        nk_label(ctx, "state changes", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.state_changes);
+        nk_label(ctx, "", NK_TEXT_RIGHT);
+        nk_label(ctx, "uniforms", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.uniform_uploads);
+        nk_label(ctx, "", NK_TEXT_RIGHT);
+#if GL_TRACE
+        nk_label(ctx, "GL traced", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", perf.shown.traced_calls);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%lu redundant", perf.shown.redundant_calls);
+#endif
+
+        nk_label(ctx, "memory", NK_TEXT_LEFT);
+        nk_label(ctx, "used", NK_TEXT_RIGHT);
+        nk_label(ctx, "size", NK_TEXT_RIGHT);
+        nk_label(ctx, "UI commands", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%luK", perf.shown.ui_memory / 1024);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%luK", (unsigned long)ctx->memory.size / 1024);
+        nk_label(ctx, "UI verts", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%ldK", (long)vstream->used / 1024);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%ldK", (long)vstream->high_water / 1024);
+        nk_label(ctx, "UI elems", NK_TEXT_LEFT);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%ldK", (long)estream->used / 1024);
+        nk_labelf(ctx, NK_TEXT_RIGHT, "%ldK", (long)estream->high_water / 1024);
+
+        nk_layout_row_dynamic(ctx, 20, 1);
+        nk_labelf(ctx, NK_TEXT_LEFT, "HUD %.3f ms/frame, refresh %.3f ms",
+                  perf.shown.cpu_ms[CPU_PASS_HUD], perf.refresh_ms);
+    }
+    nk_end(ctx);
+    cpu_pass_end(CPU_PASS_HUD);
+}
+
+/* ===============================================================
+ *
+ *                          Benchmarks
+ *
+ * ===============================================================*/
+
+static double
+bench_seconds(Uint64 start)
+{
+    return (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+static void
+bench_mat4_batch(void)
+{
+    hmm_mat4_soa left, right, result;
+    int i, rep, level;
+
+    if (!HMM_AllocMat4SoA(&left, BENCH_BATCH) || !HMM_AllocMat4SoA(&right, BENCH_BATCH)
+        || !HMM_AllocMat4SoA(&result, BENCH_BATCH)) {
+        fprintf(stderr, "bench: out of memory\n");
+        return;
+    }
+    for (i = 0; i < BENCH_BATCH; i++) {
+        HMM_StoreMat4SoA(&left, i, HMM_Rotate((float)i, HMM_Vec3(1.0f, 1.0f, 0.0f)));
+        HMM_StoreMat4SoA(&right, i, HMM_Translate(HMM_Vec3((float)i, 1.0f, 2.0f)));
+    }
+
+    printf("HMM_MultiplyMat4Batch, %d matrices x %d reps\n", BENCH_BATCH, BENCH_REPS);
+    for (level = HMM_SIMD_SCALAR; level <= (int)HMM_SIMDMaxLevel(); level++) {
+        HMM_SetSIMDLevel((hmm_simd_level)level);
+        HMM_MultiplyMat4Batch(&left, &right, &result, BENCH_BATCH);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS; rep++)
+            HMM_MultiplyMat4Batch(&left, &right, &result, BENCH_BATCH);
+        double secs = bench_seconds(start);
+
+        printf("  %-8s %10.1f Mmat/s\n", HMM_SIMDLevelName((hmm_simd_level)level),
+               (double)BENCH_BATCH * BENCH_REPS / secs / 1e6);
+    }
+    HMM_SetSIMDLevel(HMM_SIMDMaxLevel());
+
+    HMM_FreeMat4SoA(&left);
+    HMM_FreeMat4SoA(&right);
+    HMM_FreeMat4SoA(&result);
+}
+
+static void
+bench_mat4_inverse(void)
+{
+    static const char *kind_names[] = {"general", "affine", "rigid"};
+    hmm_mat4_soa input, result;
+    hmm_mat4 *single;
+    int i, rep, level, kind;
+
+    single = malloc(BENCH_BATCH * sizeof(hmm_mat4));
+    if (!single || !HMM_AllocMat4SoA(&input, BENCH_BATCH) || !HMM_AllocMat4SoA(&result, BENCH_BATCH)) {
+        fprintf(stderr, "bench: out of memory\n");
+        free(single);
+        return;
+    }
+    for (i = 0; i < BENCH_BATCH; i++) {
+        single[i] = HMM_MultiplyMat4(HMM_Translate(HMM_Vec3((float)i, 1.0f, 2.0f)),
+                                     HMM_Rotate((float)i, HMM_Vec3(1.0f, 1.0f, 0.0f)));
+        HMM_StoreMat4SoA(&input, i, single[i]);
+    }
+
+    printf("HMM_InverseMat4, %d matrices x %d reps\n", BENCH_BATCH, BENCH_REPS);
+    for (kind = HMM_MAT4_GENERAL; kind <= HMM_MAT4_RIGID; kind++) {
+        float sink = 0.0f;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS; rep++)
+            for (i = 0; i < BENCH_BATCH; i++)
+                sink += HMM_InverseMat4(single[i], (hmm_mat4_kind)kind).Elements[3][0];
+        double secs = bench_seconds(start);
+        printf("  %-8s %-8s %10.1f Mmat/s (%g)\n", "single", kind_names[kind],
+               (double)BENCH_BATCH * BENCH_REPS / secs / 1e6, sink);
+    }
+
+    printf("HMM_InverseMat4Batch, %d matrices x %d reps\n", BENCH_BATCH, BENCH_REPS);
+    for (level = HMM_SIMD_SCALAR; level <= (int)HMM_SIMDMaxLevel(); level++) {
+        HMM_SetSIMDLevel((hmm_simd_level)level);
+        for (kind = HMM_MAT4_GENERAL; kind <= HMM_MAT4_RIGID; kind++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (rep = 0; rep < BENCH_REPS; rep++)
+                HMM_InverseMat4Batch(&input, &result, BENCH_BATCH, (hmm_mat4_kind)kind);
+            double secs = bench_seconds(start);
+            printf("  %-8s %-8s %10.1f Mmat/s\n", HMM_SIMDLevelName((hmm_simd_level)level),
+                   kind_names[kind], (double)BENCH_BATCH * BENCH_REPS / secs / 1e6);
+        }
+    }
+    HMM_SetSIMDLevel(HMM_SIMDMaxLevel());
+
+    HMM_FreeMat4SoA(&input);
+    HMM_FreeMat4SoA(&result);
+    free(single);
+}
+
+static void
+bench_frustum_corners(void)
+{
+    hmm_mat4_soa inv;
+    float *verts;
+    int i, rep, level;
+
+    verts = malloc((size_t)BENCH_BATCH * 8 * 7 * sizeof(float));
+    if (!verts || !HMM_AllocMat4SoA(&inv, BENCH_BATCH)) {
+        fprintf(stderr, "bench: out of memory\n");
+        free(verts);
+        return;
+    }
+    for (i = 0; i < BENCH_BATCH; i++) {
+        hmm_mat4 view = HMM_LookAt(HMM_Vec3((float)i, 1.0f, 2.0f), HMM_Vec3(0.0f, 0.0f, 0.0f),
+                                   HMM_Vec3(0.0f, 1.0f, 0.0f));
+        hmm_mat4 proj = HMM_Perspective(45.0f + (float)(i % 45), 16.0f / 9.0f, 0.1f, 100.0f);
+        HMM_StoreMat4SoA(&inv, i, HMM_InverseMat4(HMM_MultiplyMat4(proj, view), HMM_MAT4_GENERAL));
+    }
+
+    printf("HMM_FrustumCornersBatch, %d cameras x %d reps\n", BENCH_BATCH, BENCH_REPS);
+    for (level = HMM_SIMD_SCALAR; level <= (int)HMM_SIMDMaxLevel(); level++) {
+        HMM_SetSIMDLevel((hmm_simd_level)level);
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS; rep++)
+            HMM_FrustumCornersBatch(&inv, verts, BENCH_BATCH, 7);
+        double secs = bench_seconds(start);
+        printf("  %-8s %10.1f Mcam/s\n", HMM_SIMDLevelName((hmm_simd_level)level),
+               (double)BENCH_BATCH * BENCH_REPS / secs / 1e6);
+    }
+    HMM_SetSIMDLevel(HMM_SIMDMaxLevel());
+
+    HMM_FreeMat4SoA(&inv);
+    free(verts);
+}
+
+static void
+bench_sincos_rotate(void)
+{
+    static const char *tier_names[] = {"precise", "fast"};
+    hmm_mat4_soa result;
+    float *angles, *sines, *cosines, *axis[3];
+    int i, rep, level, tier;
+
+    angles = malloc(BENCH_BATCH * sizeof(float));
+    sines = malloc(BENCH_BATCH * sizeof(float));
+    cosines = malloc(BENCH_BATCH * sizeof(float));
+    for (i = 0; i < 3; i++)
+        axis[i] = malloc(BENCH_BATCH * sizeof(float));
+    if (!angles || !sines || !cosines || !axis[0] || !axis[1] || !axis[2]
+        || !HMM_AllocMat4SoA(&result, BENCH_BATCH)) {
+        fprintf(stderr, "bench: out of memory\n");
+        goto done;
+    }
+    for (i = 0; i < BENCH_BATCH; i++) {
+        angles[i] = (float)(i - BENCH_BATCH / 2) * 0.37f;
+        axis[0][i] = (float)(i % 3) + 0.5f;
+        axis[1][i] = (float)(i % 5) - 2.0f;
+        axis[2][i] = (float)(i % 7) + 1.0f;
+    }
+
+    printf("sin/cos, %d angles x %d reps\n", BENCH_BATCH, BENCH_REPS);
+    {
+        float sink = 0.0f;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS; rep++)
+            for (i = 0; i < BENCH_BATCH; i++)
+                sink += HMM_SINF(angles[i]) + HMM_COSF(angles[i]);
+        double secs = bench_seconds(start);
+        printf("  %-8s %-8s %10.1f M/s (%g)\n", "libm", "", (double)BENCH_BATCH * BENCH_REPS / secs / 1e6, sink);
+    }
+    for (level = HMM_SIMD_SCALAR; level <= (int)HMM_SIMDMaxLevel(); level++) {
+        HMM_SetSIMDLevel((hmm_simd_level)level);
+        for (tier = HMM_SINCOS_PRECISE; tier <= HMM_SINCOS_FAST; tier++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (rep = 0; rep < BENCH_REPS; rep++)
+                HMM_SinCosBatch(angles, sines, cosines, BENCH_BATCH, (hmm_sincos_accuracy)tier);
+            double secs = bench_seconds(start);
+            printf("  %-8s %-8s %10.1f M/s\n", HMM_SIMDLevelName((hmm_simd_level)level),
+                   tier_names[tier], (double)BENCH_BATCH * BENCH_REPS / secs / 1e6);
+        }
+    }
+
+    printf("HMM_Rotate, %d matrices x %d reps\n", BENCH_BATCH, BENCH_REPS / 10);
+    {
+        float sink = 0.0f;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS / 10; rep++)
+            for (i = 0; i < BENCH_BATCH; i++)
+                sink += HMM_Rotate(angles[i], HMM_Vec3(axis[0][i], axis[1][i], axis[2][i])).Elements[1][0];
+        double secs = bench_seconds(start);
+        printf("  %-8s %-8s %10.1f Mmat/s (%g)\n", "single", "", (double)BENCH_BATCH * (BENCH_REPS / 10) / secs / 1e6, sink);
+    }
+    for (level = HMM_SIMD_SCALAR; level <= (int)HMM_SIMDMaxLevel(); level++) {
+        HMM_SetSIMDLevel((hmm_simd_level)level);
+        for (tier = HMM_SINCOS_PRECISE; tier <= HMM_SINCOS_FAST; tier++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (rep = 0; rep < BENCH_REPS / 10; rep++)
+                HMM_RotateBatch(angles, axis[0], axis[1], axis[2], &result, BENCH_BATCH,
+                                (hmm_sincos_accuracy)tier);
+            double secs = bench_seconds(start);
+            printf("  %-8s %-8s %10.1f Mmat/s\n", HMM_SIMDLevelName((hmm_simd_level)level),
+                   tier_names[tier], (double)BENCH_BATCH * (BENCH_REPS / 10) / secs / 1e6);
+        }
+    }
+    HMM_SetSIMDLevel(HMM_SIMDMaxLevel());
+    HMM_FreeMat4SoA(&result);
+
+done:
+    free(angles);
+    free(sines);
+    free(cosines);
+    for (i = 0; i < 3; i++)
+        free(axis[i]);
+}
+
+/* the five matrix chain calc_cube_model used to build */
+static hmm_mat4
+bench_model_chain(struct orientation *t)
+{
+    hmm_mat4 rx = HMM_Rotate(t->rx * 30, HMM_Vec3(1.0f, 0.0f, 0.0f));
+    hmm_mat4 ry = HMM_Rotate(t->ry * 30, HMM_Vec3(0.0f, 1.0f, 0.0f));
+    hmm_mat4 rz = HMM_Rotate(t->rz * 30, HMM_Vec3(0.0f, 0.0f, 1.0f));
+    hmm_mat4 scale = HMM_Scale(HMM_Vec3(t->sx, t->sy, t->sz));
+    hmm_mat4 translate = HMM_Translate(HMM_Vec3(t->tx, t->ty, t->tz));
+    return HMM_MultiplyMat4(translate, HMM_MultiplyMat4(rz, HMM_MultiplyMat4(ry, HMM_MultiplyMat4(rx, scale))));
+}
+
+static hmm_mat4
+bench_model_quaternion(struct orientation *t)
+{
+    hmm_quaternion q = HMM_QuaternionFromEuler(HMM_Vec3(t->rx * 30, t->ry * 30, t->rz * 30));
+    return HMM_ComposeTRSQuaternion(HMM_Vec3(t->tx, t->ty, t->tz), q, HMM_Vec3(t->sx, t->sy, t->sz));
+}
+
+static void
+bench_model_compose(void)
+{
+    static const char *names[] = {"chain", "euler", "quat"};
+    hmm_mat4 (*const compose[])(struct orientation *) = {
+        bench_model_chain, calc_cube_model, bench_model_quaternion
+    };
+    struct orientation *transforms;
+    int i, rep, method;
+
+    transforms = malloc(BENCH_BATCH * sizeof(struct orientation));
+    if (!transforms) {
+        fprintf(stderr, "bench: out of memory\n");
+        return;
+    }
+    for (i = 0; i < BENCH_BATCH; i++) {
+        struct orientation t = {
+            (float)(i % 7) - 3.0f, (float)(i % 5) * 0.5f, -(float)(i % 3),
+            1.0f + (float)(i % 4) * 0.25f, 0.5f, 2.0f,
+            (float)(i % 21) * 0.5f - 5.0f, (float)(i % 13) * 0.7f - 4.5f, (float)(i % 17) * 0.6f - 5.0f
+        };
+        transforms[i] = t;
+    }
+
+    printf("cube model matrix, %d transforms x %d reps\n", BENCH_BATCH, BENCH_REPS / 10);
+    for (method = 0; method < 3; method++) {
+        float sink = 0.0f, max_error = 0.0f;
+        int row, col;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS / 10; rep++)
+            for (i = 0; i < BENCH_BATCH; i++)
+                sink += compose[method](&transforms[i]).Elements[2][0];
+        double secs = bench_seconds(start);
+
+        for (i = 0; i < BENCH_BATCH; i++) {
+            hmm_mat4 ref = bench_model_chain(&transforms[i]);
+            hmm_mat4 m = compose[method](&transforms[i]);
+            for (col = 0; col < 4; col++)
+                for (row = 0; row < 4; row++)
+                    max_error = HMM_MAX(max_error, HMM_ABS(m.Elements[col][row] - ref.Elements[col][row]));
+        }
+        printf("  %-8s %10.1f Mmat/s  max |error| vs chain %g (%g)\n", names[method],
+               (double)BENCH_BATCH * (BENCH_REPS / 10) / secs / 1e6, max_error, sink);
+    }
+
+    free(transforms);
+}
+
+static void
+bench_matrix_display(void)
+{
+    struct matrix_display display;
+    hmm_mat4 *matrices;
+    char text[32];
+    int i, rep, cell, mismatches = 0;
+    unsigned long sink = 0;
+
+    matrices = malloc(BENCH_BATCH * sizeof(hmm_mat4));
+    if (!matrices) {
+        fprintf(stderr, "bench: out of memory\n");
+        return;
+    }
+    for (i = 0; i < BENCH_BATCH; i++)
+        for (cell = 0; cell < 16; cell++)
+            matrices[i].Elements[cell / 4][cell % 4] =
+                ((float)((i * 16 + cell) * 7919 % 200003) - 100001.0f) / (float)(1 + cell * 37);
+
+    printf("matrix display, %d matrices x %d reps\n", BENCH_BATCH, BENCH_REPS / 100);
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS / 100; rep++)
+            for (i = 0; i < BENCH_BATCH; i++)
+                for (cell = 0; cell < 16; cell++)
+                    sink += (unsigned long)snprintf(text, sizeof(text), "%0.2f",
+                                                    matrices[i].Elements[cell % 4][cell / 4]);
+        printf("  %-12s %8.2f Mmat/s (%lu)\n", "snprintf",
+               (double)BENCH_BATCH * (BENCH_REPS / 100) / bench_seconds(start) / 1e6, sink);
+    }
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (rep = 0; rep < BENCH_REPS / 100; rep++) {
+            for (i = 0; i < BENCH_BATCH; i++) {
+                display.valid = false;
+                sink += (unsigned long)matrix_display_update(&display, &matrices[i]);
+            }
+        }
+        printf("  %-12s %8.2f Mmat/s (%lu)\n", "all cells",
+               (double)BENCH_BATCH * (BENCH_REPS / 100) / bench_seconds(start) / 1e6, sink);
+    }
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        display.valid = false;
+        for (rep = 0; rep < BENCH_REPS / 100; rep++)
+            for (i = 0; i < BENCH_BATCH; i++)
+                sink += (unsigned long)matrix_display_update(&display, &matrices[0]);
+        printf("  %-12s %8.2f Mmat/s (%lu)\n", "unchanged",
+               (double)BENCH_BATCH * (BENCH_REPS / 100) / bench_seconds(start) / 1e6, sink);
+    }
+
+    for (i = 0; i < BENCH_BATCH; i++) {
+        display.valid = false;
+        matrix_display_update(&display, &matrices[i]);
+        for (cell = 0; cell < 16; cell++) {
+            snprintf(text, sizeof(text), "%0.2f", matrices[i].Elements[cell % 4][cell / 4]);
+            if (strcmp(text, display.text[cell]) != 0)
+                mismatches++;
+        }
+    }
+    printf("  cells differing from snprintf: %d of %d\n", mismatches, BENCH_BATCH * 16);
+
+    /* values too wide for a cell must stay inside it */
+    matrices[0] = HMM_Mat4d(1e30f);
+    matrices[0].Elements[1][1] = -INFINITY;
+    display.valid = false;
+    matrix_display_update(&display, &matrices[0]);
+    assert(display.len[0] <= sizeof(display.text[0]) - 1);
+    assert(display.len[5] <= sizeof(display.text[5]) - 1);
+    assert(display.len[0] == strlen(display.text[0]) && display.len[5] == strlen(display.text[5]));
+    free(matrices);
+}
+
+/*
+ * The CPU rasterizer at 1, 2, 4... threads up to one per CPU, drawing the
+ * scene as the eye sees it, a few large triangles, and a field of small
+ * cubes, where setup and binning matter as much as filling.
+ */
+static void
+bench_soft_raster(void)
+{
+    struct soft_raster_draw *cubes;
+    struct soft_scene scene;
+    int cpus = MAX(SDL_GetCPUCount(), 1);
+    int count = BENCH_RASTER_CUBES * BENCH_RASTER_CUBES;
+    int i, frame, threads;
+    double base = 0.0;
+
+    cubes = calloc((size_t)count, sizeof(*cubes));
+    if (!cubes) {
+        fprintf(stderr, "bench: out of memory\n");
+        return;
+    }
+    init_scene();
+    update_frame_transforms();
+    soft_scene_current(&scene);
+    for (i = 0; i < count; i++) {
+        float step = 10.0f / BENCH_RASTER_CUBES;
+        hmm_mat4 model = HMM_ComposeTRSEuler(
+            HMM_Vec3(-5.0f + step * ((float)(i % BENCH_RASTER_CUBES) + 0.5f), 0.0f,
+                     -5.0f + step * ((float)(i / BENCH_RASTER_CUBES) + 0.5f)),
+            HMM_Vec3(0.0f, (float)(i * 7 % 90), 0.0f), HMM_Vec3(step * 0.6f, step * 0.6f, step * 0.6f));
+        hmm_mat4 mvp = HMM_MultiplyMat4(obj_cam.viewproj, model);
+        memcpy(cubes[i].mvp, &mvp.Elements[0][0], sizeof(cubes[i].mvp));
+        cubes[i].primitive = SOFT_RASTER_TRIANGLES;
+        cubes[i].verts = cube_vertices;
+        cubes[i].stride = 7;
+        cubes[i].color_offset = 3;
+        cubes[i].indices = cube_indices;
+        cubes[i].count = LEN(cube_indices);
+        cubes[i].blend = 1;
+    }
+
+    printf("soft_raster, %dx%d, %d frames, %d cubes\n", WINDOW_WIDTH, WINDOW_HEIGHT,
+           BENCH_RASTER_FRAMES, count);
+    for (threads = 1;; threads = MIN(threads * 2, cpus)) {
+        const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+        double scene_secs, cube_secs;
+        unsigned long tris;
+        Uint64 start;
+
+        cpu_raster = soft_raster_create(WINDOW_WIDTH, WINDOW_HEIGHT, threads);
+        if (!cpu_raster) {
+            fprintf(stderr, "bench: could not start %d raster threads\n", threads);
+            break;
+        }
+        soft_draw_scene(cpu_raster, &scene);
+        soft_raster_finish(cpu_raster);
+        start = SDL_GetPerformanceCounter();
+        for (frame = 0; frame < BENCH_RASTER_FRAMES; frame++) {
+            soft_draw_scene(cpu_raster, &scene);
+            soft_raster_finish(cpu_raster);
+        }
+        scene_secs = bench_seconds(start);
+
+        start = SDL_GetPerformanceCounter();
+        for (frame = 0; frame < BENCH_RASTER_FRAMES; frame++) {
+            soft_raster_clear(cpu_raster, black);
+            for (i = 0; i < count; i++)
+                soft_raster_draw(cpu_raster, &cubes[i]);
+            soft_raster_finish(cpu_raster);
+        }
+        cube_secs = bench_seconds(start);
+        tris = soft_raster_stats(cpu_raster)->primitives;
+        if (threads == 1)
+            base = cube_secs;
+
+        printf("  %2d threads  scene %7.2f ms  cubes %7.2f ms %8.2f Mtri/s  x%.2f\n", threads,
+               scene_secs * 1000.0 / BENCH_RASTER_FRAMES, cube_secs * 1000.0 / BENCH_RASTER_FRAMES,
+               (double)tris * BENCH_RASTER_FRAMES / cube_secs / 1e6, base / cube_secs);
+        soft_raster_destroy(cpu_raster);
+        cpu_raster = NULL;
+        if (threads == cpus)
+            break;
+    }
+    free(cubes);
+}
+
+static int
+run_benchmarks(void)
+{
+    SDL_Init(SDL_INIT_TIMER);
+    printf("SIMD level: %s\n", HMM_SIMDLevelName(HMM_SIMDMaxLevel()));
+    bench_mat4_batch();
+    bench_mat4_inverse();
+    bench_frustum_corners();
+    bench_model_compose();
+    bench_sincos_rotate();
+    bench_matrix_display();
+    bench_soft_raster();
+    SDL_Quit();
+    return 0;
+}
+
+/* ===============================================================
+ *
+ *                          Headless
+ *
+ * ===============================================================*/
+
+static int
+compare_floats(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/* Writes RGB rows as a binary PPM, which starts with the top one */
+static bool
+write_ppm(const char *prefix, int frame, int width, int height,
+          const unsigned char *rgb, bool bottom_up)
+{
+    char path[512];
+    FILE *file;
+    int row;
+    size_t stride = (size_t)width * 3;
+
+    snprintf(path, sizeof(path), "%s%05d.ppm", prefix, frame);
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (row = 0; row < height; row++)
+        fwrite(rgb + (size_t)(bottom_up ? height - 1 - row : row) * stride, 1, stride, file);
+    fclose(file);
+    return true;
+}
+
+static bool
+dump_frame(const char *prefix, int frame, unsigned char *pixels)
+{
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, headless.width, headless.height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    return write_ppm(prefix, frame, headless.width, headless.height, pixels, true);
+}
+
+/* Sorts a copy of times, which must have room for frames more */
+static void
+print_frame_times(float *times, int frames)
+{
+    float *sorted = times + frames;
+    double sum = 0.0;
+    int i;
+
+    if (frames <= 0)
+        return;
+    memcpy(sorted, times, sizeof(*times) * (size_t)frames);
+    qsort(sorted, (size_t)frames, sizeof(*sorted), compare_floats);
+    for (i = 0; i < frames; i++)
+        sum += times[i];
+    printf("Frame ms: min %.3f  avg %.3f  p50 %.3f  p99 %.3f  max %.3f  (%.1f fps)\n",
+           sorted[0], sum / frames, sorted[frames / 2],
+           sorted[(frames * 99 + 99) / 100 - 1], sorted[frames - 1],
+           sum > 0.0 ? 1000.0 * frames / sum : 0.0);
+}
+
+/* the offscreen modes turn the cube so that every frame has work to do */
+static void
+spin_cube(int frame)
+{
+    cube_transform.ry = (float)frame * 0.05f;
+}
+
+/*
+ * bin/main --headless [frames] [--ui] [--dump prefix] [--replay log]
+ *
+ * Renders frames of the scene, with the cube turning so that every frame
+ * has work to do, into an offscreen framebuffer of the window's size and
+ * reports how long they took. Each frame ends in glFinish where the window
+ * would swap, so frame times include the rendering itself. With --replay
+ * the frames of a --record log are drawn instead of the turning cube.
+ */
+int
+run_headless(int argc, char *argv[])
+{
+#if HEADLESS_EGL
+    static const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+        EGL_NONE
+    };
+    EGLDisplay display;
+    EGLContext context;
+    GLenum glew_status;
+    struct nk_context *ctx;
+    const char *dump_prefix = NULL;
+    unsigned char *pixels = NULL;
+    float *times;
+    int frames = HEADLESS_FRAMES;
+    int i, frame, pass;
+
+    draw_ui = nk_false;
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--ui") == 0)
+            draw_ui = nk_true;
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            dump_prefix = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc && replay.mode == REPLAY_OFF) {
+            if (!replay_load(argv[++i]))
+                return 1;
+        } else if (atoi(argv[i]) > 0)
+            frames = atoi(argv[i]);
+        else {
+            fprintf(stderr, "usage: main --headless [frames] [--ui] [--dump prefix] [--replay log]\n");
+            return 1;
+        }
+    }
+    /* a replay runs flat out, at the size it was recorded at, for as many frames as it has */
+    if (replay.mode == REPLAY_PLAY) {
+        replay.fast = true;
+        frames = replay.frames;
+    }
+
+    SDL_Init(SDL_INIT_TIMER|SDL_INIT_EVENTS);
+    display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        fprintf(stderr, "Failed to open a surfaceless EGL display\n");
+        return 1;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+    context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "Failed to create a GL 3.3 core context: EGL error 0x%x\n", eglGetError());
+        eglTerminate(display);
+        return 1;
+    }
+
+    /* a GLX build of GLEW loads everything, then finds no X display */
+    glewExperimental = 1;
+    glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (glew_status == GLEW_ERROR_NO_GLX_DISPLAY)
+        glew_status = GLEW_OK;
+#endif
+    if (glew_status != GLEW_OK) {
+        fprintf(stderr, "Failed to setup GLEW\n");
+        return 1;
+    }
+
+    headless.enabled = true;
+    headless.width = replay.mode == REPLAY_PLAY ? replay.width : WINDOW_WIDTH;
+    headless.height = replay.mode == REPLAY_PLAY ? replay.height : WINDOW_HEIGHT;
+    glGenRenderbuffers(1, &headless.color);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, headless.width, headless.height);
+    glGenFramebuffers(1, &headless.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless.fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.color);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+        return 1;
+    }
+
+    init_scene();
+    ctx = init_renderer(NULL);
+    nk_sdl_set_size(headless.width, headless.height);
+    render_on_demand = nk_false;
+
+    times = malloc(sizeof(*times) * (size_t)frames * 2);
+    if (dump_prefix)
+        pixels = malloc((size_t)headless.width * headless.height * 3);
+    if (!times || (dump_prefix && !pixels)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (frame = 0; frame < frames; frame++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (replay.mode != REPLAY_PLAY)
+            spin_cube(frame);
+        MainLoop((void *)ctx);
+        /* the replay stopped early, on SDL_QUIT */
+        if (replay.mode == REPLAY_PLAY && replay.played == frame)
+            break;
+        times[frame] = ticks_to_ms(SDL_GetPerformanceCounter() - start);
+        if (dump_prefix && !dump_frame(dump_prefix, frame, pixels))
+            break;
+    }
+    frames = frame;
+
+    printf("Headless: %d frames at %dx%d%s on %s\n", frames, headless.width, headless.height,
+           draw_ui ? " with UI" : "", (const char *)glGetString(GL_RENDERER));
+    print_frame_times(times, frames);
+    replay_finish();
+    if (frames > 0) {
+        printf("CPU ms:");
+        for (pass = 0; pass < CPU_PASS_COUNT; pass++) {
+            int n = (int)MIN(perf.frames, PERF_HISTORY);
+            double pass_sum = 0.0;
+            for (i = 0; i < n; i++)
+                pass_sum += perf.history[i].cpu_ms[pass];
+            printf(" %s %.3f%s", cpu_pass_names[pass], n ? pass_sum / n : 0.0,
+                   pass + 1 < CPU_PASS_COUNT ? "," : "\n");
+        }
+    }
+    print_render_stats();
+    export_profile();
+
+    free(pixels);
+    free(times);
+    nk_sdl_shutdown();
+    glDeleteFramebuffers(1, &headless.fbo);
+    glDeleteRenderbuffers(1, &headless.color);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    SDL_Quit();
+    return 0;
+#else
+    UNUSED(argc);
+    UNUSED(argv);
+    fprintf(stderr, "Built without headless support (HEADLESS_EGL)\n");
+    return 1;
+#endif
+}
+
+/* ===============================================================
+ *
+ *                          Software renderer
+ *
+ * ===============================================================*/
+
+/*
+ * The CPU counterpart of the draw_* functions: the same vertices, indices
+ * and matrices, queued on raster. color stands in for a fragment shader
+ * that writes a constant, without it the vertices carry their own.
+ */
+static void
+soft_draw(struct soft_raster *raster, enum soft_raster_primitive primitive,
+          const struct ogl_init *init, int stride, hmm_mat4 mvp, const float *color, bool blend)
+{
+    struct soft_raster_draw draw;
+
+    memset(&draw, 0, sizeof(draw));
+    draw.primitive = primitive;
+    memcpy(draw.mvp, &mvp.Elements[0][0], sizeof(draw.mvp));
+    draw.verts = init->verts;
+    draw.stride = stride;
+    draw.color_offset = color ? -1 : 3;
+    if (color)
+        memcpy(draw.color, color, sizeof(draw.color));
+    draw.indices = init->indices;
+    draw.count = (int)(init->indices ? init->index_len / sizeof(GLuint)
+                                     : init->vert_len / (stride * sizeof(GLfloat)));
+    draw.blend = blend;
+    soft_raster_draw(raster, &draw);
+}
+
+/*
+ * The frame seen through obj or, when objective is false, proj, with the
+ * same matrices the calc_*_mvp functions give for the global cameras.
+ */
+static void
+soft_scene_set(struct soft_scene *scene, const struct camera *obj, const struct camera *proj,
+               hmm_mat4 cube_model, hmm_mat4 cam_model, bool objective)
+{
+    const struct camera *cam = objective ? obj : proj;
+
+    scene->grid_mvp = cam->viewproj;
+    scene->cube_mvp = HMM_MultiplyMat4(cam->viewproj, cube_model);
+    scene->frustum_mvp = obj->viewproj;
+    scene->cam_mvp = HMM_MultiplyMat4(obj->viewproj, cam_model);
+    scene->cube_blend = objective;
+    scene->show_frustum = objective && show_cam;
+    memcpy(scene->frustum_verts, frustum_verts, sizeof(scene->frustum_verts));
+    HMM_FrustumCorners(proj->inv_viewproj, scene->frustum_verts, 7);
+}
+
+/* The frame MainLoop would draw now, after update_frame_transforms() */
+void
+soft_scene_current(struct soft_scene *scene)
+{
+    soft_scene_set(scene, &obj_cam, &proj_cam, xform.cube_model, xform.cam_model,
+                   selected_cam == OBJECTIVE_CAM);
+}
+
+/* Queues what the Draw block of MainLoop draws, in the same order */
+void
+soft_draw_scene(struct soft_raster *raster, const struct soft_scene *scene)
+{
+    const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    struct ogl_init frustum = frustum_init;
+
+    soft_raster_clear(raster, black);
+    soft_draw(raster, SOFT_RASTER_LINES, &grid_init, 3, scene->grid_mvp, grid_color, false);
+    soft_draw(raster, SOFT_RASTER_TRIANGLES, &cube_init, 7, scene->cube_mvp, NULL, scene->cube_blend);
+    if (scene->show_frustum) {
+        frustum.verts = scene->frustum_verts;
+        soft_draw(raster, SOFT_RASTER_TRIANGLES, &frustum, 7, scene->frustum_mvp, NULL, true);
+        soft_draw(raster, SOFT_RASTER_TRIANGLES, &cam_init, 3, scene->cam_mvp, cam_color, true);
+    }
+}
+
+/*
+ * bin/main --soft [frames] [--threads n] [--dump prefix]
+ *
+ * Draws the frames --headless would, minus the UI, with the CPU rasterizer
+ * and no GL at all, on n threads or one per CPU.
+ */
+int
+run_soft(int argc, char *argv[])
+{
+    const struct soft_raster_stats *stats;
+    struct soft_scene scene;
+    const char *dump_prefix = NULL;
+    unsigned char *pixels = NULL;
+    float *times;
+    int frames = HEADLESS_FRAMES, threads = 0;
+    int i, frame;
+    double bin_ms = 0.0, raster_ms = 0.0;
+
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            dump_prefix = argv[++i];
+        else if (atoi(argv[i]) > 0)
+            frames = atoi(argv[i]);
+        else {
+            fprintf(stderr, "usage: main --soft [frames] [--threads n] [--dump prefix]\n");
+            return 1;
+        }
+    }
+
+    SDL_Init(SDL_INIT_TIMER);
+    init_scene();
+    cpu_raster = soft_raster_create(WINDOW_WIDTH, WINDOW_HEIGHT, threads);
+    times = malloc(sizeof(*times) * (size_t)frames * 2);
+    if (dump_prefix)
+        pixels = malloc((size_t)WINDOW_WIDTH * WINDOW_HEIGHT * 3);
+    if (!cpu_raster || !times || (dump_prefix && !pixels)) {
+        fprintf(stderr, "Failed to set up the software renderer\n");
+        return 1;
+    }
+    stats = soft_raster_stats(cpu_raster);
+
+    for (frame = 0; frame < frames; frame++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        PROFILE_BEGIN(frame_zone, "frame");
+        spin_cube(frame);
+        update_frame_transforms();
+        soft_scene_current(&scene);
+        soft_draw_scene(cpu_raster, &scene);
+        soft_raster_finish(cpu_raster);
+        PROFILE_END(frame_zone);
+        times[frame] = ticks_to_ms(SDL_GetPerformanceCounter() - start);
+        bin_ms += stats->bin_ms;
+        raster_ms += stats->raster_ms;
+        if (dump_prefix) {
+            soft_raster_read_rgb(cpu_raster, pixels);
+            if (!write_ppm(dump_prefix, frame, WINDOW_WIDTH, WINDOW_HEIGHT, pixels, false))
+                break;
+        }
+    }
+    frames = frame;
+
+    printf("Software: %d frames at %dx%d on %d threads\n", frames, WINDOW_WIDTH, WINDOW_HEIGHT,
+           soft_raster_threads(cpu_raster));
+    print_frame_times(times, frames);
+    if (frames > 0)
+        printf("Raster ms: bin %.3f, tiles %.3f; last frame %lu triangles, %lu lines, "
+               "%lu clipped, %lu tile entries\n", bin_ms / frames, raster_ms / frames,
+               stats->triangles, stats->lines, stats->clipped, stats->bin_entries);
+    export_profile();
+
+    free(pixels);
+    free(times);
+    soft_raster_destroy(cpu_raster);
+    cpu_raster = NULL;
+    SDL_Quit();
+    return 0;
+}
+
+/* ===============================================================
+ *
+ *                          Batch
+ *
+ * ===============================================================*/
+
+/*
+ * value rounded to six decimals, without trailing zeros, written to buf
+ * like format_hundredths does for the matrix display. Very large values
+ * and NaNs go through snprintf. Returns the length.
+ */
+static int
+batch_format_float(float value, char *buf)
+{
+    double magnitude = fabs((double)value);
+    unsigned long long scaled, whole;
+    unsigned int frac;
+    char digits[20];
+    int n = 0, len = 0, places = 6, i;
+
+    if (!(magnitude < 1e12))
+        return snprintf(buf, BATCH_CSV_CELL, "%.9g", value);
+
+    scaled = (unsigned long long)(magnitude * 1e6 + 0.5);
+    whole = scaled / 1000000;
+    frac = (unsigned int)(scaled % 1000000);
+    if (value < 0.0f && scaled)
+        buf[len++] = '-';
+    do {
+        digits[n++] = (char)('0' + whole % 10);
+        whole /= 10;
+    } while (whole);
+    while (n)
+        buf[len++] = digits[--n];
+    if (frac) {
+        buf[len++] = '.';
+        for (; frac % 10 == 0; frac /= 10)
+            places--;
+        for (i = places - 1; i >= 0; i--, frac /= 10)
+            buf[len + i] = (char)('0' + frac % 10);
+        len += places;
+    }
+    return len;
+}
+
+static char *
+batch_reserve(struct batch_worker *w, size_t bytes)
+{
+    int slot = w->slot;
+    size_t need = w->out_len[slot] + bytes;
+
+    if (need > w->out_cap[slot]) {
+        size_t cap = MAX(need, w->out_cap[slot] * 2);
+        char *out = realloc(w->out[slot], cap);
+        if (!out)
+            return NULL;
+        w->out[slot] = out;
+        w->out_cap[slot] = cap;
+    }
+    return w->out[slot] + w->out_len[slot];
+}
+
+/*
+ * Builds the matrices of the first count records in w->in and appends
+ * them to the output. Every step is a batch kernel except the projection
+ * and its inverse, which go through perspective() and HMM_InverseMat4 one
+ * record at a time, so every output has the same bits as the UI's.
+ */
+static bool
+batch_compute(struct batch_worker *w, int count)
+{
+    float (*in)[BATCH_RECORDS] = w->in;
+    hmm_vec3_soa translation = {in[0], in[1], in[2]};
+    hmm_vec3_soa scale = {in[3], in[4], in[5]};
+    hmm_vec3_soa rotation = {in[6], in[7], in[8]};
+    hmm_vec3_soa eye = {in[9], in[10], in[11]};
+    hmm_vec3_soa center = {in[12], in[13], in[14]};
+    hmm_vec3_soa up = {in[15], in[16], in[17]};
+    const hmm_mat4_soa *matrices[4] = {&w->model, &w->view, &w->projection, &w->mvp};
+    int floats = BATCH_OUT_FLOATS + (batch.corners ? BATCH_CORNER_FLOATS : 0);
+    int i, k, m, column, row;
+    char *out;
+
+    /* the same inputs calc_cube_model and update_camera build from */
+    for (k = 6; k < 9; k++)
+        for (i = 0; i < count; i++)
+            in[k][i] *= 30;
+    for (k = 12; k < 15; k++)
+        for (i = 0; i < count; i++)
+            in[k][i] += in[k - 3][i];
+
+    HMM_ComposeTRSEulerBatch(&translation, &rotation, &scale, &w->model, count, HMM_SINCOS_PRECISE);
+    HMM_LookAtBatch(&eye, &center, &up, &w->view, count);
+    for (i = 0; i < count; i++) {
+        hmm_mat4 projection = perspective(in[18][i], in[19][i], in[20][i], in[21][i]);
+        HMM_StoreMat4SoA(&w->projection, i, projection);
+        /* the batched general inverse rounds differently, and far/near
+           ratios in the thousands make that visible in the far corners */
+        if (batch.corners)
+            HMM_StoreMat4SoA(&w->inv_viewproj, i, HMM_InverseMat4(projection, HMM_MAT4_GENERAL));
+    }
+    HMM_MultiplyMat4Batch(&w->projection, &w->view, &w->viewproj, count);
+    HMM_MultiplyMat4Batch(&w->viewproj, &w->model, &w->mvp, count);
+    if (batch.corners) {
+        HMM_InverseMat4Batch(&w->view, &w->inv_view, count, HMM_MAT4_RIGID);
+        HMM_MultiplyMat4Batch(&w->inv_view, &w->inv_viewproj, &w->inv_viewproj, count);
+        HMM_FrustumCornersBatch(&w->inv_viewproj, w->corners, count, 3);
+    }
+
+    if (!batch.csv_out) {
+        float *dst;
+        out = batch_reserve(w, (size_t)count * floats * sizeof(float));
+        if (!out)
+            return false;
+        dst = (float *)out;
+        for (i = 0; i < count; i++) {
+            for (m = 0; m < 4; m++)
+                for (column = 0; column < 4; column++)
+                    for (row = 0; row < 4; row++)
+                        *dst++ = matrices[m]->Elements[column][row][i];
+            if (batch.corners) {
+                memcpy(dst, w->corners + i * BATCH_CORNER_FLOATS, BATCH_CORNER_FLOATS * sizeof(float));
+                dst += BATCH_CORNER_FLOATS;
+            }
+        }
+        w->out_len[w->slot] += (size_t)((char *)dst - out);
+        return true;
+    }
+
+    out = batch_reserve(w, (size_t)count * floats * BATCH_CSV_CELL);
+    if (!out)
+        return false;
+    {
+        char *dst = out;
+        for (i = 0; i < count; i++) {
+            for (m = 0; m < 4; m++)
+                for (column = 0; column < 4; column++)
+                    for (row = 0; row < 4; row++) {
+                        dst += batch_format_float(matrices[m]->Elements[column][row][i], dst);
+                        *dst++ = ',';
+                    }
+            if (batch.corners)
+                for (k = 0; k < BATCH_CORNER_FLOATS; k++) {
+                    dst += batch_format_float(w->corners[i * BATCH_CORNER_FLOATS + k], dst);
+                    *dst++ = ',';
+                }
+            dst[-1] = '\n';
+        }
+        w->out_len[w->slot] += (size_t)(dst - out);
+    }
+    return true;
+}
+
+/*
+ * Parses the CSV line [p, eol) into record n of w->in: 22 numbers split
+ * by commas or blanks. Returns 1 for a record, 0 for a blank or # comment
+ * line and -1 for anything else.
+ */
+static int
+batch_parse_line(struct batch_worker *w, int n, const char *p, const char *eol)
+{
+    char line[BATCH_LINE_MAX];
+    size_t len = (size_t)(eol - p);
+    char *s = line, *end;
+    int k;
+
+    if (len && p[len - 1] == '\r')
+        len--;
+    if (len >= sizeof(line))
+        return -1;
+    memcpy(line, p, len);
+    line[len] = '\0';
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (*s == '\0' || *s == '#')
+        return 0;
+    for (k = 0; k < BATCH_IN_FLOATS; k++) {
+        w->in[k][n] = strtof(s, &end);
+        if (end == s)
+            return -1;
+        for (s = end; *s == ' ' || *s == '\t' || *s == ','; s++)
+            ;
+    }
+    return *s == '\0' ? 1 : -1;
+}
+
+/* Converts this round's piece of the input, stopping at the first bad record */
+static void
+batch_convert(struct batch_worker *w)
+{
+    const size_t record = BATCH_IN_FLOATS * sizeof(float);
+    const char *p = w->begin;
+    int n = 0, k;
+
+    while (p < w->end) {
+        const char *next;
+        if (batch.csv_in) {
+            const char *eol = memchr(p, '\n', (size_t)(w->end - p));
+            int parsed;
+            eol = eol ? eol : w->end;
+            next = eol < w->end ? eol + 1 : eol;
+            parsed = batch_parse_line(w, n, p, eol);
+            if (parsed < 0)
+                break;
+            n += parsed;
+        } else {
+            if ((size_t)(w->end - p) < record)
+                break;
+            for (k = 0; k < BATCH_IN_FLOATS; k++)
+                memcpy(&w->in[k][n], p + k * sizeof(float), sizeof(float));
+            next = p + record;
+            n++;
+        }
+        p = next;
+        if (n == BATCH_RECORDS) {
+            if (!batch_compute(w, n)) {
+                w->failed = true;
+                return;
+            }
+            w->records += n;
+            n = 0;
+        }
+    }
+    if (n && !batch_compute(w, n)) {
+        w->failed = true;
+        return;
+    }
+    w->records += n;
+    if (p < w->end)
+        w->bad_at = w->offset + (p - w->begin);
+}
+
+static int
+batch_worker_main(void *data)
+{
+    struct batch_worker *w = data;
+
+    for (;;) {
+        SDL_SemWait(w->start);
+        if (batch.quit)
+            break;
+        batch_convert(w);
+        SDL_SemPost(batch.done);
+    }
+    return 0;
+}
+
+/*
+ * Returns the number of bytes after the last whole record in [data,
+ * data + len), or 0 when there is no whole record in there, in which
+ * case the caller takes everything and lets the workers complain.
+ */
+static size_t
+batch_partial_tail(const char *data, size_t len)
+{
+    size_t cut;
+
+    if (!batch.csv_in)
+        return len % (BATCH_IN_FLOATS * sizeof(float));
+    for (cut = len; cut > 0 && data[cut - 1] != '\n'; cut--)
+        ;
+    return cut ? len - cut : 0;
+}
+
+/*
+ * Points *data at the next round of input, at most max bytes that end
+ * with a whole record unless the input does, and returns its length, 0
+ * at the end of the input.
+ */
+static size_t
+batch_next_round(struct batch_input *in, int slot, size_t max, const char **data)
+{
+    size_t len;
+
+    if (in->map) {
+        len = MIN(max, in->map_len - in->pos);
+        *data = in->map + in->pos;
+        if (in->pos + len < in->map_len)
+            len -= batch_partial_tail(*data, len);
+        in->pos += len;
+    } else {
+        char *buf = in->buf[slot];
+        if (in->carry_len)
+            memcpy(buf, in->carry, in->carry_len);
+        len = in->carry_len;
+        while (len < in->cap && !in->eof) {
+            size_t got = fread(buf + len, 1, in->cap - len, in->file);
+            len += got;
+            in->eof = got == 0;
+        }
+        in->carry_len = in->eof ? 0 : batch_partial_tail(buf, len);
+        len -= in->carry_len;
+        in->carry = buf + len;
+        *data = buf;
+    }
+    in->offset += (long long)len;
+    return len;
+}
+
+/* Hands each worker an equal share of the round, cut at record boundaries */
+static void
+batch_start_round(const char *data, size_t len, long long offset, int slot)
+{
+    const size_t record = BATCH_IN_FLOATS * sizeof(float);
+    size_t share = (len + (size_t)batch.threads - 1) / (size_t)batch.threads;
+    const char *p = data, *end = data + len;
+    int i;
+
+    if (!batch.csv_in)
+        share = (share + record - 1) / record * record;
+    for (i = 0; i < batch.threads; i++) {
+        struct batch_worker *w = &batch.workers[i];
+        const char *q = p + MIN(share, (size_t)(end - p));
+        if (batch.csv_in && q < end) {
+            q = memchr(q, '\n', (size_t)(end - q));
+            q = q ? q + 1 : end;
+        }
+        w->begin = p;
+        w->end = i == batch.threads - 1 ? end : q;
+        w->offset = offset + (p - data);
+        w->bad_at = -1;
+        w->failed = false;
+        w->records = 0;
+        w->slot = slot;
+        w->out_len[slot] = 0;
+        SDL_SemPost(w->start);
+        p = w->end;
+    }
+}
+
+/* Writes what the first workers converted into out[slot], in input order */
+static bool
+batch_write(FILE *out, int slot, int workers)
+{
+    int i;
+    for (i = 0; i < workers; i++) {
+        struct batch_worker *w = &batch.workers[i];
+        if (w->out_len[slot] && fwrite(w->out[slot], 1, w->out_len[slot], out) != w->out_len[slot])
+            return false;
+    }
+    return fflush(out) == 0;
+}
+
+static bool
+batch_open_input(struct batch_input *in, const char *path, size_t round_max)
+{
+    memset(in, 0, sizeof(*in));
+#if BATCH_MMAP
+    if (path) {
+        struct stat st;
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+                in->map = map;
+                in->map_len = (size_t)st.st_size;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+        if (in->map)
+            return true;
+    }
+#endif
+    in->file = path ? fopen(path, "rb") : stdin;
+    in->cap = round_max;
+    in->buf[0] = malloc(round_max);
+    in->buf[1] = malloc(round_max);
+    return in->file && in->buf[0] && in->buf[1];
+}
+
+static void
+batch_close_input(struct batch_input *in)
+{
+#if BATCH_MMAP
+    if (in->map)
+        munmap((void *)in->map, in->map_len);
+#endif
+    if (in->file && in->file != stdin)
+        fclose(in->file);
+    free(in->buf[0]);
+    free(in->buf[1]);
+}
+
+static bool
+batch_create_workers(int threads)
+{
+    int i, m;
+
+    batch.threads = threads;
+    batch.workers = calloc((size_t)threads, sizeof(*batch.workers));
+    batch.done = SDL_CreateSemaphore(0);
+    if (!batch.workers || !batch.done)
+        return false;
+    for (i = 0; i < threads; i++) {
+        struct batch_worker *w = &batch.workers[i];
+        hmm_mat4_soa *soas[] = {&w->model, &w->view, &w->projection, &w->viewproj,
+                                &w->mvp, &w->inv_view, &w->inv_viewproj};
+        for (m = 0; m < (int)LEN(soas); m++)
+            if (!HMM_AllocMat4SoA(soas[m], BATCH_RECORDS))
+                return false;
+        w->corners = malloc(sizeof(float) * BATCH_RECORDS * BATCH_CORNER_FLOATS);
+        w->start = SDL_CreateSemaphore(0);
+        if (!w->corners || !w->start)
+            return false;
+        w->thread = SDL_CreateThread(batch_worker_main, "batch", w);
+        if (!w->thread)
+            return false;
+    }
+    return true;
+}
+
+static void
+batch_destroy_workers()
+{
+    int i, m;
+
+    batch.quit = true;
+    for (i = 0; batch.workers && i < batch.threads; i++) {
+        struct batch_worker *w = &batch.workers[i];
+        hmm_mat4_soa *soas[] = {&w->model, &w->view, &w->projection, &w->viewproj,
+                                &w->mvp, &w->inv_view, &w->inv_viewproj};
+        if (w->thread) {
+            SDL_SemPost(w->start);
+            SDL_WaitThread(w->thread, NULL);
+        }
+        for (m = 0; m < (int)LEN(soas); m++)
+            HMM_FreeMat4SoA(soas[m]);
+        free(w->corners);
+        free(w->out[0]);
+        free(w->out[1]);
+        if (w->start)
+            SDL_DestroySemaphore(w->start);
+    }
+    free(batch.workers);
+    if (batch.done)
+        SDL_DestroySemaphore(batch.done);
+    memset(&batch, 0, sizeof(batch));
+}
+
+/*
+ * bin/main --batch [input] [--csv-in] [--csv-out] [--corners] [--threads n] [--output file]
+ *
+ * Reads records of 22 floats from input, or stdin, and writes the model,
+ * view, projection and MVP matrices of each one, column-major, optionally
+ * followed by the eight world-space frustum corners of its camera:
+ *
+ *   tx ty tz  sx sy sz  rx ry rz     cube_transform, rotation in 30 degree steps
+ *   eye.xyz  center.xyz  up.xyz      cam_orientation, center is the view direction
+ *   fov aspect near far              cam_perspective, fov in degrees
+ *
+ * Binary records are native floats, CSV records one line each. The main
+ * thread does the reading and writing while the workers convert, and output
+ * keeps the input order.
+ */
+int
+run_batch(int argc, char *argv[])
+{
+    const size_t record = BATCH_IN_FLOATS * sizeof(float);
+    const char *input_path = NULL, *output_path = NULL;
+    const char *data, *next_data = NULL;
+    struct batch_input in;
+    FILE *out = stdout;
+    size_t round_max, len, next_len = 0;
+    long long offset = 0, next_offset, records = 0, pending_records = 0, round_records, bad_at = -1;
+    int threads = 0, slot = 0, i;
+    bool pending = false, failed = false;
+    Uint64 start;
+    double seconds;
+
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--csv-in") == 0)
+            batch.csv_in = true;
+        else if (strcmp(argv[i], "--csv-out") == 0)
+            batch.csv_out = true;
+        else if (strcmp(argv[i], "--corners") == 0)
+            batch.corners = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output_path = argv[++i];
+        else if (!input_path && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0))
+            input_path = strcmp(argv[i], "-") == 0 ? NULL : argv[i];
+        else {
+            fprintf(stderr, "usage: main --batch [input] [--csv-in] [--csv-out] [--corners] "
+                            "[--threads n] [--output file]\n");
+            return 1;
+        }
+    }
+
+    SDL_Init(SDL_INIT_TIMER);
+    if (threads <= 0)
+        threads = SDL_GetCPUCount();
+    threads = MAX(threads, 1);
+    round_max = (size_t)threads * BATCH_PIECE_BYTES;
+    if (!batch.csv_in)
+        round_max -= round_max % record;
+
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    if (!batch_open_input(&in, input_path, round_max)) {
+        fprintf(stderr, "Failed to open %s\n", input_path ? input_path : "stdin");
+        batch_close_input(&in);
+        return 1;
+    }
+    if (output_path)
+        out = fopen(output_path, "wb");
+    if (!out || !batch_create_workers(threads)) {
+        fprintf(stderr, "Failed to set up the batch workers\n");
+        batch_destroy_workers();
+        batch_close_input(&in);
+        return 1;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    len = batch_next_round(&in, slot, round_max, &data);
+    for (;;) {
+        if (len)
+            batch_start_round(data, len, offset, slot);
+        /* the previous round goes out and the next one comes in meanwhile */
+        if (pending) {
+            if (batch_write(out, slot ^ 1, batch.threads)) {
+                records += pending_records;
+            } else {
+                fprintf(stderr, "Failed to write %s\n", output_path ? output_path : "stdout");
+                failed = true;
+            }
+        }
+        if (!len)
+            break;
+        next_offset = in.offset;
+        if (!failed)
+            next_len = batch_next_round(&in, slot ^ 1, round_max, &next_data);
+        for (i = 0; i < batch.threads; i++)
+            SDL_SemWait(batch.done);
+        for (i = 0; i < batch.threads; i++) {
+            if (batch.workers[i].failed) {
+                fprintf(stderr, "Out of memory converting records\n");
+                failed = true;
+                break;
+            }
+        }
+        round_records = 0;
+        for (i = 0; i < batch.threads && bad_at < 0; i++) {
+            bad_at = batch.workers[i].bad_at;
+            round_records += batch.workers[i].records;
+        }
+        /* everything up to the bad record still goes out */
+        if (bad_at >= 0 && !failed) {
+            if (batch_write(out, slot, i)) {
+                records += round_records;
+            } else {
+                fprintf(stderr, "Failed to write %s\n", output_path ? output_path : "stdout");
+                failed = true;
+            }
+        }
+        if (failed || bad_at >= 0)
+            break;
+        pending = true;
+        pending_records = round_records;
+        slot ^= 1;
+        data = next_data;
+        len = next_len;
+        offset = next_offset;
+    }
+    seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+    if (bad_at >= 0)
+        fprintf(stderr, "Malformed or truncated record at byte %lld\n", bad_at);
+    if (in.file && ferror(in.file)) {
+        fprintf(stderr, "Failed to read %s\n", input_path ? input_path : "stdin");
+        failed = true;
+    }
+    fprintf(stderr, "Batch: %lld records in %.3f s, %.2f M records/s on %d threads (%s)\n",
+            records, seconds, seconds > 0.0 ? (double)records / seconds / 1e6 : 0.0,
+            batch.threads, HMM_SIMDLevelName(HMM_SIMDLevel()));
+
+    batch_destroy_workers();
+    batch_close_input(&in);
+    if (out != stdout && fclose(out) != 0)
+        failed = true;
+    SDL_Quit();
+    return failed || bad_at >= 0 ? 1 : 0;
+}
+
+/* ===============================================================
+ *
+ *                          Sweep
+ *
+ * ===============================================================*/
+
+/*
+ * Adds the axis in spec, "name=start:end:steps" for steps evenly spaced
+ * values from start to end or "name=v1,v2,..." for a list.
+ */
+static bool
+sweep_add_axis(const char *spec)
+{
+    const char *eq = strchr(spec, '=');
+    struct sweep_axis *axis = &sweep.axes[sweep.axis_count];
+    char *end;
+    int param, i;
+
+    if (!eq)
+        return false;
+    for (param = 0; param < (int)LEN(sweep_params); param++)
+        if (strlen(sweep_params[param].name) == (size_t)(eq - spec) &&
+            strncmp(sweep_params[param].name, spec, (size_t)(eq - spec)) == 0)
+            break;
+    if (param == (int)LEN(sweep_params))
+        return false;
+    for (i = 0; i < sweep.axis_count; i++)
+        if (sweep.axes[i].param == param)
+            return false;
+
+    axis->param = param;
+    if (strchr(eq, ':')) {
+        float start = strtof(eq + 1, &end), stop;
+        long steps;
+        if (*end != ':')
+            return false;
+        stop = strtof(end + 1, &end);
+        if (*end != ':')
+            return false;
+        steps = strtol(end + 1, &end, 10);
+        if (*end || steps < 1 || steps > INT_MAX)
+            return false;
+        axis->count = (int)steps;
+        axis->values = malloc(sizeof(float) * (size_t)axis->count);
+        if (!axis->values)
+            return false;
+        for (i = 0; i < axis->count; i++)
+            axis->values[i] = steps == 1 ? start : start + (stop - start) * (float)i / (float)(steps - 1);
+    } else {
+        const char *p = eq;
+        axis->count = 1;
+        for (p = strchr(eq, ','); p; p = strchr(p + 1, ','))
+            axis->count++;
+        axis->values = malloc(sizeof(float) * (size_t)axis->count);
+        if (!axis->values)
+            return false;
+        for (i = 0, p = eq; i < axis->count; i++, p = end) {
+            axis->values[i] = strtof(p + 1, &end);
+            if (end == p + 1 || *end != (i + 1 < axis->count ? ',' : '\0')) {
+                free(axis->values);
+                return false;
+            }
+        }
+    }
+    sweep.axis_count++;
+    return true;
+}
+
+static void
+sweep_frame_at(int image, struct sweep_frame *frame)
+{
+    int a;
+
+    frame->cube = cube_transform_init;
+    frame->prsp = proj_cam_prsp_init;
+    for (a = sweep.axis_count - 1; a >= 0; a--) {
+        const struct sweep_axis *axis = &sweep.axes[a];
+        float value = axis->values[image % axis->count];
+        memcpy((char *)frame + sweep_params[axis->param].offset, &value, sizeof(value));
+        image /= axis->count;
+    }
 }
 
-void
-draw_frustum(struct ogl *obj)
+/* prefix + "index.csv": which values each image was rendered with */
+static bool
+sweep_write_index()
 {
-    struct cam_orientation *ornt = &obj_cam_ornt;
-    struct cam_perspective *prsp = &obj_cam_prsp;
-    glUseProgram(obj->program);
+    char path[512];
+    FILE *file;
+    int image, a;
+
+    snprintf(path, sizeof(path), "%sindex.csv", sweep.dump_prefix);
+    file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return false;
+    }
+    fprintf(file, "image");
+    for (a = 0; a < sweep.axis_count; a++)
+        fprintf(file, ",%s", sweep_params[sweep.axes[a].param].name);
+    fprintf(file, "\n");
+    for (image = 0; image < sweep.images; image++) {
+        struct sweep_frame frame;
+        sweep_frame_at(image, &frame);
+        fprintf(file, "%05d", image);
+        for (a = 0; a < sweep.axis_count; a++) {
+            float value;
+            memcpy(&value, (char *)&frame + sweep_params[sweep.axes[a].param].offset, sizeof(value));
+            fprintf(file, ",%g", value);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
 
-    cube_view = HMM_LookAt(ornt->eye, cube_center, ornt->up);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "view"), 1, GL_FALSE, &cube_view.Elements[0][0]);
-    cube_projection = perspective(prsp->fov, prsp->aspect_ratio,prsp->near, prsp->far);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "projection"), 1, GL_FALSE, &cube_projection.Elements[0][0]);
+/*
+ * Draws image with the scene camera's perspective and the cube transform
+ * of its sweep_frame. The eyes of both cameras stay where init_scene()
+ * put them, and the objective camera takes the aspect of the image.
+ */
+static void
+sweep_render(struct sweep_worker *w, int image)
+{
+    struct cam_perspective obj_prsp = obj_cam_prsp;
+    struct sweep_frame frame;
+    struct camera obj, proj;
+    struct soft_scene scene;
+
+    sweep_frame_at(image, &frame);
+    obj_prsp.aspect_ratio = (float)sweep.width / (float)sweep.height;
+    calc_camera(&obj, &obj_cam_ornt_init, &obj_prsp);
+    calc_camera(&proj, &proj_cam_ornt_init, &frame.prsp);
+    soft_scene_set(&scene, &obj, &proj, calc_cube_model(&frame.cube),
+                   calc_cam_model(proj_cam_ornt_init.eye), !sweep.through);
+    soft_draw_scene(w->raster, &scene);
+    soft_raster_finish(w->raster);
+}
 
-    glBindVertexArray(obj->VAO);
+static int
+sweep_worker_main(void *data)
+{
+    struct sweep_worker *w = data;
+    int image;
+
+    while (!SDL_AtomicGet(&sweep.failed) && (image = SDL_AtomicAdd(&sweep.next, 1)) < sweep.images) {
+        sweep_render(w, image);
+        if (!sweep.dump_prefix)
+            continue;
+        soft_raster_read_rgb(w->raster, w->rgb);
+        if (!write_ppm(sweep.dump_prefix, image, sweep.width, sweep.height, w->rgb, false))
+            SDL_AtomicSet(&sweep.failed, 1);
+    }
+    return 0;
+}
 
-    glDrawElements(GL_TRIANGLES, obj->init_data->index_len, GL_UNSIGNED_INT, 0);
+/*
+ * Renders the whole sweep on count threads. Each holds one image at a
+ * time and writes it out itself, so memory stays at count frames however
+ * long the sweep is. Returns the seconds it took, or -1 on failure.
+ */
+static double
+sweep_run(int count)
+{
+    struct sweep_worker *workers = calloc((size_t)count, sizeof(*workers));
+    size_t frame_bytes = (size_t)sweep.width * (size_t)sweep.height * 3;
+    double seconds = -1.0;
+    Uint64 start;
+    int i, started = 0;
+
+    SDL_AtomicSet(&sweep.next, 0);
+    SDL_AtomicSet(&sweep.failed, 0);
+    for (i = 0; workers && i < count; i++) {
+        workers[i].raster = soft_raster_create(sweep.width, sweep.height, 1);
+        workers[i].rgb = sweep.dump_prefix ? malloc(frame_bytes) : NULL;
+        if (!workers[i].raster || (sweep.dump_prefix && !workers[i].rgb))
+            break;
+    }
+    if (workers && i == count) {
+        start = SDL_GetPerformanceCounter();
+        for (started = 0; started < count; started++) {
+            workers[started].thread = SDL_CreateThread(sweep_worker_main, "sweep", &workers[started]);
+            if (!workers[started].thread) {
+                SDL_AtomicSet(&sweep.failed, 1);
+                break;
+            }
+        }
+        for (i = 0; i < started; i++)
+            SDL_WaitThread(workers[i].thread, NULL);
+        if (!SDL_AtomicGet(&sweep.failed))
+            seconds = bench_seconds(start);
+    }
 
-    glBindVertexArray(0);
+    for (i = 0; workers && i < count; i++) {
+        if (workers[i].raster)
+            soft_raster_destroy(workers[i].raster);
+        free(workers[i].rgb);
+    }
+    free(workers);
+    return seconds;
 }
 
-void
-draw_grid(struct ogl *obj, struct cam_orientation *ornt, struct cam_perspective *prsp)
+/*
+ * bin/main --sweep name=start:end:steps|name=v1,v2,... ... [--through]
+ *                  [--size WxH] [--threads n] [--scaling] [--dump prefix]
+ *
+ * Renders one image for every combination of the swept values with the
+ * software renderer, on n threads or one per CPU. --scaling renders the
+ * sweep again at 1, 2, 4... threads up to n to show how it scales.
+ */
+int
+run_sweep(int argc, char *argv[])
 {
-    glDisable(GL_BLEND);
-    glUseProgram(obj->program);
+    long long images = 1;
+    int threads = 0, i, count;
+    bool scaling = false;
+    double base = 0.0, seconds;
+    int result = 0;
+
+    sweep.width = WINDOW_WIDTH / 2;
+    sweep.height = WINDOW_HEIGHT / 2;
+    for (i = 0; i < argc; i++) {
+        bool ok = true;
+        if (strcmp(argv[i], "--through") == 0)
+            sweep.through = true;
+        else if (strcmp(argv[i], "--scaling") == 0)
+            scaling = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            sweep.dump_prefix = argv[++i];
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            ok = sscanf(argv[++i], "%dx%d", &sweep.width, &sweep.height) == 2 &&
+                 sweep.width > 0 && sweep.height > 0;
+        else
+            ok = argv[i][0] != '-' && sweep_add_axis(argv[i]);
+        if (!ok) {
+            fprintf(stderr, "usage: main --sweep name=start:end:steps|name=v1,v2,... ... [--through] "
+                            "[--size WxH] [--threads n] [--scaling] [--dump prefix]\n"
+                            "names:");
+            for (count = 0; count < (int)LEN(sweep_params); count++)
+                fprintf(stderr, " %s", sweep_params[count].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < sweep.axis_count && images <= INT_MAX; i++)
+        images *= sweep.axes[i].count;
+    if (images > INT_MAX) {
+        fprintf(stderr, "A sweep can have at most %d images\n", INT_MAX);
+        return 1;
+    }
+    sweep.images = (int)images;
+
+    SDL_Init(SDL_INIT_TIMER);
+    init_scene();
+    if (threads <= 0)
+        threads = MAX(SDL_GetCPUCount(), 1);
+    if (sweep.dump_prefix && !sweep_write_index())
+        return 1;
+
+    printf("Sweep: %d images at %dx%d, through the %s camera\n", sweep.images, sweep.width,
+           sweep.height, sweep.through ? "scene" : "objective");
+    for (count = scaling ? 1 : threads;; count = MIN(count * 2, threads)) {
+        seconds = sweep_run(count);
+        if (seconds < 0.0) {
+            fprintf(stderr, "Sweep failed on %d threads\n", count);
+            result = 1;
+            break;
+        }
+        if (base == 0.0)
+            base = seconds;
+        printf("  %2d threads  %8.3f s  %8.1f images/s  x%.2f\n", count, seconds,
+               seconds > 0.0 ? sweep.images / seconds : 0.0, seconds > 0.0 ? base / seconds : 0.0);
+        if (count == threads)
+            break;
+    }
+    export_profile();
+    profile_shutdown();
 
-    hmm_mat4 view, projection;
-    hmm_vec3 center;
-    center = HMM_AddVec3(ornt->center, ornt->eye);
+    for (i = 0; i < sweep.axis_count; i++)
+        free(sweep.axes[i].values);
+    SDL_Quit();
+    return result;
+}
 
-    view = HMM_LookAt(ornt->eye, center, ornt->up);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "view"), 1, GL_FALSE, &view.Elements[0][0]);
-    projection = perspective(prsp->fov, prsp->aspect_ratio,prsp->near, prsp->far);
-    glUniformMatrix4fv(glGetUniformLocation(obj->program, "projection"), 1, GL_FALSE, &projection.Elements[0][0]);
+/* ===============================================================
+ *
+ *                          Record and replay
+ *
+ * ===============================================================*/
 
-    glBindVertexArray(obj->VAO);
-    glDrawArrays(GL_LINES, 0, (obj->init_data->vert_len) / 3);
+/* Hands out the next bytes of the log being played, or skips them when dst is NULL */
+static bool
+replay_take(void *dst, size_t bytes)
+{
+    if (replay.size - replay.pos < bytes)
+        return false;
+    if (dst)
+        memcpy(dst, replay.data + replay.pos, bytes);
+    replay.pos += bytes;
+    return true;
+}
+
+/* Adds to the events of the frame being recorded */
+static bool
+replay_append(const void *bytes, size_t len)
+{
+    if (replay.size + len > replay.capacity) {
+        size_t capacity = MAX(replay.capacity * 2, replay.size + len + 4096);
+        unsigned char *data = realloc(replay.data, capacity);
+        if (!data)
+            return false;
+        replay.data = data;
+        replay.capacity = capacity;
+    }
+    if (len)
+        memcpy(replay.data + replay.size, bytes, len);
+    replay.size += len;
+    return true;
+}
+
+static void
+replay_stop_recording(const char *why)
+{
+    fprintf(stderr, "Stopped recording to %s: %s\n", replay.path, why);
+    fclose(replay.file);
+    replay.file = NULL;
+    replay.mode = REPLAY_OFF;
 }
 
+static void
+replay_get_controls(struct replay_controls *controls)
+{
+    memset(controls, 0, sizeof(*controls));
+    controls->cube = cube_transform;
+    controls->proj_ornt = proj_cam_ornt;
+    controls->obj_ornt = obj_cam_ornt;
+    controls->proj_prsp = proj_cam_prsp;
+    controls->yaw = yaw;
+    controls->pitch = pitch;
+    controls->selected_cam = (Sint32)selected_cam;
+    controls->show_cam = show_cam;
+    controls->live_counters = live_counters;
+    controls->cached_ui = cached_ui;
+    controls->render_on_demand = render_on_demand;
+    controls->show_perf = show_perf;
+}
+
+static void
+replay_set_controls(const struct replay_controls *controls)
+{
+    cube_transform = controls->cube;
+    proj_cam_ornt = controls->proj_ornt;
+    obj_cam_ornt = controls->obj_ornt;
+    proj_cam_prsp = controls->proj_prsp;
+    yaw = controls->yaw;
+    pitch = controls->pitch;
+    selected_cam = (enum cam)controls->selected_cam;
+    show_cam = controls->show_cam;
+    live_counters = controls->live_counters;
+    cached_ui = controls->cached_ui;
+    render_on_demand = controls->render_on_demand;
+    show_perf = controls->show_perf;
+}
+
+/*
+ * Reads a --record log into memory to be played, and counts its whole
+ * frames. A log cut short by a crash plays up to its last whole frame.
+ */
+bool
+replay_load(const char *path)
+{
+    struct replay_header header;
+    struct replay_frame frame;
+    struct replay_event event;
+    size_t whole;
+    long size;
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        !(replay.data = malloc((size_t)size + 1)) ||
+        fread(replay.data, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        fclose(file);
+        free(replay.data);
+        replay.data = NULL;
+        return false;
+    }
+    fclose(file);
+    replay.size = (size_t)size;
+    replay.pos = 0;
+
+    if (!replay_take(&header, sizeof(header)) || header.magic != REPLAY_MAGIC ||
+        header.version != REPLAY_VERSION || header.width <= 0 || header.height <= 0) {
+        fprintf(stderr, "%s is not a version %d --record log\n", path, REPLAY_VERSION);
+        free(replay.data);
+        replay.data = NULL;
+        return false;
+    }
+    replay.width = header.width;
+    replay.height = header.height;
+
+    whole = replay.pos;
+    while (replay_take(&frame, sizeof(frame))) {
+        bool ok = replay.frames > 0 || frame.has_controls;
+        Uint32 i;
+        for (i = 0; ok && i < frame.events; i++)
+            ok = replay_take(&event, sizeof(event)) &&
+                 event.text_len < SDL_TEXTINPUTEVENT_TEXT_SIZE && replay_take(NULL, event.text_len);
+        if (!ok || (frame.has_controls && !replay_take(NULL, sizeof(struct replay_controls))))
+            break;
+        whole = replay.pos;
+        replay.recorded_ms = frame.ms;
+        replay.frames++;
+    }
+    if (whole < replay.size)
+        fprintf(stderr, "%s: ignoring %lu bytes after frame %d\n", path,
+                (unsigned long)(replay.size - whole), replay.frames);
+
+    replay.size = whole;
+    replay.pos = sizeof(header);
+    replay.path = path;
+    replay.mode = REPLAY_PLAY;
+    return true;
+}
+
+/* Starts writing a log of the frames to come, for a window of the given size */
+bool
+replay_record(const char *path, int width, int height)
+{
+    struct replay_header header = {REPLAY_MAGIC, REPLAY_VERSION, width, height};
+
+    replay.file = fopen(path, "wb");
+    if (!replay.file || fwrite(&header, sizeof(header), 1, replay.file) != 1) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        if (replay.file)
+            fclose(replay.file);
+        replay.file = NULL;
+        return false;
+    }
+    replay.path = path;
+    replay.mode = REPLAY_RECORD;
+    replay.start_ticks = SDL_GetTicks();
+    return true;
+}
+
+/*
+ * Starts a frame. Recording, it notes the time. Playing, it loads the next
+ * frame of the log and, without --fast, waits until as long after the first
+ * frame as it was recorded. Real input is dropped meanwhile, except for
+ * closing the window. Returns false once the replay is over.
+ */
+bool
+replay_begin_frame()
+{
+    SDL_Event evt;
+    Uint32 now;
+
+    if (replay.mode == REPLAY_RECORD) {
+        memset(&replay.frame, 0, sizeof(replay.frame));
+        replay.frame.ms = SDL_GetTicks() - replay.start_ticks;
+        replay.size = 0;
+        return true;
+    }
+
+    while (SDL_PollEvent(&evt))
+        if (evt.type == SDL_QUIT)
+            return false;
+    if (replay.played == replay.frames)
+        return false;
+    if (replay.played == 0) {
+        replay.start_ticks = SDL_GetTicks();
+        replay.start_counter = SDL_GetPerformanceCounter();
+    }
+    replay_take(&replay.frame, sizeof(replay.frame));
+    replay.events_left = replay.frame.events;
+    replay.played++;
+
+    now = SDL_GetTicks() - replay.start_ticks;
+    if (!replay.fast && replay.frame.ms > now)
+        SDL_Delay(replay.frame.ms - now);
+    return true;
+}
+
+/* The next event of the frame being played, like SDL_PollEvent */
+int
+replay_read_event(SDL_Event *evt)
+{
+    struct replay_event event;
+    bool down;
+
+    if (!replay.events_left)
+        return 0;
+    replay.events_left--;
+    replay_take(&event, sizeof(event));
+    memset(evt, 0, sizeof(*evt));
+    replay_take(event.kind == REPLAY_TEXT ? evt->text.text : NULL, event.text_len);
+    down = event.kind == REPLAY_KEY_DOWN || event.kind == REPLAY_BUTTON_DOWN;
+
+    switch (event.kind)
+    {
+    case REPLAY_QUIT:
+        evt->type = SDL_QUIT;
+        break;
+    case REPLAY_KEY_DOWN:
+    case REPLAY_KEY_UP:
+        evt->type = down ? SDL_KEYDOWN : SDL_KEYUP;
+        evt->key.state = down ? SDL_PRESSED : SDL_RELEASED;
+        evt->key.repeat = event.code;
+        evt->key.keysym.sym = event.sym;
+        evt->key.keysym.scancode = (SDL_Scancode)event.scancode;
+        evt->key.keysym.mod = event.mod;
+        break;
+    case REPLAY_BUTTON_DOWN:
+    case REPLAY_BUTTON_UP:
+        evt->type = down ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+        evt->button.state = down ? SDL_PRESSED : SDL_RELEASED;
+        evt->button.button = event.code;
+        evt->button.clicks = event.state;
+        evt->button.x = event.x;
+        evt->button.y = event.y;
+        break;
+    case REPLAY_MOTION:
+        evt->type = SDL_MOUSEMOTION;
+        evt->motion.state = event.state;
+        evt->motion.x = event.x;
+        evt->motion.y = event.y;
+        evt->motion.xrel = event.xrel;
+        evt->motion.yrel = event.yrel;
+        break;
+    case REPLAY_WHEEL:
+        evt->type = SDL_MOUSEWHEEL;
+        evt->wheel.x = event.x;
+        evt->wheel.y = event.y;
+        evt->wheel.direction = event.state;
+        break;
+    case REPLAY_TEXT:
+        evt->type = SDL_TEXTINPUT;
+        break;
+    }
+    evt->common.timestamp = SDL_GetTicks();
+    return 1;
+}
+
+/* Adds evt to the frame being recorded, if it is one MainLoop or the UI uses */
 void
-just_draw_it(struct ogl *obj, struct cam_orientation *ornt, struct cam_perspective *prsp)
+replay_record_event(const SDL_Event *evt)
 {
-    glUseProgram(obj->program);
-    hmm_mat4 mvp;
-    mvp = calc_grid_mvp( ornt,prsp );
-    glUniformMatrix4fv(obj->matrixID, 1, GL_FALSE, mvp.Elements[0]);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, obj->VBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj->IBO);
+    struct replay_event event;
+    size_t text_len = 0;
 
-    glVertexAttribPointer(0,
-                          3, GL_FLOAT, GL_FALSE,
-                          3 * sizeof(float), 0);
-    glDrawArrays(GL_LINES, 0, (obj->init_data->vert_len) / 3);
-    glDisableVertexAttribArray(0);
+    memset(&event, 0, sizeof(event));
+    switch (evt->type)
+    {
+    case SDL_QUIT:
+        event.kind = REPLAY_QUIT;
+        break;
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+        event.kind = evt->type == SDL_KEYDOWN ? REPLAY_KEY_DOWN : REPLAY_KEY_UP;
+        event.code = evt->key.repeat;
+        event.sym = evt->key.keysym.sym;
+        event.scancode = (Uint16)evt->key.keysym.scancode;
+        event.mod = evt->key.keysym.mod;
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        event.kind = evt->type == SDL_MOUSEBUTTONDOWN ? REPLAY_BUTTON_DOWN : REPLAY_BUTTON_UP;
+        event.code = evt->button.button;
+        event.state = evt->button.clicks;
+        event.x = (Sint16)evt->button.x;
+        event.y = (Sint16)evt->button.y;
+        break;
+    case SDL_MOUSEMOTION:
+        event.kind = REPLAY_MOTION;
+        event.state = (Uint8)evt->motion.state;
+        event.x = (Sint16)evt->motion.x;
+        event.y = (Sint16)evt->motion.y;
+        event.xrel = (Sint16)evt->motion.xrel;
+        event.yrel = (Sint16)evt->motion.yrel;
+        break;
+    case SDL_MOUSEWHEEL:
+        event.kind = REPLAY_WHEEL;
+        event.state = (Uint8)evt->wheel.direction;
+        event.x = (Sint16)evt->wheel.x;
+        event.y = (Sint16)evt->wheel.y;
+        break;
+    case SDL_TEXTINPUT:
+        event.kind = REPLAY_TEXT;
+        text_len = strlen(evt->text.text);
+        event.text_len = (Uint8)text_len;
+        break;
+    default:
+        return;
+    }
+    if (!replay_append(&event, sizeof(event)) || !replay_append(evt->text.text, text_len)) {
+        replay_stop_recording("out of memory");
+        return;
+    }
+    replay.frame.events++;
+}
+
+/*
+ * Runs once the UI is done with a frame. Recording, it writes the frame,
+ * with the controls if they changed. Playing, it puts back the logged
+ * controls, so that every build draws the same scenes from one log even
+ * when its UI would have come out differently; such frames are counted.
+ */
+void
+replay_sync_controls()
+{
+    struct replay_controls controls;
+
+    replay_get_controls(&controls);
+    if (replay.mode == REPLAY_RECORD) {
+        replay.frame.has_controls = replay.frames == 0 ||
+            memcmp(&controls, &replay.controls, sizeof(controls)) != 0;
+        if (fwrite(&replay.frame, sizeof(replay.frame), 1, replay.file) != 1 ||
+            (replay.size && fwrite(replay.data, replay.size, 1, replay.file) != 1) ||
+            (replay.frame.has_controls && fwrite(&controls, sizeof(controls), 1, replay.file) != 1)) {
+            replay_stop_recording("write failed");
+            return;
+        }
+        replay.controls = controls;
+        replay.recorded_ms = replay.frame.ms;
+        replay.frames++;
+        return;
+    }
+
+    if (replay.frame.has_controls)
+        replay_take(&replay.controls, sizeof(replay.controls));
+    if (memcmp(&controls, &replay.controls, sizeof(controls)) != 0) {
+        replay.diverged++;
+        replay_set_controls(&replay.controls);
+    }
 }
 
+/* Closes the log being recorded, or reports how long the replay took */
+void
+replay_finish()
+{
+    if (replay.mode == REPLAY_RECORD) {
+        if (fclose(replay.file) != 0)
+            fprintf(stderr, "Failed to write %s\n", replay.path);
+        else
+            printf("Recorded %d frames over %.3f s to %s\n", replay.frames,
+                   replay.recorded_ms / 1000.0, replay.path);
+    } else if (replay.mode == REPLAY_PLAY) {
+        double seconds = replay.played
+            ? (double)(SDL_GetPerformanceCounter() - replay.start_counter) / (double)SDL_GetPerformanceFrequency()
+            : 0.0;
+        printf("Replay: %d of %d frames in %.3f s, %.3f ms per frame (recorded over %.3f s), "
+               "%lu frames with other UI values\n", replay.played, replay.frames, seconds,
+               replay.played ? seconds * 1000.0 / replay.played : 0.0,
+               replay.recorded_ms / 1000.0, replay.diverged);
+    }
+    free(replay.data);
+    replay.data = NULL;
+    replay.file = NULL;
+    replay.mode = REPLAY_OFF;
+}
 
 /* ===============================================================
  *
@@ -1142,22 +4307,129 @@ bool lc_down = false;
 
 static int foo = 0;
 
+unsigned long
+xform_rebuilt_total()
+{
+    unsigned long total = 0;
+    int slot;
+    for (slot = 0; slot < XFORM_COUNT; slot++)
+        total += xform.rebuilt[slot];
+    return total;
+}
+
+/*
+ * Moves the eye for every WASD key held right now, by MOVESPEED times the
+ * time since the previous frame. Returns whether it moved. A replay takes
+ * both the keys and the time from the log instead.
+ */
+bool
+update_movement()
+{
+    hmm_vec3 forward = obj_cam_ornt.center;
+    hmm_vec3 left = HMM_NormalizeVec3(HMM_Cross(obj_cam_ornt.center, obj_cam_ornt.up));
+    hmm_vec3 step = HMM_Vec3(0.0f, 0.0f, 0.0f);
+    bool moved = false;
+    int keys;
+
+    if (replay.mode == REPLAY_PLAY) {
+        keys = replay.frame.keys;
+        movement.dt = replay.frame.dt;
+    } else {
+        const Uint8 *state = SDL_GetKeyboardState(NULL);
+        Uint64 now = SDL_GetPerformanceCounter();
+
+        movement.dt = movement.last_counter
+            ? (float)((double)(now - movement.last_counter) / (double)SDL_GetPerformanceFrequency())
+            : 0.0f;
+        movement.dt = MIN(movement.dt, MAX_FRAME_DT);
+        movement.last_counter = now;
+        keys = (state[SDL_SCANCODE_W] ? MOVE_FORWARD : 0) | (state[SDL_SCANCODE_S] ? MOVE_BACK : 0) |
+               (state[SDL_SCANCODE_D] ? MOVE_RIGHT : 0) | (state[SDL_SCANCODE_A] ? MOVE_LEFT : 0);
+        if (replay.mode == REPLAY_RECORD) {
+            replay.frame.keys = (Uint8)keys;
+            replay.frame.dt = movement.dt;
+        }
+    }
+
+    if (keys & MOVE_FORWARD) { step = HMM_AddVec3(step, forward); moved = true; }
+    if (keys & MOVE_BACK) { step = HMM_SubtractVec3(step, forward); moved = true; }
+    if (keys & MOVE_RIGHT) { step = HMM_AddVec3(step, left); moved = true; }
+    if (keys & MOVE_LEFT) { step = HMM_SubtractVec3(step, left); moved = true; }
+    if (moved)
+        obj_cam_ornt.eye = HMM_AddVec3(obj_cam_ornt.eye,
+                                       HMM_MultiplyVec3f(step, MOVESPEED * movement.dt));
+    return moved;
+}
+
+/*
+ * Blocks until an event arrives or IDLE_TIMEOUT_MS pass, timing the wait.
+ * Movement's clock restarts: the frame that wakes takes no step.
+ */
+int
+idle_wait(SDL_Event *evt)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    clock_t cpu = clock();
+    int got = SDL_WaitEventTimeout(evt, IDLE_TIMEOUT_MS);
+
+    idle.wait_seconds += (double)(SDL_GetPerformanceCounter() - start)
+        / (double)SDL_GetPerformanceFrequency();
+    idle.wait_cpu_seconds += (double)(clock() - cpu) / CLOCKS_PER_SEC;
+    idle.waits++;
+    if (!got)
+        idle.timeouts++;
+    /* a key that ends the wait has been held for no time, not for the wait */
+    movement.last_counter = 0;
+    return got;
+}
+
+/* Writes the profiler's retained zones out for chrome://tracing */
+void
+export_profile()
+{
+    long zones = profile_export_chrome(PROFILE_TRACE_PATH);
+    if (zones < 0)
+        fprintf(stderr, "Failed to write %s\n", PROFILE_TRACE_PATH);
+    else if (zones > 0)
+        printf("Profile: wrote %ld zones to %s\n", zones, PROFILE_TRACE_PATH);
+}
+
 void
 MainLoop(void *loopArg)
 {
-    set_frustum_verts();
-    update_frustum_buffer();
     //glDebugStuff();
     struct nk_context *ctx = (struct nk_context *)loopArg;
-    int x, y;
-    int lastx, lasty;
 
     /* Input */
     SDL_Event evt;
+    int pending = 0, events = 0;
+    bool moved;
+    unsigned long ui_converted = nk_sdl_frame_stats()->converted;
+    unsigned long rebuilt = xform_rebuilt_total();
+
+    if (render_on_demand && idle.frames >= IDLE_SETTLE_FRAMES && replay.mode != REPLAY_PLAY) {
+        PROFILE_BEGIN(wait_zone, "idle wait");
+        pending = idle_wait(&evt);
+        PROFILE_END(wait_zone);
+        if (!pending)
+            return;
+    }
+    if (replay.mode != REPLAY_OFF && !replay_begin_frame()) {
+        running = nk_false;
+        return;
+    }
+    PROFILE_BEGIN(frame_zone, "frame");
+    perf.frame_start = SDL_GetPerformanceCounter();
+    gpu_timers_begin_frame();
+    cpu_pass_begin(CPU_PASS_EVENTS);
     nk_input_begin(ctx);
 
-    while (SDL_PollEvent(&evt))
+    while (pending || (replay.mode == REPLAY_PLAY ? replay_read_event(&evt) : SDL_PollEvent(&evt)))
     {
+        pending = 0;
+        events++;
+        if (replay.mode == REPLAY_RECORD)
+            replay_record_event(&evt);
         switch (evt.type)
         {
         case SDL_QUIT:
@@ -1174,44 +4446,27 @@ MainLoop(void *loopArg)
             case SDLK_q:
                 running = nk_false;
                 break;
-                //TODO: make WASD movement additive
-            case SDLK_w:
-            {
-                hmm_vec3 delta, eye;
-                delta = HMM_MultiplyVec3f(obj_cam_ornt.center,MOVESPEED);
-                eye = HMM_AddVec3(obj_cam_ornt.eye, delta);
-                obj_cam_ornt.eye = eye;
+            case SDLK_p:
+                if (evt.type == SDL_KEYDOWN && !evt.key.repeat)
+                    export_profile();
                 break;
-            }
+            case SDLK_w:
             case SDLK_a:
-            {
-                hmm_vec3 left = HMM_NormalizeVec3(HMM_Cross(obj_cam_ornt.center, obj_cam_ornt.up));
-                hmm_vec3 delta = HMM_MultiplyVec3f(left,MOVESPEED);
-                obj_cam_ornt.eye = HMM_SubtractVec3(obj_cam_ornt.eye, delta);
-                break;
-            }
             case SDLK_s:
-            {
-                hmm_vec3 delta = HMM_MultiplyVec3f(obj_cam_ornt.center,MOVESPEED);
-                obj_cam_ornt.eye = HMM_SubtractVec3(obj_cam_ornt.eye, delta);
-                break;
-            }
             case SDLK_d:
-            {
-                hmm_vec3 left = HMM_NormalizeVec3(HMM_Cross(obj_cam_ornt.center, obj_cam_ornt.up));
-                hmm_vec3 delta = HMM_MultiplyVec3f(left,MOVESPEED);
-                obj_cam_ornt.eye = HMM_AddVec3(obj_cam_ornt.eye, delta);
+                /* the movement itself happens in update_movement */
+                if (evt.type == SDL_KEYDOWN && !evt.key.repeat) {
+                    movement.pressed_at = evt.key.timestamp;
+                    movement.pending = true;
+                }
                 break;
             }
-            }
+            break;
         }
         case SDL_MOUSEBUTTONDOWN:
         {
             if (!nk_window_is_any_hovered(ctx) && !lc_down && evt.button.button == SDL_BUTTON_LEFT)
-            {
-                SDL_GetMouseState(&x, &y);
                 lc_down = true;
-            }
             break;
         }
         case SDL_MOUSEBUTTONUP:
@@ -1221,16 +4476,16 @@ MainLoop(void *loopArg)
         case SDL_MOUSEMOTION:
             if (lc_down == true)
             {
-                lastx = x;
-                lasty = y;
-                SDL_GetMouseState(&x, &y);
-                int xoffset = x - lastx;
-                int yoffset = lasty - y;
+                /* from the event rather than the mouse's state now, so replays match */
+                int xoffset = evt.motion.xrel;
+                int yoffset = -evt.motion.yrel;
                 yaw += (float)xoffset;
                 pitch += (float)yoffset;
-                obj_cam_ornt.center.X = HMM_COSF(HMM_ToRadians(yaw)) * cosf(HMM_ToRadians(pitch));
-                obj_cam_ornt.center.Y = HMM_SINF(HMM_ToRadians(pitch));
-                obj_cam_ornt.center.Z = HMM_SINF(HMM_ToRadians(yaw)) * HMM_COSF(HMM_ToRadians(pitch));
+                hmm_vec3 sin_angles, cos_angles;
+                HMM_SinCosVec3(HMM_Vec3(HMM_ToRadians(yaw), HMM_ToRadians(pitch), 0.0f), &sin_angles, &cos_angles);
+                obj_cam_ornt.center.X = cos_angles.X * cos_angles.Y;
+                obj_cam_ornt.center.Y = sin_angles.Y;
+                obj_cam_ornt.center.Z = sin_angles.X * cos_angles.Y;
                 obj_cam_ornt.center = HMM_NormalizeVec3(obj_cam_ornt.center);
             }
             break;
@@ -1238,6 +4493,10 @@ MainLoop(void *loopArg)
         nk_sdl_handle_event(&evt);
     }
     nk_input_end(ctx);
+    moved = update_movement();
+    cpu_pass_end(CPU_PASS_EVENTS);
+
+    cpu_pass_begin(CPU_PASS_UI);
 
     int window_flags = 0;
     window_flags |= NK_WINDOW_BORDER;
@@ -1337,109 +4596,232 @@ MainLoop(void *loopArg)
                  NK_WINDOW_TITLE | NK_WINDOW_BORDER | NK_WINDOW_MOVABLE |
                  NK_WINDOW_NO_SCROLLBAR | NK_WINDOW_MINIMIZABLE))
     {
-        nk_layout_row_dynamic(ctx, 250, 3);
-
-        nk_group_begin(ctx, "Model", NK_WINDOW_TITLE | NK_WINDOW_BORDER | NK_WINDOW_NO_SCROLLBAR);
-        nk_layout_row_static(ctx, 30, 50, 4);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[0][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[1][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[2][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[3][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[0][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[1][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[2][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[3][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[0][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[1][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[2][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[3][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[0][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[1][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[2][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_model.Elements[3][3]);
-        nk_group_end(ctx);
-
-        nk_group_begin(ctx, "View", NK_WINDOW_TITLE | NK_WINDOW_BORDER | NK_WINDOW_NO_SCROLLBAR);
-        nk_layout_row_static(ctx, 30, 50, 4);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[0][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[1][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[2][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[3][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[0][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[1][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[2][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[3][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[0][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[1][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[2][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[3][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[0][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[1][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[2][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_view.Elements[3][3]);
-        nk_group_end(ctx);
-
-        nk_group_begin(ctx, "Projection", NK_WINDOW_TITLE | NK_WINDOW_BORDER | NK_WINDOW_NO_SCROLLBAR);
-        nk_layout_row_static(ctx, 30, 50, 4);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[0][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[1][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[2][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[3][0]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[0][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[1][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[2][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[3][1]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[0][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[1][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[2][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[3][2]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[0][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[1][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[2][3]);
-        nk_labelf(ctx, NK_TEXT_LEFT, "%0.2f", cube_projection.Elements[3][3]);
+        const hmm_mat4 *cube_model = &xform.cube_model;
+        const struct camera *cam = selected_cam == OBJECTIVE_CAM ? &obj_cam : &proj_cam;
+        nk_layout_row_dynamic(ctx, 250, 4);
+
+        matrix_display_update(&model_display, cube_model);
+        matrix_display_update(&view_display, &cam->view);
+        matrix_display_update(&projection_display, &cam->projection);
+        matrix_display_draw(ctx, "Model", &model_display);
+        matrix_display_draw(ctx, "View", &view_display);
+        matrix_display_draw(ctx, "Projection", &projection_display);
+
+        nk_group_begin(ctx, "Counters", NK_WINDOW_TITLE | NK_WINDOW_BORDER);
+        nk_layout_row_dynamic(ctx, 20, 3);
+        nk_checkbox_label(ctx, "Live", &live_counters);
+        nk_checkbox_label(ctx, "Cache UI", &cached_ui);
+        nk_checkbox_label(ctx, "On demand", &render_on_demand);
+        nk_checkbox_label(ctx, "Perf HUD", &show_perf);
+        nk_layout_row_dynamic(ctx, 20, 3);
+        if (live_counters) {
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "rebuilt", NK_TEXT_RIGHT);
+            nk_label(ctx, "avoided", NK_TEXT_RIGHT);
+            {
+                int slot;
+                for (slot = 0; slot < XFORM_COUNT; slot++) {
+                    nk_label(ctx, xform_slot_names[slot], NK_TEXT_LEFT);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", xform.rebuilt[slot]);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", xform.reused[slot]);
+                }
+                nk_label(ctx, "matrix text", NK_TEXT_LEFT);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", matrix_cells_formatted);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", matrix_cells_kept);
+            }
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "frame", NK_TEXT_RIGHT);
+            nk_label(ctx, "total", NK_TEXT_RIGHT);
+            {
+                int counter;
+                for (counter = 0; counter < GL_COUNTER_COUNT; counter++) {
+                    nk_label(ctx, gl_counter_names[counter], NK_TEXT_LEFT);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", gl_calls.last_frame[counter]);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", gl_calls.total[counter]);
+                }
+            }
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "stalls", NK_TEXT_RIGHT);
+            nk_label(ctx, "orphans", NK_TEXT_RIGHT);
+            {
+                const struct gl_stream_stats *streams[3];
+                const char *stream_names[3] = {"frustum", "UI verts", "UI elems"};
+                int i;
+                streams[0] = &frustum_stream.stats;
+                nk_sdl_stream_stats(&streams[1], &streams[2]);
+                for (i = 0; i < 3; i++) {
+                    nk_label(ctx, stream_names[i], NK_TEXT_LEFT);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", streams[i]->stalls);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", streams[i]->orphans);
+                }
+                nk_label(ctx, "", NK_TEXT_LEFT);
+                nk_label(ctx, "used", NK_TEXT_RIGHT);
+                nk_label(ctx, "peak", NK_TEXT_RIGHT);
+                for (i = 1; i < 3; i++) {
+                    nk_label(ctx, stream_names[i], NK_TEXT_LEFT);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%ldK", (long)streams[i]->used / 1024);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%ldK", (long)streams[i]->high_water / 1024);
+                }
+            }
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "frames", NK_TEXT_RIGHT);
+            nk_label(ctx, "ms", NK_TEXT_RIGHT);
+            {
+                const struct nk_sdl_frame_stats *ui = nk_sdl_frame_stats();
+                nk_label(ctx, "UI convert", NK_TEXT_LEFT);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", ui->converted);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", ui->convert_seconds * 1000.0);
+                nk_label(ctx, "UI reuse", NK_TEXT_LEFT);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", ui->reused);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", ui->hash_seconds * 1000.0);
+                nk_label(ctx, "UI redraw", NK_TEXT_LEFT);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", ui->cache_refreshes);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", ui->render_seconds * 1000.0);
+            }
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "waits", NK_TEXT_RIGHT);
+            nk_label(ctx, "CPU %", NK_TEXT_RIGHT);
+            nk_label(ctx, "idle", NK_TEXT_LEFT);
+            nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", idle.waits);
+            nk_labelf(ctx, NK_TEXT_RIGHT, "%.2f", idle.wait_seconds > 0.0 ?
+                      100.0 * idle.wait_cpu_seconds / idle.wait_seconds : 0.0);
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "latency ms", NK_TEXT_RIGHT);
+            nk_label(ctx, "dt ms", NK_TEXT_RIGHT);
+            nk_label(ctx, "WASD", NK_TEXT_LEFT);
+            nk_labelf(ctx, NK_TEXT_RIGHT, "%u", (unsigned)movement.latency_ms);
+            nk_labelf(ctx, NK_TEXT_RIGHT, "%.2f", movement.dt * 1000.0f);
+#if GL_TRACE
+            nk_label(ctx, "", NK_TEXT_LEFT);
+            nk_label(ctx, "calls", NK_TEXT_RIGHT);
+            nk_label(ctx, "redundant", NK_TEXT_RIGHT);
+            {
+                const struct gl_trace_stats *trace = gl_trace_stats();
+                int call;
+                for (call = 0; call < GL_TRACE_CALL_COUNT; call++) {
+                    nk_label(ctx, trace->names[call], NK_TEXT_LEFT);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", trace->last_frame[call].calls);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%lu", trace->last_frame[call].redundant);
+                }
+            }
+#endif
+            nk_label(ctx, gpu_timers.submit_only ? "submit only" : "", NK_TEXT_LEFT);
+            nk_label(ctx, "last ms", NK_TEXT_RIGHT);
+            nk_label(ctx, "avg ms", NK_TEXT_RIGHT);
+            {
+                int pass;
+                for (pass = 0; pass < GPU_PASS_COUNT; pass++) {
+                    nk_label(ctx, gpu_pass_names[pass], NK_TEXT_LEFT);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", gpu_timers.last_ms[pass]);
+                    nk_labelf(ctx, NK_TEXT_RIGHT, "%.3f", gpu_timers.samples[pass] ?
+                              gpu_timers.total_ms[pass] / (double)gpu_timers.samples[pass] : 0.0);
+                }
+            }
+        }
         nk_group_end(ctx);
     }
     nk_end(ctx);
 
+    if (show_perf)
+        perf_hud_draw(ctx);
+    perf.current.ui_memory = (unsigned long)ctx->memory.allocated;
+    cpu_pass_end(CPU_PASS_UI);
+    if (replay.mode != REPLAY_OFF)
+        replay_sync_controls();
+
+    cpu_pass_begin(CPU_PASS_TRANSFORMS);
+    update_frame_transforms();
+    cpu_pass_end(CPU_PASS_TRANSFORMS);
+
     /* Draw */
     {
         float bg[4];
         int win_width, win_height;
         nk_color_fv(bg, nk_rgb(0, 0, 0));
-        SDL_GetWindowSize(win, &win_width, &win_height);
+        if (headless.enabled) {
+            win_width = headless.width;
+            win_height = headless.height;
+        } else {
+            SDL_GetWindowSize(win, &win_width, &win_height);
+        }
         glViewport(0, 0, win_width, win_height);
         glClear(GL_COLOR_BUFFER_BIT);
         glClearColor(bg[0], bg[1], bg[2], bg[3]);
 
+        cpu_pass_begin(CPU_PASS_SCENE);
+        upload_camera(selected_cam == OBJECTIVE_CAM ? &obj_cam : &proj_cam);
+
         if (selected_cam == OBJECTIVE_CAM)
         {
-            draw_grid(&(objs.grid), &obj_cam_ornt, &obj_cam_prsp);
-            glEnable(GL_BLEND);
+            gpu_timer_begin(GPU_PASS_GRID);
+            draw_grid(&(objs.grid));
+            gpu_timer_end(GPU_PASS_GRID);
+            set_blend(true);
+            gl_count(GL_COUNT_STATE_CHANGES);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            draw_cube(&(objs.cube), &obj_cam_ornt, &obj_cam_prsp);
+            gpu_timer_begin(GPU_PASS_CUBE);
+            draw_cube(&(objs.cube));
+            gpu_timer_end(GPU_PASS_CUBE);
 
             if (show_cam)
             {
+                gpu_timer_begin(GPU_PASS_FRUSTUM);
                 draw_frustum(&(objs.frustum));
+                gpu_timer_end(GPU_PASS_FRUSTUM);
+                gpu_timer_begin(GPU_PASS_CAM);
                 draw_cam(&(objs.cam));
+                gpu_timer_end(GPU_PASS_CAM);
             }
             glFlush();
         }
         else if (selected_cam == PROJECTION_CAM)
         {
-            draw_grid(&(objs.grid), &proj_cam_ornt, &proj_cam_prsp);
-            draw_cube(&(objs.cube), &proj_cam_ornt, &proj_cam_prsp);
+            gpu_timer_begin(GPU_PASS_GRID);
+            draw_grid(&(objs.grid));
+            gpu_timer_end(GPU_PASS_GRID);
+            gpu_timer_begin(GPU_PASS_CUBE);
+            draw_cube(&(objs.cube));
+            gpu_timer_end(GPU_PASS_CUBE);
         }
         glFlush();
+        cpu_pass_end(CPU_PASS_SCENE);
+
+        cpu_pass_begin(CPU_PASS_UI_RENDER);
+        nk_sdl_set_cached(cached_ui);
+        gpu_timer_begin(GPU_PASS_UI);
+        if (draw_ui)
+            nk_sdl_render(NK_ANTI_ALIASING_ON, UI_VERTEX_MEMORY, UI_ELEMENT_MEMORY);
+        else
+            nk_clear(ctx);
+        gpu_timer_end(GPU_PASS_UI);
+        cpu_pass_end(CPU_PASS_UI_RENDER);
+
+        cpu_pass_begin(CPU_PASS_SWAP);
+        if (headless.enabled)
+            glFinish();
+        else
+            SDL_GL_SwapWindow(win);
+        cpu_pass_end(CPU_PASS_SWAP);
+        gl_count_end_frame();
+    }
 
-        nk_sdl_render(NK_ANTI_ALIASING_ON, MAX_VERTEX_MEMORY, MAX_ELEMENT_MEMORY);
-        SDL_GL_SwapWindow(win);
+    /* latency runs to the first frame that took a step, not the one that woke */
+    if (moved && movement.dt > 0.0f && movement.pending) {
+        movement.latency_ms = SDL_GetTicks() - movement.pressed_at;
+        movement.pending = false;
     }
 
+    if (events || moved || nk_sdl_frame_stats()->converted != ui_converted ||
+        xform_rebuilt_total() != rebuilt)
+        idle.frames = 0;
+    else
+        idle.frames++;
+    perf_end_frame();
+    PROFILE_END(frame_zone);
 }
 
-int
-main(int argc, char *argv[])
+void
+init_scene()
 {
     init_objs();
     proj_cam_ornt = proj_cam_ornt_init = (struct cam_orientation){
@@ -1452,12 +4834,94 @@ main(int argc, char *argv[])
         HMM_Vec3(-5.0f, -2.0f, -4.0f),
         HMM_Vec3(0.0f, 1.0f, 0.0f),
     };
+}
 
+/* GL objects and the UI, once a context is current. window may be NULL. */
+struct nk_context *
+init_renderer(SDL_Window *window)
+{
     struct nk_context *ctx;
-    SDL_GLContext glContext;
 
-    NK_UNUSED(argc);
-    NK_UNUSED(argv);
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    init_cube(&(objs.cube), &cube_init);
+    init_cam_gl(&(objs.cam), &cam_init);
+    init_grid(&(objs.grid), &grid_init);
+    init_frustum(&(objs.frustum), &frustum_init);
+    init_camera_ubo();
+    init_gpu_timers();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    ctx = nk_sdl_init(window);
+    {
+        struct nk_font_atlas *atlas;
+        nk_sdl_font_stash_begin(&atlas);
+        nk_sdl_font_stash_end();
+        ;
+    }
+    return ctx;
+}
+
+void
+print_render_stats()
+{
+    const struct nk_sdl_frame_stats *ui = nk_sdl_frame_stats();
+    int pass;
+
+    printf("UI: %lu frames converted, %lu reused, %.3f ms saved per reused frame\n",
+           ui->converted, ui->reused,
+           ui->reused ? ui->saved_seconds * 1000.0 / (double)ui->reused : 0.0);
+    printf("UI: %.3f ms per frame in nk_sdl_render, %lu cached texture redraws\n",
+           ui->frames ? ui->render_seconds_total * 1000.0 / (double)ui->frames : 0.0,
+           ui->cache_refreshes);
+    printf("GPU:");
+    for (pass = 0; pass < GPU_PASS_COUNT; pass++)
+        printf(" %s %.3f ms,", gpu_pass_names[pass] + 4, gpu_timers.samples[pass] ?
+               gpu_timers.total_ms[pass] / (double)gpu_timers.samples[pass] : 0.0);
+    printf(" %lu results dropped%s\n", gpu_timers.dropped,
+           gpu_timers.finish_passes ? ", passes timed with glFinish" :
+           gpu_timers.submit_only ? ", submit times only (" GPU_FINISH_ENV "=1 times passes with glFinish)" : "");
+#if GL_TRACE
+    gl_trace_report(stdout);
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+    HMM_SIMDInit();
+    profile_init();
+    PROFILE_THREAD("main");
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmarks();
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+        return run_headless(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--soft") == 0)
+        return run_soft(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return run_batch(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0)
+        return run_sweep(argc - 2, argv + 2);
+
+    const char *record_path = NULL;
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc && replay.mode == REPLAY_OFF)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc && !record_path && replay.mode == REPLAY_OFF) {
+            if (!replay_load(argv[++i]))
+                return 1;
+        } else if (strcmp(argv[i], "--fast") == 0)
+            replay.fast = true;
+        else {
+            fprintf(stderr, "usage: main [--record log | --replay log [--fast]]\n");
+            return 1;
+        }
+    }
+
+    init_scene();
+
+    struct nk_context *ctx;
+    SDL_GLContext glContext;
 
     SDL_SetHint(SDL_HINT_VIDEO_HIGHDPI_DISABLED, "0");
 
@@ -1469,7 +4933,8 @@ main(int argc, char *argv[])
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     win = SDL_CreateWindow("Demo",
                            SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                           WINDOW_WIDTH, WINDOW_HEIGHT,
+                           replay.mode == REPLAY_PLAY ? replay.width : WINDOW_WIDTH,
+                           replay.mode == REPLAY_PLAY ? replay.height : WINDOW_HEIGHT,
                            SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
     glContext = SDL_GL_CreateContext(win);
 
@@ -1479,24 +4944,32 @@ main(int argc, char *argv[])
         exit(1);
     }
 
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-    init_cube(&(objs.cube), &cube_init);
-    init_cam_gl(&(objs.cam), &cam_init);
-    init_grid(&(objs.grid), &grid_init);
-    init_frustum(&(objs.frustum), &frustum_init);
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-
-    ctx = nk_sdl_init(win);
-    {
-        struct nk_font_atlas *atlas;
-        nk_sdl_font_stash_begin(&atlas);
-        nk_sdl_font_stash_end();
-        ;
+    ctx = init_renderer(win);
+    if (record_path) {
+        int width, height;
+        SDL_GetWindowSize(win, &width, &height);
+        if (!replay_record(record_path, width, height))
+            return 1;
     }
 
+    idle.run_start = SDL_GetPerformanceCounter();
+    idle.run_cpu_start = clock();
     while (running) {
         MainLoop((void *)ctx);
     }
+    {
+        double wall = (double)(SDL_GetPerformanceCounter() - idle.run_start)
+            / (double)SDL_GetPerformanceFrequency();
+        printf("Idle: %.1f s of %.1f s spent waiting for events (%lu waits), "
+               "%.2f%% CPU while idle, %.1f%% CPU overall\n",
+               idle.wait_seconds, wall, idle.waits,
+               idle.wait_seconds > 0.0 ? 100.0 * idle.wait_cpu_seconds / idle.wait_seconds : 0.0,
+               wall > 0.0 ? 100.0 * ((double)(clock() - idle.run_cpu_start) / CLOCKS_PER_SEC) / wall : 0.0);
+    }
+    replay_finish();
+    print_render_stats();
+    export_profile();
+    profile_shutdown();
     nk_sdl_shutdown();
     SDL_GL_DeleteContext(glContext);
     SDL_DestroyWindow(win);
@@ -15,15 +15,34 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
+#include "gl_stream.h"
+
+struct nk_sdl_frame_stats {
+    unsigned long converted;    /* frames tessellated and uploaded */
+    unsigned long reused;       /* frames drawn from the previous frame's buffers */
+    double convert_seconds;     /* last conversion, upload included */
+    double hash_seconds;        /* last command buffer hash */
+    double saved_seconds;       /* conversion minus hash time, over all reused frames */
+    unsigned long cache_refreshes; /* frames drawn into the cached texture */
+    unsigned long frames;
+    double render_seconds;      /* last nk_sdl_render call */
+    double render_seconds_total;
+    unsigned long draws;        /* draw calls made by the last nk_sdl_render */
+    unsigned long upload_bytes; /* vertex and element bytes it wrote, 0 when reused */
+};
 
 NK_API struct nk_context*   nk_sdl_init(SDL_Window *win);
+NK_API void                 nk_sdl_set_size(int width, int height);
 NK_API void                 nk_sdl_font_stash_begin(struct nk_font_atlas **atlas);
 NK_API void                 nk_sdl_font_stash_end(void);
 NK_API int                  nk_sdl_handle_event(SDL_Event *evt);
-NK_API void                 nk_sdl_render(enum nk_anti_aliasing , int max_vertex_buffer, int max_element_buffer);
+NK_API void                 nk_sdl_render(enum nk_anti_aliasing , int init_vertex_buffer, int init_element_buffer);
 NK_API void                 nk_sdl_shutdown(void);
 NK_API void                 nk_sdl_device_destroy(void);
 NK_API void                 nk_sdl_device_create(void);
+NK_API void                 nk_sdl_stream_stats(const struct gl_stream_stats **vertex, const struct gl_stream_stats **element);
+NK_API const struct nk_sdl_frame_stats *nk_sdl_frame_stats(void);
+NK_API void                 nk_sdl_set_cached(int enable);
 
 #endif
 
@@ -38,10 +57,31 @@ NK_API void                 nk_sdl_device_create(void);
 
 #include <string.h>
 
+/*
+ * Cached mode: the UI is drawn into tex only when its command buffer hash
+ * changes (which covers input, since anything input does to the UI shows
+ * up in its commands), and every frame composites tex with one triangle.
+ * tex holds premultiplied alpha.
+ */
+struct nk_sdl_cache {
+    int enabled;
+    int stale;                  /* tex was not kept up to date */
+    GLuint fbo, tex;
+    int width, height;
+    GLuint prog, vert_shdr, frag_shdr;
+    GLuint vao;                 /* empty, the triangle comes from gl_VertexID */
+};
+
 struct nk_sdl_device {
     struct nk_buffer cmds;
     struct nk_draw_null_texture tex_null;
-    GLuint vbo, vao, ebo;
+    GLuint vao;
+    struct gl_stream vstream, estream;
+    nk_size vertex_capacity, element_capacity;
+    int reusable;               /* stream regions and cmds hold last_hash's frame */
+    struct nk_sdl_cache cache;
+    nk_hash last_hash;
+    struct nk_sdl_frame_stats stats;
     GLuint prog;
     GLuint vert_shdr;
     GLuint frag_shdr;
@@ -61,6 +101,7 @@ struct nk_sdl_vertex {
 
 static struct nk_sdl {
     SDL_Window *win;
+    int width, height;          /* used instead of win's size when win is NULL */
     struct nk_sdl_device ogl;
     struct nk_context ctx;
     struct nk_font_atlas atlas;
@@ -124,36 +165,122 @@ nk_sdl_device_create(void)
     dev->attrib_uv = glGetAttribLocation(dev->prog, "TexCoord");
     dev->attrib_col = glGetAttribLocation(dev->prog, "Color");
 
-    {
-        /* buffer setup */
-        GLsizei vs = sizeof(struct nk_sdl_vertex);
-        size_t vp = offsetof(struct nk_sdl_vertex, position);
-        size_t vt = offsetof(struct nk_sdl_vertex, uv);
-        size_t vc = offsetof(struct nk_sdl_vertex, col);
-
-        glGenBuffers(1, &dev->vbo);
-        glGenBuffers(1, &dev->ebo);
-        glGenVertexArrays(1, &dev->vao);
-
-        glBindVertexArray(dev->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
-
-        glEnableVertexAttribArray((GLuint)dev->attrib_pos);
-        glEnableVertexAttribArray((GLuint)dev->attrib_uv);
-        glEnableVertexAttribArray((GLuint)dev->attrib_col);
-
-        glVertexAttribPointer((GLuint)dev->attrib_pos, 2, GL_FLOAT, GL_FALSE, vs, (void*)vp);
-        glVertexAttribPointer((GLuint)dev->attrib_uv, 2, GL_FLOAT, GL_FALSE, vs, (void*)vt);
-        glVertexAttribPointer((GLuint)dev->attrib_col, 4, GL_UNSIGNED_BYTE, GL_TRUE, vs, (void*)vc);
-    }
+    /* buffer storage is allocated on first render, see nk_sdl_device_bind_streams */
+    gl_stream_init(&dev->vstream);
+    gl_stream_init(&dev->estream);
+    dev->reusable = 0;
+    dev->cache.stale = 1;
+    glGenVertexArrays(1, &dev->vao);
+    glBindVertexArray(dev->vao);
+    glEnableVertexAttribArray((GLuint)dev->attrib_pos);
+    glEnableVertexAttribArray((GLuint)dev->attrib_uv);
+    glEnableVertexAttribArray((GLuint)dev->attrib_col);
 
     glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
 
+/* points the VAO at the stream buffers, again whenever they are replaced */
+NK_INTERN void
+nk_sdl_device_bind_streams(struct nk_sdl_device *dev)
+{
+    GLsizei vs = sizeof(struct nk_sdl_vertex);
+    size_t vp = offsetof(struct nk_sdl_vertex, position);
+    size_t vt = offsetof(struct nk_sdl_vertex, uv);
+    size_t vc = offsetof(struct nk_sdl_vertex, col);
+
+    glBindVertexArray(dev->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, dev->vstream.buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->estream.buffer);
+    glVertexAttribPointer((GLuint)dev->attrib_pos, 2, GL_FLOAT, GL_FALSE, vs, (void*)vp);
+    glVertexAttribPointer((GLuint)dev->attrib_uv, 2, GL_FLOAT, GL_FALSE, vs, (void*)vt);
+    glVertexAttribPointer((GLuint)dev->attrib_col, 4, GL_UNSIGNED_BYTE, GL_TRUE, vs, (void*)vc);
+}
+
+NK_INTERN void
+nk_sdl_cache_create(struct nk_sdl_cache *cache)
+{
+    GLint status;
+    static const GLchar *vertex_shader =
+        NK_SHADER_VERSION
+        "out vec2 Frag_UV;\n"
+        "void main() {\n"
+        "   Frag_UV = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0;\n"
+        "   gl_Position = vec4(Frag_UV * 2.0 - 1.0, 0, 1);\n"
+        "}\n";
+    static const GLchar *fragment_shader =
+        NK_SHADER_VERSION
+        "precision mediump float;\n"
+        "uniform sampler2D Texture;\n"
+        "in vec2 Frag_UV;\n"
+        "out vec4 Out_Color;\n"
+        "void main(){\n"
+        "   Out_Color = texture(Texture, Frag_UV);\n"
+        "}\n";
+
+    cache->prog = glCreateProgram();
+    cache->vert_shdr = glCreateShader(GL_VERTEX_SHADER);
+    cache->frag_shdr = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(cache->vert_shdr, 1, &vertex_shader, 0);
+    glShaderSource(cache->frag_shdr, 1, &fragment_shader, 0);
+    glCompileShader(cache->vert_shdr);
+    glCompileShader(cache->frag_shdr);
+    glGetShaderiv(cache->vert_shdr, GL_COMPILE_STATUS, &status);
+    assert(status == GL_TRUE);
+    glGetShaderiv(cache->frag_shdr, GL_COMPILE_STATUS, &status);
+    assert(status == GL_TRUE);
+    glAttachShader(cache->prog, cache->vert_shdr);
+    glAttachShader(cache->prog, cache->frag_shdr);
+    glLinkProgram(cache->prog);
+    glGetProgramiv(cache->prog, GL_LINK_STATUS, &status);
+    assert(status == GL_TRUE);
+
+    glGenVertexArrays(1, &cache->vao);
+    glGenFramebuffers(1, &cache->fbo);
+    glGenTextures(1, &cache->tex);
+    cache->width = cache->height = 0;
+}
+
+/* (re)allocates tex to the drawable size, returns nonzero if it did */
+NK_INTERN int
+nk_sdl_cache_resize(struct nk_sdl_cache *cache, int width, int height)
+{
+    GLint target;
+    if (!cache->prog)
+        nk_sdl_cache_create(cache);
+    if (cache->width == width && cache->height == height)
+        return 0;
+    cache->width = width;
+    cache->height = height;
+
+    glBindTexture(GL_TEXTURE_2D, cache->tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei)width, (GLsizei)height, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, cache->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cache->tex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+    return 1;
+}
+
+NK_INTERN void
+nk_sdl_cache_destroy(struct nk_sdl_cache *cache)
+{
+    if (!cache->prog)
+        return;
+    glDetachShader(cache->prog, cache->vert_shdr);
+    glDetachShader(cache->prog, cache->frag_shdr);
+    glDeleteShader(cache->vert_shdr);
+    glDeleteShader(cache->frag_shdr);
+    glDeleteProgram(cache->prog);
+    glDeleteVertexArrays(1, &cache->vao);
+    glDeleteFramebuffers(1, &cache->fbo);
+    glDeleteTextures(1, &cache->tex);
+    cache->prog = 0;
+}
+
 NK_INTERN void
 nk_sdl_device_upload_atlas(const void *image, int width, int height)
 {
@@ -176,31 +303,81 @@ nk_sdl_device_destroy(void)
     glDeleteShader(dev->frag_shdr);
     glDeleteProgram(dev->prog);
     glDeleteTextures(1, &dev->font_tex);
-    glDeleteBuffers(1, &dev->vbo);
-    glDeleteBuffers(1, &dev->ebo);
+    glDeleteVertexArrays(1, &dev->vao);
+    gl_stream_destroy(&dev->vstream);
+    gl_stream_destroy(&dev->estream);
+    nk_sdl_cache_destroy(&dev->cache);
     nk_buffer_free(&dev->cmds);
 }
 
+NK_INTERN void
+nk_sdl_draw_commands(struct nk_sdl_device *dev, int height, struct nk_vec2 scale)
+{
+    const struct nk_draw_command *cmd;
+    const nk_draw_index *offset = (const nk_draw_index *)dev->estream.offset;
+    GLint base_vertex = (GLint)(dev->vstream.offset / (GLintptr)sizeof(struct nk_sdl_vertex));
+
+    /* iterate over and execute each draw command */
+    nk_draw_foreach(cmd, &sdl.ctx, &dev->cmds) {
+        if (!cmd->elem_count) continue;
+        glBindTexture(GL_TEXTURE_2D, (GLuint)cmd->texture.id);
+        glScissor((GLint)(cmd->clip_rect.x * scale.x),
+            (GLint)((height - (GLint)(cmd->clip_rect.y + cmd->clip_rect.h)) * scale.y),
+            (GLint)(cmd->clip_rect.w * scale.x),
+            (GLint)(cmd->clip_rect.h * scale.y));
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)cmd->elem_count, GL_UNSIGNED_SHORT,
+                                 (void*)offset, base_vertex);
+        dev->stats.draws++;
+        offset += cmd->elem_count;
+    }
+    gl_stream_fence(&dev->vstream);
+    gl_stream_fence(&dev->estream);
+}
+
+/* a quarter of headroom over the last frame, so the usual frame converts once */
+NK_INTERN nk_size
+nk_sdl_map_size(nk_size last_used, nk_size capacity)
+{
+    nk_size size = last_used ? last_used + last_used / 4 : capacity;
+    return NK_MIN(size, capacity);
+}
+
+/*
+ * The buffers start at init_vertex_buffer/init_element_buffer bytes and
+ * grow geometrically whenever nk_convert reports them full, after which the
+ * frame is converted again. Only about as much as the last frame used is
+ * mapped, see nk_sdl_stream_stats for usage and high-water marks.
+ * With nk_sdl_set_cached(1) the UI goes through the cached texture
+ * instead of straight to the framebuffer.
+ */
 NK_API void
-nk_sdl_render(enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_buffer)
+nk_sdl_render(enum nk_anti_aliasing AA, int init_vertex_buffer, int init_element_buffer)
 {
     struct nk_sdl_device *dev = &sdl.ogl;
     int width, height;
     int display_width, display_height;
     struct nk_vec2 scale;
+    Uint64 render_start = SDL_GetPerformanceCounter();
     GLfloat ortho[4][4] = {
         {2.0f, 0.0f, 0.0f, 0.0f},
         {0.0f,-2.0f, 0.0f, 0.0f},
         {0.0f, 0.0f,-1.0f, 0.0f},
         {-1.0f,1.0f, 0.0f, 1.0f},
     };
-    SDL_GetWindowSize(sdl.win, &width, &height);
-    SDL_GL_GetDrawableSize(sdl.win, &display_width, &display_height);
+    if (sdl.win) {
+        SDL_GetWindowSize(sdl.win, &width, &height);
+        SDL_GL_GetDrawableSize(sdl.win, &display_width, &display_height);
+    } else {
+        width = display_width = sdl.width;
+        height = display_height = sdl.height;
+    }
     ortho[0][0] /= (GLfloat)width;
     ortho[1][1] /= (GLfloat)height;
 
     scale.x = (float)display_width/(float)width;
     scale.y = (float)display_height/(float)height;
+    dev->stats.draws = 0;
+    dev->stats.upload_bytes = 0;
 
     /* setup global state */
     glViewport(0,0,display_width,display_height);
@@ -218,72 +395,166 @@ nk_sdl_render(enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_b
     glUniformMatrix4fv(dev->uniform_proj, 1, GL_FALSE, &ortho[0][0]);
     {
         /* convert from command queue into draw list and draw to screen */
-        const struct nk_draw_command *cmd;
         void *vertices, *elements;
-        const nk_draw_index *offset = NULL;
         struct nk_buffer vbuf, ebuf;
-
-        /* allocate vertex and element buffer */
-        glBindVertexArray(dev->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
-
-        glBufferData(GL_ARRAY_BUFFER, max_vertex_buffer, NULL, GL_STREAM_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_element_buffer, NULL, GL_STREAM_DRAW);
-
-        /* load vertices/elements directly into vertex/element buffer */
-        vertices = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-        elements = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
-        {
-            /* fill convert configuration */
-            struct nk_convert_config config;
-            static const struct nk_draw_vertex_layout_element vertex_layout[] = {
-                {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, position)},
-                {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, uv)},
-                {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(struct nk_sdl_vertex, col)},
-                {NK_VERTEX_LAYOUT_END}
-            };
-            memset(&config, 0, sizeof(config));
-            config.vertex_layout = vertex_layout;
-            config.vertex_size = sizeof(struct nk_sdl_vertex);
-            config.vertex_alignment = NK_ALIGNOF(struct nk_sdl_vertex);
-            config.tex_null = dev->tex_null;
-            config.circle_segment_count = 22;
-            config.curve_segment_count = 22;
-            config.arc_segment_count = 22;
-            config.global_alpha = 1.0f;
-            config.shape_AA = AA;
-            config.line_AA = AA;
-
-            /* setup buffers to load vertices and elements */
-            nk_buffer_init_fixed(&vbuf, vertices, (nk_size)max_vertex_buffer);
-            nk_buffer_init_fixed(&ebuf, elements, (nk_size)max_element_buffer);
-            nk_convert(&sdl.ctx, &dev->cmds, &vbuf, &ebuf, &config);
+        nk_size vsize, esize;
+        nk_flags res;
+        int attempt, changed;
+        nk_hash hash;
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        /*
+         * Building links the windows' command lists in drawing order, so
+         * the hash sees z-order changes as well. Needs NK_ZERO_COMMAND_MEMORY
+         * for the padding between commands to hash the same every frame.
+         */
+        nk__begin(&sdl.ctx);
+        hash = nk_murmur_hash(nk_buffer_memory_const(&sdl.ctx.memory),
+                              (int)sdl.ctx.memory.allocated, (nk_hash)AA);
+        dev->stats.hash_seconds = (double)(SDL_GetPerformanceCounter() - start)
+            / (double)SDL_GetPerformanceFrequency();
+
+        if (dev->reusable && hash == dev->last_hash) {
+            /* same UI as last frame, draw its vertices and commands again */
+            dev->stats.reused++;
+            dev->stats.saved_seconds += dev->stats.convert_seconds - dev->stats.hash_seconds;
+            glBindVertexArray(dev->vao);
+            changed = 0;
+        } else {
+            nk_buffer_clear(&dev->cmds);
+            dev->vertex_capacity = NK_MAX(dev->vertex_capacity, (nk_size)init_vertex_buffer);
+            dev->element_capacity = NK_MAX(dev->element_capacity, (nk_size)init_element_buffer);
+            for (attempt = 0; attempt < 4; attempt++) {
+                /* fill convert configuration */
+                struct nk_convert_config config;
+                static const struct nk_draw_vertex_layout_element vertex_layout[] = {
+                    {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, position)},
+                    {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, uv)},
+                    {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(struct nk_sdl_vertex, col)},
+                    {NK_VERTEX_LAYOUT_END}
+                };
+                memset(&config, 0, sizeof(config));
+                config.vertex_layout = vertex_layout;
+                config.vertex_size = sizeof(struct nk_sdl_vertex);
+                config.vertex_alignment = NK_ALIGNOF(struct nk_sdl_vertex);
+                config.tex_null = dev->tex_null;
+                config.circle_segment_count = 22;
+                config.curve_segment_count = 22;
+                config.arc_segment_count = 22;
+                config.global_alpha = 1.0f;
+                config.shape_AA = AA;
+                config.line_AA = AA;
+
+                /* take the next region of each stream, (re)allocating them if needed */
+                if (gl_stream_reserve(&dev->vstream, (GLsizeiptr)dev->vertex_capacity,
+                                      sizeof(struct nk_sdl_vertex)) |
+                    gl_stream_reserve(&dev->estream, (GLsizeiptr)dev->element_capacity,
+                                      sizeof(nk_draw_index)))
+                    nk_sdl_device_bind_streams(dev);
+                glBindVertexArray(dev->vao);
+
+                /* load vertices/elements directly into vertex/element buffer */
+                vsize = nk_sdl_map_size((nk_size)dev->vstream.stats.used, (nk_size)dev->vstream.region_size);
+                esize = nk_sdl_map_size((nk_size)dev->estream.stats.used, (nk_size)dev->estream.region_size);
+                vertices = gl_stream_map(&dev->vstream, (GLsizeiptr)vsize);
+                elements = gl_stream_map(&dev->estream, (GLsizeiptr)esize);
+                nk_buffer_init_fixed(&vbuf, vertices, vsize);
+                nk_buffer_init_fixed(&ebuf, elements, esize);
+                res = nk_convert(&sdl.ctx, &dev->cmds, &vbuf, &ebuf, &config);
+
+                /* needed counts everything asked for, including what did not fit */
+                gl_stream_unmap(&dev->vstream, (GLsizeiptr)vbuf.needed);
+                gl_stream_unmap(&dev->estream, (GLsizeiptr)ebuf.needed);
+                if (!(res & (NK_CONVERT_VERTEX_BUFFER_FULL | NK_CONVERT_ELEMENT_BUFFER_FULL)))
+                    break;
+                vsize = vbuf.needed + vbuf.needed / 4;
+                esize = ebuf.needed + ebuf.needed / 4;
+                if (vsize > dev->vertex_capacity)
+                    dev->vertex_capacity = NK_MAX(dev->vertex_capacity * 2, vsize);
+                if (esize > dev->element_capacity)
+                    dev->element_capacity = NK_MAX(dev->element_capacity * 2, esize);
+                nk_buffer_clear(&dev->cmds);
+            }
+            dev->stats.upload_bytes = (unsigned long)(vbuf.needed + ebuf.needed);
+            dev->reusable = 1;
+            dev->last_hash = hash;
+            dev->stats.converted++;
+            dev->stats.convert_seconds = (double)(SDL_GetPerformanceCounter() - start)
+                / (double)SDL_GetPerformanceFrequency();
+            changed = 1;
         }
-        glUnmapBuffer(GL_ARRAY_BUFFER);
-        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
-
-        /* iterate over and execute each draw command */
-        nk_draw_foreach(cmd, &sdl.ctx, &dev->cmds) {
-            if (!cmd->elem_count) continue;
-            glBindTexture(GL_TEXTURE_2D, (GLuint)cmd->texture.id);
-            glScissor((GLint)(cmd->clip_rect.x * scale.x),
-                (GLint)((height - (GLint)(cmd->clip_rect.y + cmd->clip_rect.h)) * scale.y),
-                (GLint)(cmd->clip_rect.w * scale.x),
-                (GLint)(cmd->clip_rect.h * scale.y));
-            glDrawElements(GL_TRIANGLES, (GLsizei)cmd->elem_count, GL_UNSIGNED_SHORT, offset);
-            offset += cmd->elem_count;
+
+        if (dev->cache.enabled) {
+            if (nk_sdl_cache_resize(&dev->cache, display_width, display_height) ||
+                dev->cache.stale)
+                changed = 1;
+            if (changed) {
+                static const GLfloat transparent[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                GLint target;
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+                glBindFramebuffer(GL_FRAMEBUFFER, dev->cache.fbo);
+                glDisable(GL_SCISSOR_TEST);
+                glClearBufferfv(GL_COLOR, 0, transparent);
+                glEnable(GL_SCISSOR_TEST);
+                /* keep alpha correct so the texture composites like the direct draw */
+                glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                                    GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                nk_sdl_draw_commands(dev, height, scale);
+                glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+                dev->cache.stale = 0;
+                dev->stats.cache_refreshes++;
+            }
+            glDisable(GL_SCISSOR_TEST);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            glUseProgram(dev->cache.prog);
+            glBindVertexArray(dev->cache.vao);
+            glBindTexture(GL_TEXTURE_2D, dev->cache.tex);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            dev->stats.draws++;
+        } else {
+            nk_sdl_draw_commands(dev, height, scale);
+            dev->cache.stale = 1;
         }
         nk_clear(&sdl.ctx);
-        nk_buffer_clear(&dev->cmds);
     }
 
     glUseProgram(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glDisable(GL_BLEND);
     glDisable(GL_SCISSOR_TEST);
+
+    dev->stats.frames++;
+    dev->stats.render_seconds = (double)(SDL_GetPerformanceCounter() - render_start)
+        / (double)SDL_GetPerformanceFrequency();
+    dev->stats.render_seconds_total += dev->stats.render_seconds;
+}
+
+/* For rendering without a window, into a framebuffer of this size */
+NK_API void
+nk_sdl_set_size(int width, int height)
+{
+    sdl.width = width;
+    sdl.height = height;
+}
+
+NK_API void
+nk_sdl_set_cached(int enable)
+{
+    sdl.ogl.cache.enabled = enable;
+}
+
+NK_API void
+nk_sdl_stream_stats(const struct gl_stream_stats **vertex, const struct gl_stream_stats **element)
+{
+    *vertex = &sdl.ogl.vstream.stats;
+    *element = &sdl.ogl.estream.stats;
+}
+
+NK_API const struct nk_sdl_frame_stats *
+nk_sdl_frame_stats(void)
+{
+    return &sdl.ogl.stats;
 }
 
 static void
@@ -0,0 +1,367 @@
+/*
+  profile.h
+
+  Scoped CPU timing zones, exported as Chrome trace-event JSON that
+  chrome://tracing or https://ui.perfetto.dev can open.
+
+      PROFILE_BEGIN(zone, "name");
+      ...
+      PROFILE_END(zone);
+
+  records one complete event with the zone's start and end time. Zones may
+  nest; the viewer stacks them by time. Names must outlive the export, in
+  practice they are string literals.
+
+  Every thread writes into its own ring of PROFILE_RING_EVENTS events,
+  allocated the first time it ends a zone, so recording never takes a lock
+  and never waits on another thread. Only the newest PROFILE_RING_EVENTS
+  events of each thread are kept. When a thread made with SDL_CreateThread
+  exits, its ring goes to the next thread that needs one, so programs that
+  keep starting threads keep a ring per live thread rather than one per
+  thread ever started. profile_export_chrome() may run on any
+  thread while the others keep recording; events overwritten while it
+  copies a ring are dropped from that export rather than written torn.
+
+  Events timed by something other than the calling thread, such as GPU
+  timer queries read back frames later, go on a track of their own made by
+  profile_track() and are added with profile_record(). A track is a ring
+  like any thread's and shows up as its own row in the viewer.
+
+  Building with PROFILE_ENABLED defined to 0 turns PROFILE_BEGIN,
+  PROFILE_END and PROFILE_THREAD into nothing, and profile_export_chrome()
+  into a function that writes no file, so zones can stay in hot code.
+
+  SDL (for the timer, thread ids, TLS and atomics) must be included before
+  this header. You MUST
+
+     #define PROFILE_IMPLEMENTATION
+
+  in EXACTLY one C file that includes this header, BEFORE the include, and
+  call profile_init() once before any zone is recorded.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+#ifndef PROFILE_RING_EVENTS
+#define PROFILE_RING_EVENTS 65536
+#endif
+
+struct profile_ring;
+
+struct profile_zone
+{
+    const char *name;
+    Uint64 start;
+};
+
+/* Starts the trace clock and creates the thread-local ring slot. */
+void profile_init(void);
+
+/* Names the calling thread in exported traces, e.g. "main" or "worker 3". */
+void profile_thread_name(const char *name);
+
+/* Records zone, timed from profile_begin() to now, on the calling thread. */
+void profile_end(const struct profile_zone *zone);
+
+/*
+ * Makes a named track for profile_record(). Only one thread at a time may
+ * record into it. Returns NULL when profiling is compiled out.
+ */
+struct profile_ring *profile_track(const char *name);
+
+/* Adds an event to track. Times are SDL_GetPerformanceCounter() ticks. */
+void profile_record(struct profile_ring *track, const char *name, Uint64 start, Uint64 end);
+
+/*
+ * Writes every thread's retained events to path. Returns the number of
+ * events written, or -1 if the file could not be written.
+ */
+long profile_export_chrome(const char *path);
+
+/* Frees all rings. No zone may be recorded after this. */
+void profile_shutdown(void);
+
+#if PROFILE_ENABLED
+
+static inline struct profile_zone
+profile_begin(const char *name)
+{
+    struct profile_zone zone;
+    zone.name = name;
+    zone.start = SDL_GetPerformanceCounter();
+    return zone;
+}
+
+#define PROFILE_BEGIN(zone, name) struct profile_zone zone = profile_begin(name)
+#define PROFILE_END(zone) profile_end(&(zone))
+#define PROFILE_THREAD(name) profile_thread_name(name)
+
+#else
+
+#define PROFILE_BEGIN(zone, name) ((void)0)
+#define PROFILE_END(zone) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+
+#endif
+
+#endif
+
+#if defined(PROFILE_IMPLEMENTATION) && !defined(PROFILE_IMPLEMENTED)
+#define PROFILE_IMPLEMENTED
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if PROFILE_ENABLED
+
+struct profile_event
+{
+    const char *name;
+    Uint64 start;
+    Uint64 end;
+};
+
+struct profile_ring
+{
+    /*
+     * Events ever written. Only the owning thread stores to it, after a
+     * release barrier, so a reader that loads it and then issues an acquire
+     * barrier sees every event below it complete.
+     */
+    volatile unsigned long head;
+    unsigned long first;            /* head when the current owner took it over */
+    SDL_atomic_t free;              /* the owner has exited */
+    SDL_threadID tid;
+    const char *thread_name;
+    struct profile_ring *next;
+    struct profile_event events[PROFILE_RING_EVENTS];
+};
+
+static struct
+{
+    SDL_TLSID tls;
+    Uint64 epoch;
+    double ticks_per_us;
+    struct profile_ring *rings;     /* lock-free list, pushed at the front */
+    SDL_atomic_t tracks;            /* made so far, numbered as their tids */
+} profile;
+
+void
+profile_init(void)
+{
+    if (!profile.tls)
+        profile.tls = SDL_TLSCreate();
+    profile.epoch = SDL_GetPerformanceCounter();
+    profile.ticks_per_us = (double)SDL_GetPerformanceFrequency() / 1000000.0;
+}
+
+/* TLS destructor, run as a thread made with SDL_CreateThread exits */
+static void
+profile__release(void *data)
+{
+    struct profile_ring *ring = data;
+    if (ring)
+        SDL_AtomicSet(&ring->free, 1);
+}
+
+static struct profile_ring *
+profile__new_ring(SDL_threadID tid)
+{
+    struct profile_ring *ring;
+
+    /* the events an exited thread left behind are not exported any more */
+    for (ring = SDL_AtomicGetPtr((void **)&profile.rings); ring; ring = ring->next) {
+        if (SDL_AtomicCAS(&ring->free, 1, 0)) {
+            ring->thread_name = NULL;
+            ring->tid = tid;
+            ring->first = ring->head;
+            SDL_MemoryBarrierRelease();
+            return ring;
+        }
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    if (!ring)
+        return NULL;
+    ring->tid = tid;
+    do {
+        ring->next = SDL_AtomicGetPtr((void **)&profile.rings);
+    } while (!SDL_AtomicCASPtr((void **)&profile.rings, ring->next, ring));
+    return ring;
+}
+
+static struct profile_ring *
+profile__ring(void)
+{
+    struct profile_ring *ring = SDL_TLSGet(profile.tls);
+    if (ring || !profile.tls)
+        return ring;
+
+    ring = profile__new_ring(SDL_ThreadID());
+    if (ring)
+        SDL_TLSSet(profile.tls, ring, profile__release);
+    return ring;
+}
+
+static void
+profile__push(struct profile_ring *ring, const char *name, Uint64 start, Uint64 end)
+{
+    unsigned long head = ring->head;
+    struct profile_event *event = &ring->events[head % PROFILE_RING_EVENTS];
+
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    SDL_MemoryBarrierRelease();
+    ring->head = head + 1;
+}
+
+void
+profile_thread_name(const char *name)
+{
+    struct profile_ring *ring = profile__ring();
+    if (ring)
+        ring->thread_name = name;
+}
+
+void
+profile_end(const struct profile_zone *zone)
+{
+    struct profile_ring *ring = profile__ring();
+    if (ring)
+        profile__push(ring, zone->name, zone->start, SDL_GetPerformanceCounter());
+}
+
+struct profile_ring *
+profile_track(const char *name)
+{
+    /* small made-up tids, real thread ids are addresses or kernel tids */
+    struct profile_ring *track = profile__new_ring((SDL_threadID)SDL_AtomicAdd(&profile.tracks, 1) + 1);
+    if (track)
+        track->thread_name = name;
+    return track;
+}
+
+void
+profile_record(struct profile_ring *track, const char *name, Uint64 start, Uint64 end)
+{
+    if (track)
+        profile__push(track, name, start, end);
+}
+
+static void
+profile__write_string(FILE *file, const char *s)
+{
+    fputc('"', file);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+long
+profile_export_chrome(const char *path)
+{
+    struct profile_event *copy;
+    struct profile_ring *ring;
+    FILE *file;
+    long written = 0;
+    int first = 1;
+
+    copy = malloc(sizeof(ring->events));
+    if (!copy)
+        return -1;
+    file = fopen(path, "w");
+    if (!file) {
+        free(copy);
+        return -1;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    for (ring = SDL_AtomicGetPtr((void **)&profile.rings); ring; ring = ring->next) {
+        unsigned long head, base, tail, after, i;
+
+        head = ring->head;
+        SDL_MemoryBarrierAcquire();
+        base = head > PROFILE_RING_EVENTS ? head - PROFILE_RING_EVENTS : 0;
+        for (i = base; i < head; i++)
+            copy[i - base] = ring->events[i % PROFILE_RING_EVENTS];
+
+        /*
+         * anything the owner lapped while we copied may be torn, and so may
+         * the slot of index after - N, which it can be writing right now
+         */
+        SDL_MemoryBarrierAcquire();
+        after = ring->head;
+        tail = base;
+        if (after - base >= PROFILE_RING_EVENTS)
+            tail = after - PROFILE_RING_EVENTS + 1 < head ? after - PROFILE_RING_EVENTS + 1 : head;
+        /* and anything from before the ring changed hands */
+        if (tail < ring->first)
+            tail = ring->first < head ? ring->first : head;
+
+        if (ring->thread_name) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,"
+                    "\"args\":{\"name\":", first ? "" : ",\n", (unsigned long)ring->tid);
+            profile__write_string(file, ring->thread_name);
+            fputs("}}", file);
+            first = 0;
+        }
+        for (i = tail; i < head; i++) {
+            const struct profile_event *event = &copy[i - base];
+            fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+            profile__write_string(file, event->name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+                    (unsigned long)ring->tid,
+                    (double)(Sint64)(event->start - profile.epoch) / profile.ticks_per_us,
+                    (double)(event->end - event->start) / profile.ticks_per_us);
+            first = 0;
+            written++;
+        }
+    }
+    fputs("\n]}\n", file);
+
+    free(copy);
+    if (fclose(file) != 0)
+        return -1;
+    return written;
+}
+
+void
+profile_shutdown(void)
+{
+    struct profile_ring *ring = profile.rings;
+    while (ring) {
+        struct profile_ring *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    profile.rings = NULL;
+    if (profile.tls)
+        SDL_TLSSet(profile.tls, NULL, NULL);
+}
+
+#else
+
+void profile_init(void) {}
+void profile_thread_name(const char *name) { (void)name; }
+void profile_end(const struct profile_zone *zone) { (void)zone; }
+struct profile_ring *profile_track(const char *name) { (void)name; return NULL; }
+void profile_record(struct profile_ring *track, const char *name, Uint64 start, Uint64 end)
+{
+    (void)track; (void)name; (void)start; (void)end;
+}
+long profile_export_chrome(const char *path) { (void)path; return 0; }
+void profile_shutdown(void) {}
+
+#endif
+
+#endif
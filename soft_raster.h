@@ -0,0 +1,1118 @@
+/*
+  soft_raster.h
+
+  Multithreaded tiled rasterizer for triangles and lines, to draw the scene
+  without GL. Draws are queued with soft_raster_draw(), each with its own
+  MVP matrix, much like a glDrawElements call, and soft_raster_finish()
+  carries them out in two passes:
+
+    bin     Every thread takes an equal share of the queued primitives,
+            transforms and clips them, sets up their edge functions and
+            appends them to a list for each SOFT_RASTER_TILE square tile
+            they touch.
+    raster  Threads take tiles off a shared counter and draw everything
+            binned to them. A tile walks the threads' lists in thread
+            order, so primitives land in the order they were queued and
+            blending comes out as it does in GL.
+
+  Triangles are filled by evaluating their three edge functions at pixel
+  centers, four pixels at a time with SSE2 (defining SOFT_RASTER_NO_SSE
+  leaves the scalar loop). Vertices are snapped to 1/256 pixel and every
+  edge function is evaluated the same way by both triangles sharing the
+  edge, with ties going to exactly one of them, so meshes have neither
+  cracks nor seams blended twice. Colors are interpolated perspective
+  correctly. Lines are one pixel wide, sampled once per pixel along their
+  major axis, and drawn in the color of their first vertex.
+
+  As in the GL scene there is no depth buffer and no face culling, and
+  blending, for draws that ask for it, is GL_SRC_ALPHA,
+  GL_ONE_MINUS_SRC_ALPHA into an RGBA8 color buffer. Primitives are clipped
+  against the near and far planes and a guard band SOFT_RASTER_GUARD
+  pixels wide around the viewport.
+
+  SDL (threads, semaphores, atomics and the timer) must be included before
+  this header. When profile.h is included first, both passes show up as
+  zones on every thread. You MUST
+
+     #define SOFT_RASTER_IMPLEMENTATION
+
+  in EXACTLY one C file that includes this header, BEFORE the include.
+*/
+
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#define SOFT_RASTER_TILE 64
+#define SOFT_RASTER_GUARD 2048
+#define SOFT_RASTER_MAX_THREADS 64
+
+enum soft_raster_primitive
+{
+    SOFT_RASTER_TRIANGLES,
+    SOFT_RASTER_LINES
+};
+
+struct soft_raster_draw
+{
+    enum soft_raster_primitive primitive;
+    float mvp[16];                  /* column major, as glUniformMatrix4fv takes it */
+    const float *verts;             /* x, y, z, and r, g, b, a at color_offset */
+    int stride;                     /* floats from one vertex to the next */
+    int color_offset;               /* -1 draws every vertex in color */
+    float color[4];
+    const unsigned int *indices;    /* NULL draws the vertices in order */
+    int count;                      /* indices, or vertices without them */
+    int blend;
+};
+
+/* What the last soft_raster_finish() did */
+struct soft_raster_stats
+{
+    unsigned long primitives;       /* queued */
+    unsigned long triangles;        /* set up, after clipping */
+    unsigned long lines;
+    unsigned long clipped;          /* primitives crossing a clip plane */
+    unsigned long culled;           /* outside, degenerate or between pixels */
+    unsigned long bin_entries;      /* primitive and tile pairs */
+    unsigned long dropped;          /* lost to failed allocations */
+    double bin_ms, raster_ms;
+};
+
+struct soft_raster;
+
+/*
+ * Makes a width x height color buffer and threads - 1 worker threads; the
+ * thread calling soft_raster_finish() is the last one. threads <= 0 uses
+ * one per CPU. Returns NULL if memory or threads ran out.
+ */
+struct soft_raster *soft_raster_create(int width, int height, int threads);
+void soft_raster_destroy(struct soft_raster *r);
+int soft_raster_threads(const struct soft_raster *r);
+
+/* Fills the buffer with color before the draws queued after this call. */
+void soft_raster_clear(struct soft_raster *r, const float color[4]);
+
+/*
+ * Queues a draw. The draw is copied but verts and indices are read during
+ * soft_raster_finish(), and must stay valid until then. Returns 0 if it
+ * could not be queued.
+ */
+int soft_raster_draw(struct soft_raster *r, const struct soft_raster_draw *draw);
+
+/* Draws everything queued and returns once the buffer is complete. */
+void soft_raster_finish(struct soft_raster *r);
+
+/* Copies the buffer out as width * height RGB triples, top row first. */
+void soft_raster_read_rgb(const struct soft_raster *r, unsigned char *rgb);
+
+const struct soft_raster_stats *soft_raster_stats(const struct soft_raster *r);
+
+#endif
+
+#if defined(SOFT_RASTER_IMPLEMENTATION) && !defined(SOFT_RASTER_IMPLEMENTED)
+#define SOFT_RASTER_IMPLEMENTED
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(SOFT_RASTER_NO_SSE) && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SOFT_RASTER__SSE 1
+#include <emmintrin.h>
+#else
+#define SOFT_RASTER__SSE 0
+#endif
+
+#ifdef PROFILE_H
+#define SOFT_RASTER__BEGIN(zone, name) PROFILE_BEGIN(zone, name)
+#define SOFT_RASTER__END(zone) PROFILE_END(zone)
+#define SOFT_RASTER__THREAD(name) PROFILE_THREAD(name)
+#else
+#define SOFT_RASTER__BEGIN(zone, name) ((void)0)
+#define SOFT_RASTER__END(zone) ((void)0)
+#define SOFT_RASTER__THREAD(name) ((void)0)
+#endif
+
+#define SOFT_RASTER__MIN(a, b) ((a) < (b) ? (a) : (b))
+#define SOFT_RASTER__MAX(a, b) ((a) < (b) ? (b) : (a))
+
+/* clip space x, y, z, w and then r, g, b, a */
+#define SOFT_RASTER__VERTEX 8
+/* a triangle clipped by all six planes */
+#define SOFT_RASTER__MAX_CLIPPED 9
+
+/*
+ * Edge i is the one opposite vertex i, E_i(x, y) = a*x + b*y + c, positive
+ * inside, with the half pixel to the pixel center folded into c.
+ * Perspective-correct barycentrics are E_i * inv_area * q_i normalized.
+ */
+struct soft_raster__triangle
+{
+    float a[3], b[3], c[3];
+    float inv_a[3];                 /* 1/a, 0 for horizontal edges */
+    int ties[3];                    /* pixels exactly on edge i are inside */
+    int x0, y0, x1, y1;             /* pixel bounds, inclusive */
+    float inv_area;
+    float q[3];                     /* 1/w */
+    float cq[4][3];                 /* color channel over w, smooth only */
+    float rgba[4];                  /* flat only */
+    Uint32 color;
+    unsigned char smooth, blend;
+};
+
+/*
+ * Samples pixels first..last along the major axis, at the pixel centers
+ * inside [u0, u1), and the minor axis pixel the line crosses there.
+ */
+struct soft_raster__line
+{
+    float u0, v0, slope;
+    int first, last;
+    int y_major;
+    float rgba[4];
+    Uint32 color;
+    unsigned char blend;
+};
+
+/* primitive indices into one worker's arrays, shifted left, lines odd */
+struct soft_raster__bin
+{
+    Uint32 *items;
+    int count, capacity;
+};
+
+struct soft_raster__worker
+{
+    struct soft_raster *r;
+    int index;
+    SDL_Thread *thread;
+    SDL_sem *start;
+    struct soft_raster__triangle *tris;
+    int tri_count, tri_capacity;
+    struct soft_raster__line *lines;
+    int line_count, line_capacity;
+    struct soft_raster__bin *bins;  /* one per tile */
+    struct soft_raster_stats stats;
+};
+
+struct soft_raster__queued
+{
+    struct soft_raster_draw draw;
+    unsigned long first;            /* primitives queued before it */
+    unsigned long prims;
+};
+
+enum soft_raster__phase
+{
+    SOFT_RASTER__BIN,
+    SOFT_RASTER__RASTER,
+    SOFT_RASTER__QUIT
+};
+
+struct soft_raster
+{
+    int width, height;
+    int stride;                     /* width rounded up to whole 4 pixel groups */
+    int tiles_x, tiles_y;
+    Uint32 *pixels;
+    float guard_x, guard_y;         /* guard band edges, in w */
+
+    struct soft_raster__queued *queue;
+    int queue_count, queue_capacity;
+    unsigned long prim_count;
+    int clear;
+    Uint32 clear_color;
+
+    int thread_count;
+    struct soft_raster__worker workers[SOFT_RASTER_MAX_THREADS];
+    enum soft_raster__phase phase;
+    SDL_sem *done;
+    SDL_atomic_t next_tile;
+    struct soft_raster_stats stats;
+};
+
+static Uint32
+soft_raster__pack(const float rgba[4])
+{
+    Uint32 packed = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        float v = rgba[i] < 0.0f ? 0.0f : rgba[i] > 1.0f ? 1.0f : rgba[i];
+        packed |= (Uint32)(v * 255.0f + 0.5f) << (i * 8);
+    }
+    return packed;
+}
+
+static float
+soft_raster__snap(float v)
+{
+    return floorf(v * 256.0f + 0.5f) * (1.0f / 256.0f);
+}
+
+static void *
+soft_raster__grow(void *items, int *capacity, int count, size_t size)
+{
+    int grown = *capacity ? *capacity * 2 : 64;
+    void *more;
+    if (count < *capacity)
+        return items;
+    more = realloc(items, (size_t)grown * size);
+    if (more)
+        *capacity = grown;
+    return more;
+}
+
+static int
+soft_raster__bin_push(struct soft_raster__worker *w, int tile, Uint32 item)
+{
+    struct soft_raster__bin *bin = &w->bins[tile];
+    Uint32 *items = soft_raster__grow(bin->items, &bin->capacity, bin->count, sizeof(*items));
+    if (!items) {
+        w->stats.dropped++;
+        return 0;
+    }
+    bin->items = items;
+    bin->items[bin->count++] = item;
+    w->stats.bin_entries++;
+    return 1;
+}
+
+static void
+soft_raster__fetch(const struct soft_raster_draw *draw, unsigned long vertex, float *out)
+{
+    const float *v = draw->verts + (size_t)vertex * draw->stride;
+    const float *m = draw->mvp;
+    int i;
+    for (i = 0; i < 4; i++)
+        out[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i];
+    memcpy(out + 4, draw->color_offset < 0 ? draw->color : v + draw->color_offset, 4 * sizeof(float));
+}
+
+/* distance inside clip plane p (near, far, left, right, bottom, top) */
+static float
+soft_raster__plane(const struct soft_raster *r, int p, const float *v)
+{
+    switch (p) {
+    case 0: return v[2] + v[3];
+    case 1: return v[3] - v[2];
+    case 2: return v[0] + r->guard_x * v[3];
+    case 3: return r->guard_x * v[3] - v[0];
+    case 4: return v[1] + r->guard_y * v[3];
+    default: return r->guard_y * v[3] - v[1];
+    }
+}
+
+/* bit p set for each plane the vertex is outside of */
+static int
+soft_raster__outcode(const struct soft_raster *r, const float *v)
+{
+    int p, code = 0;
+    for (p = 0; p < 6; p++)
+        if (soft_raster__plane(r, p, v) < 0.0f)
+            code |= 1 << p;
+    return code;
+}
+
+/* Sutherland-Hodgman against the planes in planes, returns the vertex count */
+static int
+soft_raster__clip(const struct soft_raster *r, int planes, float poly[][SOFT_RASTER__VERTEX], int n)
+{
+    float out[SOFT_RASTER__MAX_CLIPPED][SOFT_RASTER__VERTEX];
+    int p, i, k;
+
+    for (p = 0; p < 6 && n >= 3; p++) {
+        int count = 0;
+        if (!(planes & (1 << p)))
+            continue;
+        for (i = 0; i < n; i++) {
+            const float *a = poly[i], *b = poly[(i + 1) % n];
+            float da = soft_raster__plane(r, p, a), db = soft_raster__plane(r, p, b);
+            if (da >= 0.0f)
+                memcpy(out[count++], a, sizeof(out[0]));
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+                for (k = 0; k < SOFT_RASTER__VERTEX; k++)
+                    out[count][k] = a[k] + (b[k] - a[k]) * t;
+                count++;
+            }
+        }
+        memcpy(poly, out, (size_t)count * sizeof(out[0]));
+        n = count;
+    }
+    return n;
+}
+
+static void
+soft_raster__to_screen(const struct soft_raster *r, const float *v, float *x, float *y, float *q)
+{
+    *q = 1.0f / v[3];
+    *x = soft_raster__snap((v[0] * *q * 0.5f + 0.5f) * (float)r->width);
+    *y = soft_raster__snap((0.5f - v[1] * *q * 0.5f) * (float)r->height);
+}
+
+static void
+soft_raster__bin_triangle(struct soft_raster__worker *w, const struct soft_raster__triangle *t, Uint32 item)
+{
+    const struct soft_raster *r = w->r;
+    int tx, ty, i;
+
+    for (ty = t->y0 / SOFT_RASTER_TILE; ty <= t->y1 / SOFT_RASTER_TILE; ty++) {
+        for (tx = t->x0 / SOFT_RASTER_TILE; tx <= t->x1 / SOFT_RASTER_TILE; tx++) {
+            double x0 = tx * SOFT_RASTER_TILE, y0 = ty * SOFT_RASTER_TILE;
+            double x1 = x0 + SOFT_RASTER_TILE - 1, y1 = y0 + SOFT_RASTER_TILE - 1;
+            int outside = 0;
+
+            /* skip tiles entirely outside an edge, with room for float error */
+            for (i = 0; i < 3 && !outside; i++) {
+                double x = t->a[i] > 0.0f ? x1 : x0, y = t->b[i] > 0.0f ? y1 : y0;
+                double e = t->a[i] * x + t->b[i] * y + t->c[i];
+                double slack = (fabs(t->a[i] * x) + fabs(t->b[i] * y) + fabs(t->c[i])) * 1e-6;
+                outside = e < -slack;
+            }
+            if (!outside && !soft_raster__bin_push(w, ty * r->tiles_x + tx, item))
+                return;
+        }
+    }
+}
+
+static void
+soft_raster__setup_triangle(struct soft_raster__worker *w, const struct soft_raster_draw *draw,
+                            float v[3][SOFT_RASTER__VERTEX])
+{
+    const struct soft_raster *r = w->r;
+    struct soft_raster__triangle *t;
+    float x[3], y[3], q[3];
+    int order[3] = {0, 1, 2};
+    double area;
+    int i, k;
+
+    for (i = 0; i < 3; i++) {
+        if (v[i][3] <= 0.0f) {
+            w->stats.culled++;
+            return;
+        }
+        soft_raster__to_screen(r, v[i], &x[i], &y[i], &q[i]);
+    }
+    area = (double)(x[1] - x[0]) * (y[2] - y[0]) - (double)(x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0.0) {
+        w->stats.culled++;
+        return;
+    }
+    if (area < 0.0) {
+        order[1] = 2;
+        order[2] = 1;
+        area = -area;
+    }
+
+    t = soft_raster__grow(w->tris, &w->tri_capacity, w->tri_count, sizeof(*t));
+    if (!t) {
+        w->stats.dropped++;
+        return;
+    }
+    w->tris = t;
+    t += w->tri_count;
+
+    t->x0 = t->y0 = INT_MAX;
+    t->x1 = t->y1 = INT_MIN;
+    for (i = 0; i < 3; i++) {
+        int v0 = order[(i + 1) % 3], v1 = order[(i + 2) % 3];
+        /* exact in double for snapped coordinates, rounded the same way for
+           the neighbour that walks this edge the other way round */
+        double a = (double)y[v0] - y[v1], b = (double)x[v1] - x[v0];
+        double c = (double)y[v1] * x[v0] - (double)x[v1] * y[v0];
+        t->a[i] = (float)a;
+        t->b[i] = (float)b;
+        t->c[i] = (float)(c + 0.5 * a + 0.5 * b);
+        t->inv_a[i] = a != 0.0 ? (float)(1.0 / a) : 0.0f;
+        t->ties[i] = a > 0.0 || (a == 0.0 && b > 0.0);
+
+        t->q[i] = q[order[i]];
+        for (k = 0; k < 4; k++)
+            t->cq[k][i] = v[order[i]][4 + k] * q[order[i]];
+        t->x0 = SOFT_RASTER__MIN(t->x0, (int)ceilf(x[i] - 0.5f));
+        t->x1 = SOFT_RASTER__MAX(t->x1, (int)ceilf(x[i] - 0.5f));
+        t->y0 = SOFT_RASTER__MIN(t->y0, (int)ceilf(y[i] - 0.5f));
+        t->y1 = SOFT_RASTER__MAX(t->y1, (int)ceilf(y[i] - 0.5f));
+    }
+    t->x0 = SOFT_RASTER__MAX(t->x0, 0);
+    t->y0 = SOFT_RASTER__MAX(t->y0, 0);
+    t->x1 = SOFT_RASTER__MIN(t->x1, r->width - 1);
+    t->y1 = SOFT_RASTER__MIN(t->y1, r->height - 1);
+    if (t->x0 > t->x1 || t->y0 > t->y1) {
+        w->stats.culled++;
+        return;
+    }
+    t->inv_area = (float)(1.0 / area);
+
+    t->smooth = 0;
+    for (i = 1; i < 3; i++)
+        t->smooth |= memcmp(v[0] + 4, v[i] + 4, 4 * sizeof(float)) != 0;
+    memcpy(t->rgba, v[0] + 4, sizeof(t->rgba));
+    t->color = soft_raster__pack(t->rgba);
+    /* blending with an alpha of one everywhere only costs time */
+    t->blend = draw->blend && (v[0][7] < 1.0f || v[1][7] < 1.0f || v[2][7] < 1.0f);
+
+    w->stats.triangles++;
+    soft_raster__bin_triangle(w, t, (Uint32)w->tri_count << 1);
+    w->tri_count++;
+}
+
+static void
+soft_raster__triangle(struct soft_raster__worker *w, const struct soft_raster_draw *draw,
+                      unsigned long prim)
+{
+    const struct soft_raster *r = w->r;
+    float poly[SOFT_RASTER__MAX_CLIPPED][SOFT_RASTER__VERTEX];
+    int i, n, all = ~0, any = 0;
+
+    for (i = 0; i < 3; i++) {
+        unsigned long vertex = prim * 3 + i;
+        int code;
+        soft_raster__fetch(draw, draw->indices ? draw->indices[vertex] : vertex, poly[i]);
+        code = soft_raster__outcode(r, poly[i]);
+        all &= code;
+        any |= code;
+    }
+    if (all) {
+        w->stats.culled++;
+        return;
+    }
+    if (!any) {
+        soft_raster__setup_triangle(w, draw, poly);
+        return;
+    }
+
+    w->stats.clipped++;
+    n = soft_raster__clip(r, any, poly, 3);
+    for (i = 2; i < n; i++) {
+        float fan[3][SOFT_RASTER__VERTEX];
+        memcpy(fan[0], poly[0], sizeof(fan[0]));
+        memcpy(fan[1], poly[i - 1], sizeof(fan[1]));
+        memcpy(fan[2], poly[i], sizeof(fan[2]));
+        soft_raster__setup_triangle(w, draw, fan);
+    }
+    if (n < 3)
+        w->stats.culled++;
+}
+
+/* minor axis pixel for major axis pixel u, the same in every tile */
+static int
+soft_raster__line_minor(const struct soft_raster__line *l, int u)
+{
+    return (int)floorf(l->v0 + ((float)u + 0.5f - l->u0) * l->slope);
+}
+
+static void
+soft_raster__line(struct soft_raster__worker *w, const struct soft_raster_draw *draw,
+                  unsigned long prim)
+{
+    const struct soft_raster *r = w->r;
+    struct soft_raster__line *l;
+    float v[2][SOFT_RASTER__VERTEX], x[2], y[2], q[2], rgba[4];
+    float t0 = 0.0f, t1 = 1.0f, u0, u1, v0, v1;
+    int i, p, major_size, minor_size, tiles_along;
+
+    for (i = 0; i < 2; i++) {
+        unsigned long vertex = prim * 2 + i;
+        soft_raster__fetch(draw, draw->indices ? draw->indices[vertex] : vertex, v[i]);
+    }
+    memcpy(rgba, v[0] + 4, sizeof(rgba));
+
+    /* Liang-Barsky, in clip space */
+    for (p = 0; p < 6; p++) {
+        float d0 = soft_raster__plane(r, p, v[0]), d1 = soft_raster__plane(r, p, v[1]);
+        if (d0 < 0.0f && d1 < 0.0f) {
+            w->stats.culled++;
+            return;
+        }
+        if (d0 < 0.0f)
+            t0 = SOFT_RASTER__MAX(t0, d0 / (d0 - d1));
+        else if (d1 < 0.0f)
+            t1 = SOFT_RASTER__MIN(t1, d0 / (d0 - d1));
+    }
+    if (t0 >= t1) {
+        w->stats.culled++;
+        return;
+    }
+    if (t0 > 0.0f || t1 < 1.0f) {
+        float clipped[2][SOFT_RASTER__VERTEX];
+        w->stats.clipped++;
+        for (i = 0; i < 4; i++) {
+            clipped[0][i] = v[0][i] + (v[1][i] - v[0][i]) * t0;
+            clipped[1][i] = v[0][i] + (v[1][i] - v[0][i]) * t1;
+        }
+        memcpy(v, clipped, sizeof(clipped));
+    }
+    for (i = 0; i < 2; i++) {
+        if (v[i][3] <= 0.0f) {
+            w->stats.culled++;
+            return;
+        }
+        soft_raster__to_screen(r, v[i], &x[i], &y[i], &q[i]);
+    }
+
+    l = soft_raster__grow(w->lines, &w->line_capacity, w->line_count, sizeof(*l));
+    if (!l) {
+        w->stats.dropped++;
+        return;
+    }
+    w->lines = l;
+    l += w->line_count;
+
+    l->y_major = fabsf(y[1] - y[0]) > fabsf(x[1] - x[0]);
+    u0 = l->y_major ? y[0] : x[0];
+    u1 = l->y_major ? y[1] : x[1];
+    v0 = l->y_major ? x[0] : y[0];
+    v1 = l->y_major ? x[1] : y[1];
+    if (u1 < u0) {
+        float swap = u0; u0 = u1; u1 = swap;
+        swap = v0; v0 = v1; v1 = swap;
+    }
+    if (u1 == u0) {
+        w->stats.culled++;
+        return;
+    }
+    l->u0 = u0;
+    l->v0 = v0;
+    l->slope = (v1 - v0) / (u1 - u0);
+    major_size = l->y_major ? r->height : r->width;
+    minor_size = l->y_major ? r->width : r->height;
+    l->first = SOFT_RASTER__MAX((int)ceilf(u0 - 0.5f), 0);
+    l->last = SOFT_RASTER__MIN((int)ceilf(u1 - 0.5f) - 1, major_size - 1);
+    if (l->first > l->last) {
+        w->stats.culled++;
+        return;
+    }
+    memcpy(l->rgba, rgba, sizeof(rgba));
+    l->color = soft_raster__pack(rgba);
+    l->blend = draw->blend && rgba[3] < 1.0f;
+    w->stats.lines++;
+
+    /* bin to the tiles along the line, a pixel of slack either side */
+    tiles_along = l->y_major ? r->tiles_y : r->tiles_x;
+    for (i = l->first / SOFT_RASTER_TILE; i <= l->last / SOFT_RASTER_TILE && i < tiles_along; i++) {
+        int lo = SOFT_RASTER__MAX(l->first, i * SOFT_RASTER_TILE);
+        int hi = SOFT_RASTER__MIN(l->last, i * SOFT_RASTER_TILE + SOFT_RASTER_TILE - 1);
+        int m0 = soft_raster__line_minor(l, lo), m1 = soft_raster__line_minor(l, hi);
+        int lo_tile = (SOFT_RASTER__MAX(SOFT_RASTER__MIN(m0, m1) - 1, 0)) / SOFT_RASTER_TILE;
+        int hi_tile = (SOFT_RASTER__MIN(SOFT_RASTER__MAX(m0, m1) + 1, minor_size - 1)) / SOFT_RASTER_TILE;
+        int j;
+        for (j = lo_tile; j <= hi_tile; j++) {
+            int tile = l->y_major ? i * r->tiles_x + j : j * r->tiles_x + i;
+            if (!soft_raster__bin_push(w, tile, ((Uint32)w->line_count << 1) | 1))
+                break;
+        }
+    }
+    w->line_count++;
+}
+
+static void
+soft_raster__bin_pass(struct soft_raster__worker *w)
+{
+    struct soft_raster *r = w->r;
+    unsigned long prim = r->prim_count * w->index / r->thread_count;
+    unsigned long end = r->prim_count * (w->index + 1) / r->thread_count;
+    int tile, q = 0;
+
+    w->tri_count = w->line_count = 0;
+    for (tile = 0; tile < r->tiles_x * r->tiles_y; tile++)
+        w->bins[tile].count = 0;
+
+    for (; prim < end; prim++) {
+        const struct soft_raster__queued *queued;
+        while (prim >= r->queue[q].first + r->queue[q].prims)
+            q++;
+        queued = &r->queue[q];
+        if (queued->draw.primitive == SOFT_RASTER_LINES)
+            soft_raster__line(w, &queued->draw, prim - queued->first);
+        else
+            soft_raster__triangle(w, &queued->draw, prim - queued->first);
+    }
+}
+
+static void
+soft_raster__plot(Uint32 *pixel, const struct soft_raster__line *l)
+{
+    if (l->blend) {
+        Uint32 dst = *pixel, out = 0;
+        float a = l->rgba[3];
+        int i;
+        for (i = 0; i < 4; i++) {
+            float d = (float)((dst >> (i * 8)) & 0xff);
+            out |= (Uint32)(l->rgba[i] * 255.0f * a + d * (1.0f - a) + 0.5f) << (i * 8);
+        }
+        *pixel = out;
+    } else {
+        *pixel = l->color;
+    }
+}
+
+static void
+soft_raster__draw_line(struct soft_raster *r, const struct soft_raster__line *l,
+                       int x0, int y0, int x1, int y1)
+{
+    int u, first, last;
+
+    first = SOFT_RASTER__MAX(l->first, l->y_major ? y0 : x0);
+    last = SOFT_RASTER__MIN(l->last, l->y_major ? y1 : x1);
+    for (u = first; u <= last; u++) {
+        int v = soft_raster__line_minor(l, u);
+        if (l->y_major && v >= x0 && v <= x1)
+            soft_raster__plot(&r->pixels[(size_t)u * r->stride + v], l);
+        else if (!l->y_major && v >= y0 && v <= y1)
+            soft_raster__plot(&r->pixels[(size_t)v * r->stride + u], l);
+    }
+}
+
+/*
+ * Narrows [*x0, *x1] to the pixels of row y that can be inside every edge,
+ * a pixel wider on each side than the edges put it so that rounding never
+ * loses one; the edge test still decides. Returns 0 for an empty row.
+ */
+static int
+soft_raster__span(const struct soft_raster__triangle *t, int y, int *x0, int *x1)
+{
+    float left = (float)*x0, right = (float)*x1;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        float row = t->b[i] * (float)y + t->c[i];
+        if (t->a[i] > 0.0f)
+            left = SOFT_RASTER__MAX(left, floorf(-row * t->inv_a[i]) - 1.0f);
+        else if (t->a[i] < 0.0f)
+            right = SOFT_RASTER__MIN(right, ceilf(-row * t->inv_a[i]) + 1.0f);
+        else if (row < 0.0f)
+            return 0;
+    }
+    if (left > right)
+        return 0;
+    *x0 = (int)left;
+    *x1 = (int)right;
+    return 1;
+}
+
+#if SOFT_RASTER__SSE
+
+static __m128
+soft_raster__inside(__m128 e, int ties)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 inside = _mm_cmpgt_ps(e, zero);
+    if (ties)
+        inside = _mm_or_ps(inside, _mm_cmpeq_ps(e, zero));
+    return inside;
+}
+
+static __m128i
+soft_raster__pack4(__m128 r, __m128 g, __m128 b, __m128 a)
+{
+    __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(255.0f);
+    __m128i ri = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(r, lo), hi));
+    __m128i gi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(g, lo), hi));
+    __m128i bi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, lo), hi));
+    __m128i ai = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(a, lo), hi));
+    return _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)),
+                        _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_slli_epi32(ai, 24)));
+}
+
+/* colors in 0..1 scaled up to 0..255 and blended over dst */
+static __m128i
+soft_raster__shade4(__m128i dst, __m128 c[4], int blend)
+{
+    __m128 scale = _mm_set1_ps(255.0f);
+    int i;
+
+    if (!blend)
+        return soft_raster__pack4(_mm_mul_ps(c[0], scale), _mm_mul_ps(c[1], scale),
+                                  _mm_mul_ps(c[2], scale), _mm_mul_ps(c[3], scale));
+    {
+        __m128i mask = _mm_set1_epi32(0xff);
+        __m128 a = c[3], keep = _mm_sub_ps(_mm_set1_ps(1.0f), c[3]), out[4];
+        for (i = 0; i < 4; i++) {
+            __m128 d = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(dst, i * 8), mask));
+            out[i] = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(c[i], scale), a), _mm_mul_ps(d, keep));
+        }
+        return soft_raster__pack4(out[0], out[1], out[2], out[3]);
+    }
+}
+
+static void
+soft_raster__draw_triangle(struct soft_raster *r, const struct soft_raster__triangle *t,
+                           int x0, int y0, int x1, int y1)
+{
+    __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 a0 = _mm_set1_ps(t->a[0]), a1 = _mm_set1_ps(t->a[1]), a2 = _mm_set1_ps(t->a[2]);
+    __m128 last = _mm_set1_ps((float)x1);
+    __m128 flat[4];
+    int x, y, i;
+
+    for (i = 0; i < 4; i++)
+        flat[i] = _mm_set1_ps(t->rgba[i]);
+    for (y = y0; y <= y1; y++) {
+        Uint32 *row = r->pixels + (size_t)y * r->stride;
+        __m128 r0 = _mm_set1_ps(t->b[0] * (float)y + t->c[0]);
+        __m128 r1 = _mm_set1_ps(t->b[1] * (float)y + t->c[1]);
+        __m128 r2 = _mm_set1_ps(t->b[2] * (float)y + t->c[2]);
+        int first = x0, end = x1;
+
+        if (!soft_raster__span(t, y, &first, &end))
+            continue;
+        for (x = first & ~3; x <= end; x += 4) {
+            __m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lane);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, xs), r0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, xs), r1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, xs), r2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(soft_raster__inside(e0, t->ties[0]),
+                                                  soft_raster__inside(e1, t->ties[1])),
+                                       _mm_and_ps(soft_raster__inside(e2, t->ties[2]),
+                                                  _mm_cmple_ps(xs, last)));
+            __m128i mask, dst, src;
+
+            if (!_mm_movemask_ps(inside))
+                continue;
+            mask = _mm_castps_si128(inside);
+            dst = _mm_loadu_si128((const __m128i *)(row + x));
+            if (t->smooth) {
+                __m128 inv_area = _mm_set1_ps(t->inv_area), c[4], q;
+                __m128 l0 = _mm_mul_ps(e0, inv_area), l1 = _mm_mul_ps(e1, inv_area);
+                __m128 l2 = _mm_mul_ps(e2, inv_area);
+                q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t->q[0])),
+                                          _mm_mul_ps(l1, _mm_set1_ps(t->q[1]))),
+                               _mm_mul_ps(l2, _mm_set1_ps(t->q[2])));
+                q = _mm_div_ps(_mm_set1_ps(1.0f), q);
+                for (i = 0; i < 4; i++)
+                    c[i] = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(t->cq[i][0])),
+                                                            _mm_mul_ps(l1, _mm_set1_ps(t->cq[i][1]))),
+                                                 _mm_mul_ps(l2, _mm_set1_ps(t->cq[i][2]))), q);
+                src = soft_raster__shade4(dst, c, t->blend);
+            } else if (t->blend) {
+                src = soft_raster__shade4(dst, flat, 1);
+            } else {
+                src = _mm_set1_epi32((int)t->color);
+            }
+            _mm_storeu_si128((__m128i *)(row + x),
+                             _mm_or_si128(_mm_and_si128(mask, src), _mm_andnot_si128(mask, dst)));
+        }
+    }
+}
+
+#else
+
+static int
+soft_raster__inside(float e, int ties)
+{
+    return e > 0.0f || (ties && e == 0.0f);
+}
+
+static void
+soft_raster__draw_triangle(struct soft_raster *r, const struct soft_raster__triangle *t,
+                           int x0, int y0, int x1, int y1)
+{
+    int x, y, i;
+
+    for (y = y0; y <= y1; y++) {
+        Uint32 *row = r->pixels + (size_t)y * r->stride;
+        float r0 = t->b[0] * (float)y + t->c[0];
+        float r1 = t->b[1] * (float)y + t->c[1];
+        float r2 = t->b[2] * (float)y + t->c[2];
+        int first = x0, end = x1;
+
+        if (!soft_raster__span(t, y, &first, &end))
+            continue;
+        for (x = first; x <= end; x++) {
+            float e0 = t->a[0] * (float)x + r0;
+            float e1 = t->a[1] * (float)x + r1;
+            float e2 = t->a[2] * (float)x + r2;
+            float c[4];
+            Uint32 dst, out = 0;
+
+            if (!soft_raster__inside(e0, t->ties[0]) || !soft_raster__inside(e1, t->ties[1]) ||
+                !soft_raster__inside(e2, t->ties[2]))
+                continue;
+            if (!t->smooth && !t->blend) {
+                row[x] = t->color;
+                continue;
+            }
+            memcpy(c, t->rgba, sizeof(c));
+            if (t->smooth) {
+                float l0 = e0 * t->inv_area, l1 = e1 * t->inv_area, l2 = e2 * t->inv_area;
+                float q = 1.0f / (l0 * t->q[0] + l1 * t->q[1] + l2 * t->q[2]);
+                for (i = 0; i < 4; i++)
+                    c[i] = (l0 * t->cq[i][0] + l1 * t->cq[i][1] + l2 * t->cq[i][2]) * q;
+            }
+            dst = row[x];
+            for (i = 0; i < 4; i++) {
+                float v = c[i] * 255.0f;
+                if (t->blend)
+                    v = v * c[3] + (float)((dst >> (i * 8)) & 0xff) * (1.0f - c[3]);
+                v = v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v;
+                out |= (Uint32)(v + 0.5f) << (i * 8);
+            }
+            row[x] = out;
+        }
+    }
+}
+
+#endif
+
+static void
+soft_raster__raster_pass(struct soft_raster__worker *w)
+{
+    struct soft_raster *r = w->r;
+    int tile_count = r->tiles_x * r->tiles_y;
+    int tile;
+
+    while ((tile = SDL_AtomicAdd(&r->next_tile, 1)) < tile_count) {
+        int x0 = tile % r->tiles_x * SOFT_RASTER_TILE, y0 = tile / r->tiles_x * SOFT_RASTER_TILE;
+        int x1 = SOFT_RASTER__MIN(x0 + SOFT_RASTER_TILE, r->width) - 1, y1 = SOFT_RASTER__MIN(y0 + SOFT_RASTER_TILE, r->height) - 1;
+        int i, k, x, y;
+
+        if (r->clear)
+            for (y = y0; y <= y1; y++)
+                for (x = x0; x <= x1; x++)
+                    r->pixels[(size_t)y * r->stride + x] = r->clear_color;
+
+        for (i = 0; i < r->thread_count; i++) {
+            const struct soft_raster__worker *binner = &r->workers[i];
+            const struct soft_raster__bin *bin = &binner->bins[tile];
+            for (k = 0; k < bin->count; k++) {
+                Uint32 item = bin->items[k];
+                if (item & 1) {
+                    soft_raster__draw_line(r, &binner->lines[item >> 1], x0, y0, x1, y1);
+                } else {
+                    const struct soft_raster__triangle *t = &binner->tris[item >> 1];
+                    soft_raster__draw_triangle(r, t, SOFT_RASTER__MAX(t->x0, x0), SOFT_RASTER__MAX(t->y0, y0),
+                                               SOFT_RASTER__MIN(t->x1, x1), SOFT_RASTER__MIN(t->y1, y1));
+                }
+            }
+        }
+    }
+}
+
+static void
+soft_raster__run(struct soft_raster__worker *w)
+{
+    if (w->r->phase == SOFT_RASTER__BIN) {
+        SOFT_RASTER__BEGIN(zone, "raster bin");
+        soft_raster__bin_pass(w);
+        SOFT_RASTER__END(zone);
+    } else {
+        SOFT_RASTER__BEGIN(zone, "raster tiles");
+        soft_raster__raster_pass(w);
+        SOFT_RASTER__END(zone);
+    }
+}
+
+static int
+soft_raster__thread(void *data)
+{
+    struct soft_raster__worker *w = data;
+
+    SOFT_RASTER__THREAD("raster worker");
+    for (;;) {
+        SDL_SemWait(w->start);
+        if (w->r->phase == SOFT_RASTER__QUIT)
+            break;
+        soft_raster__run(w);
+        SDL_SemPost(w->r->done);
+    }
+    return 0;
+}
+
+/* Runs phase on every thread, the caller being the last one */
+static void
+soft_raster__phase(struct soft_raster *r, enum soft_raster__phase phase)
+{
+    int i;
+
+    r->phase = phase;
+    for (i = 0; i < r->thread_count - 1; i++)
+        SDL_SemPost(r->workers[i].start);
+    soft_raster__run(&r->workers[r->thread_count - 1]);
+    for (i = 0; i < r->thread_count - 1; i++)
+        SDL_SemWait(r->done);
+}
+
+struct soft_raster *
+soft_raster_create(int width, int height, int threads)
+{
+    struct soft_raster *r = calloc(1, sizeof(*r));
+    int i;
+
+    if (!r)
+        return NULL;
+    if (threads <= 0)
+        threads = SDL_GetCPUCount();
+    r->thread_count = SOFT_RASTER__MAX(1, SOFT_RASTER__MIN(threads, SOFT_RASTER_MAX_THREADS));
+    r->width = width;
+    r->height = height;
+    r->stride = (width + 3) & ~3;
+    r->tiles_x = (width + SOFT_RASTER_TILE - 1) / SOFT_RASTER_TILE;
+    r->tiles_y = (height + SOFT_RASTER_TILE - 1) / SOFT_RASTER_TILE;
+    r->guard_x = 1.0f + 2.0f * SOFT_RASTER_GUARD / (float)width;
+    r->guard_y = 1.0f + 2.0f * SOFT_RASTER_GUARD / (float)height;
+    r->pixels = calloc((size_t)r->stride * height, sizeof(*r->pixels));
+    r->done = SDL_CreateSemaphore(0);
+    if (!r->pixels || !r->done) {
+        r->thread_count = 0;
+        soft_raster_destroy(r);
+        return NULL;
+    }
+
+    for (i = 0; i < r->thread_count; i++) {
+        struct soft_raster__worker *w = &r->workers[i];
+        w->r = r;
+        w->index = i;
+        w->bins = calloc((size_t)r->tiles_x * r->tiles_y, sizeof(*w->bins));
+        if (!w->bins)
+            break;
+        if (i == r->thread_count - 1)
+            continue;
+        w->start = SDL_CreateSemaphore(0);
+        if (w->start)
+            w->thread = SDL_CreateThread(soft_raster__thread, "raster worker", w);
+        if (!w->thread) {
+            SDL_DestroySemaphore(w->start);
+            w->start = NULL;
+            free(w->bins);
+            w->bins = NULL;
+            break;
+        }
+    }
+    if (i < r->thread_count) {
+        r->thread_count = i;
+        soft_raster_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void
+soft_raster__stop(struct soft_raster *r)
+{
+    int i;
+    r->phase = SOFT_RASTER__QUIT;
+    for (i = 0; i < r->thread_count; i++) {
+        if (!r->workers[i].thread)
+            continue;
+        SDL_SemPost(r->workers[i].start);
+        SDL_WaitThread(r->workers[i].thread, NULL);
+        SDL_DestroySemaphore(r->workers[i].start);
+    }
+}
+
+void
+soft_raster_destroy(struct soft_raster *r)
+{
+    int i, tile;
+
+    if (!r)
+        return;
+    soft_raster__stop(r);
+    for (i = 0; i < r->thread_count; i++) {
+        struct soft_raster__worker *w = &r->workers[i];
+        if (w->bins)
+            for (tile = 0; tile < r->tiles_x * r->tiles_y; tile++)
+                free(w->bins[tile].items);
+        free(w->bins);
+        free(w->tris);
+        free(w->lines);
+    }
+    if (r->done)
+        SDL_DestroySemaphore(r->done);
+    free(r->queue);
+    free(r->pixels);
+    free(r);
+}
+
+int
+soft_raster_threads(const struct soft_raster *r)
+{
+    return r->thread_count;
+}
+
+void
+soft_raster_clear(struct soft_raster *r, const float color[4])
+{
+    r->queue_count = 0;
+    r->prim_count = 0;
+    r->clear = 1;
+    r->clear_color = soft_raster__pack(color);
+}
+
+int
+soft_raster_draw(struct soft_raster *r, const struct soft_raster_draw *draw)
+{
+    struct soft_raster__queued *queued;
+    int per = draw->primitive == SOFT_RASTER_LINES ? 2 : 3;
+
+    if (draw->count < per)
+        return 1;
+    queued = soft_raster__grow(r->queue, &r->queue_capacity, r->queue_count, sizeof(*queued));
+    if (!queued)
+        return 0;
+    r->queue = queued;
+    queued += r->queue_count++;
+    queued->draw = *draw;
+    queued->first = r->prim_count;
+    queued->prims = (unsigned long)(draw->count / per);
+    r->prim_count += queued->prims;
+    return 1;
+}
+
+void
+soft_raster_finish(struct soft_raster *r)
+{
+    Uint64 start = SDL_GetPerformanceCounter(), binned;
+    double ms_per_tick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+    int i;
+
+    for (i = 0; i < r->thread_count; i++)
+        memset(&r->workers[i].stats, 0, sizeof(r->workers[i].stats));
+    soft_raster__phase(r, SOFT_RASTER__BIN);
+    binned = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&r->next_tile, 0);
+    soft_raster__phase(r, SOFT_RASTER__RASTER);
+
+    memset(&r->stats, 0, sizeof(r->stats));
+    r->stats.primitives = r->prim_count;
+    for (i = 0; i < r->thread_count; i++) {
+        const struct soft_raster_stats *s = &r->workers[i].stats;
+        r->stats.triangles += s->triangles;
+        r->stats.lines += s->lines;
+        r->stats.clipped += s->clipped;
+        r->stats.culled += s->culled;
+        r->stats.bin_entries += s->bin_entries;
+        r->stats.dropped += s->dropped;
+    }
+    r->stats.bin_ms = (double)(binned - start) * ms_per_tick;
+    r->stats.raster_ms = (double)(SDL_GetPerformanceCounter() - binned) * ms_per_tick;
+
+    r->queue_count = 0;
+    r->prim_count = 0;
+    r->clear = 0;
+}
+
+void
+soft_raster_read_rgb(const struct soft_raster *r, unsigned char *rgb)
+{
+    int x, y;
+    for (y = 0; y < r->height; y++) {
+        const Uint32 *row = r->pixels + (size_t)y * r->stride;
+        for (x = 0; x < r->width; x++) {
+            *rgb++ = (unsigned char)(row[x] & 0xff);
+            *rgb++ = (unsigned char)((row[x] >> 8) & 0xff);
+            *rgb++ = (unsigned char)((row[x] >> 16) & 0xff);
+        }
+    }
+}
+
+const struct soft_raster_stats *
+soft_raster_stats(const struct soft_raster *r)
+{
+    return &r->stats;
+}
+
+#endif